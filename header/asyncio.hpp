@@ -0,0 +1,580 @@
+/*
+ * asyncio.hpp
+ *  a class to read a region of a file keeping some reads in flight
+ *
+ *  This uses io_uring on Linux, and falls back to threads that call
+ *  pread(4) when io_uring isn't available at compile time or at run time
+ *  (old kernels, seccomp and so on). Define NO_IO_URING to disable
+ *  io_uring. Link the thread library with GCC:
+ *
+ *      > g++ -Wall --pedantic -pthread main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#ifndef ASYNCIO_HPP
+#define ASYNCIO_HPP
+
+#if defined(__linux__) && !defined(NO_IO_URING) && defined(__has_include)
+#   if __has_include(<linux/io_uring.h>)
+#       define ASYNCIO_IO_URING
+#   endif
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+#ifdef ASYNCIO_IO_URING
+#   include <cerrno>
+#   include <linux/io_uring.h>
+#   include <sys/mman.h>    // for mmap(6), munmap(2)
+#   include <sys/syscall.h> // for __NR_io_uring_setup, __NR_io_uring_enter
+#   include <sys/uio.h>     // for struct iovec
+#   include <unistd.h>      // for syscall(2), close(1)
+#endif
+
+#include "dlogger.hpp"
+#include "rawfile.hpp"
+#include "thread.hpp"
+
+namespace util {
+    namespace file {
+        /*
+         *  A class to read a region of a file sequentially in large blocks.
+         *  At most depth blocks are read ahead while the consumer processes
+         *  the current one.
+         *  Usage:
+         *
+         *      util::file::async_reader reader(1 << 20, 4);
+         *      // the region [first, last) in blocks of multiple of unit
+         *      if (!reader.open("foo.wav", first, last, unit)) return 1;
+         *      async_reader::buffer_type buffer;
+         *      while (reader.next(buffer)) {
+         *          process(buffer.data, buffer.size);
+         *      }
+         *      if (reader.failed()) return 1;
+         *
+         *  Give the size of a frame (RIFF WAV) or the stride of a row
+         *  (Windows Bitmap) as unit, then every buffer contains whole frames
+         *  or rows. The data of a buffer is valid until the next call of
+         *  next(1) or close(0). This object is not copyable.
+         * */
+        class async_reader {
+            public:
+                // a block that has been read
+                struct buffer_type {
+                    uint64_t offset;
+                    const char* data;
+                    std::size_t size;
+                };
+
+                enum backend_type {
+                    NOTHING,
+                    IO_URING,
+                    THREADS
+                };
+
+                static const std::size_t default_depth = 4;
+
+            private:
+                enum state_type {
+                    IDLE,
+                    QUEUED,
+                    READY,
+                    FAILED
+                };
+
+                struct slot_type {
+                    aligned_buffer* buffer;
+                    uint64_t offset;
+                    std::size_t size;
+                    std::size_t done;
+                    // written by the engines under their locks
+                    state_type state;
+                    // whether a read is submitted, that only the caller uses
+                    bool submitted;
+#ifdef ASYNCIO_IO_URING
+                    struct iovec vector;
+#endif
+                };
+
+                typedef std::vector<slot_type>  slots_type;
+
+                // interface of backends
+                class engine_base {
+                    public:
+                        virtual ~engine_base(void) {}
+                        virtual bool submit(slot_type& slot) = 0;
+                        virtual bool wait(slot_type& slot) = 0;
+                };
+
+#ifdef ASYNCIO_IO_URING
+                // io_uring through the system calls without liburing
+                class uring_engine : public engine_base {
+                    private:
+                        int ring;
+                        int fd;
+                        slots_type& slots;
+                        unsigned int inflight;
+
+                        void* sq_ring;
+                        std::size_t sq_ring_size;
+                        void* cq_ring;
+                        std::size_t cq_ring_size;
+                        io_uring_sqe* sqes;
+                        std::size_t sqes_size;
+
+                        unsigned int* sq_tail;
+                        unsigned int* sq_mask;
+                        unsigned int* sq_array;
+                        unsigned int* cq_head;
+                        unsigned int* cq_tail;
+                        unsigned int* cq_mask;
+                        io_uring_cqe* cqes;
+
+                    public:
+                        // constructor
+                        uring_engine(int fd, slots_type& slots)
+                            : ring(-1), fd(fd), slots(slots), inflight(0),
+                              sq_ring(MAP_FAILED), cq_ring(MAP_FAILED),
+                              sqes(0) {
+                            io_uring_params params;
+                            std::memset(&params, 0, sizeof(params));
+                            ring = static_cast<int>(syscall(
+                                        __NR_io_uring_setup,
+                                        static_cast<unsigned int>(
+                                            slots.size()),
+                                        &params));
+                            if (ring < 0) return;
+
+                            sq_ring_size = params.sq_off.array
+                                + params.sq_entries * sizeof(unsigned int);
+                            cq_ring_size = params.cq_off.cqes
+                                + params.cq_entries * sizeof(io_uring_cqe);
+                            sqes_size =
+                                params.sq_entries * sizeof(io_uring_sqe);
+
+                            sq_ring = mmap(0, sq_ring_size,
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE,
+                                    ring, IORING_OFF_SQ_RING);
+                            cq_ring = mmap(0, cq_ring_size,
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE,
+                                    ring, IORING_OFF_CQ_RING);
+                            void* p = mmap(0, sqes_size,
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE,
+                                    ring, IORING_OFF_SQES);
+                            if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED
+                                    || p == MAP_FAILED) {
+                                if (p != MAP_FAILED) munmap(p, sqes_size);
+                                release();
+                                return;
+                            }
+                            sqes = static_cast<io_uring_sqe*>(p);
+
+                            char* sq = static_cast<char*>(sq_ring);
+                            char* cq = static_cast<char*>(cq_ring);
+                            sq_tail = field(sq, params.sq_off.tail);
+                            sq_mask = field(sq, params.sq_off.ring_mask);
+                            sq_array = field(sq, params.sq_off.array);
+                            cq_head = field(cq, params.cq_off.head);
+                            cq_tail = field(cq, params.cq_off.tail);
+                            cq_mask = field(cq, params.cq_off.ring_mask);
+                            cqes = reinterpret_cast<io_uring_cqe*>(
+                                    cq + params.cq_off.cqes);
+                        }
+
+                        // destructor
+                        ~uring_engine(void) {
+                            // The kernel writes to the buffers until the
+                            // reads complete.
+                            while (inflight > 0 && reap()) {}
+                            release();
+                        }
+
+                        bool is_available(void) const { return sqes != 0; }
+
+                        bool submit(slot_type& slot) {
+                            const unsigned int tail = *sq_tail;
+                            const unsigned int index = tail & *sq_mask;
+                            io_uring_sqe& sqe = sqes[index];
+
+                            slot.vector.iov_base = slot.buffer->data()
+                                + slot.done;
+                            slot.vector.iov_len = slot.size - slot.done;
+                            std::memset(&sqe, 0, sizeof(sqe));
+                            sqe.opcode = IORING_OP_READV;
+                            sqe.fd = fd;
+                            sqe.off = slot.offset + slot.done;
+                            sqe.addr = reinterpret_cast<uintptr_t>(
+                                    &slot.vector);
+                            sqe.len = 1;
+                            sqe.user_data = &slot - &slots[0];
+                            sq_array[index] = index;
+                            __atomic_store_n(sq_tail, tail + 1,
+                                    __ATOMIC_RELEASE);
+
+                            int result;
+                            do {
+                                result = enter(1, 0, 0);
+                            } while (result < 0 && errno == EINTR);
+                            if (result != 1) {
+                                DBGLOG("Can't submit a read at "
+                                        << slot.offset);
+                                slot.state = FAILED;
+                                return false;
+                            }
+                            slot.state = QUEUED;
+                            ++inflight;
+                            return true;
+                        }
+
+                        bool wait(slot_type& slot) {
+                            while (slot.state == QUEUED) {
+                                if (!reap()) return false;
+                            }
+                            return slot.state == READY;
+                        }
+
+                    private:
+                        static unsigned int* field(char* ring, uint32_t off) {
+                            return reinterpret_cast<unsigned int*>(ring + off);
+                        }
+
+                        int enter(unsigned int to_submit,
+                                  unsigned int min_complete,
+                                  unsigned int flags) {
+                            return static_cast<int>(syscall(
+                                        __NR_io_uring_enter, ring,
+                                        to_submit, min_complete, flags,
+                                        0, 0));
+                        }
+
+                        // This consumes the completions, waits one if
+                        // there are none.
+                        bool reap(void) {
+                            unsigned int head = *cq_head;
+                            unsigned int tail = __atomic_load_n(
+                                    cq_tail, __ATOMIC_ACQUIRE);
+                            if (head == tail) {
+                                if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0
+                                        && errno != EINTR) {
+                                    DBGLOG("Can't wait completions");
+                                    return false;
+                                }
+                                return true;
+                            }
+
+                            for (; head != tail; ++head) {
+                                const io_uring_cqe& cqe =
+                                    cqes[head & *cq_mask];
+                                slot_type& slot = slots[cqe.user_data];
+                                --inflight;
+                                if (cqe.res <= 0) {
+                                    DBGLOG("Can't read the file at "
+                                            << slot.offset);
+                                    slot.state = FAILED;
+                                    continue;
+                                }
+                                slot.done += cqe.res;
+                                slot.state = READY;
+                                // a short read
+                                if (slot.done < slot.size) {
+                                    __atomic_store_n(cq_head, head + 1,
+                                            __ATOMIC_RELEASE);
+                                    if (!submit(slot)) return false;
+                                }
+                            }
+                            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+                            return true;
+                        }
+
+                        void release(void) {
+                            if (sqes != 0) munmap(sqes, sqes_size);
+                            if (cq_ring != MAP_FAILED) {
+                                munmap(cq_ring, cq_ring_size);
+                            }
+                            if (sq_ring != MAP_FAILED) {
+                                munmap(sq_ring, sq_ring_size);
+                            }
+                            if (ring >= 0) ::close(ring);
+                            sqes = 0;
+                            cq_ring = sq_ring = MAP_FAILED;
+                            ring = -1;
+                        }
+
+                        // not copyable
+                        uring_engine(const uring_engine&);
+                        uring_engine& operator=(const uring_engine&);
+                };
+#endif // ASYNCIO_IO_URING
+
+                // threads that call pread(4)
+                class thread_engine : public engine_base {
+                    private:
+                        // thread body
+                        struct worker_task {
+                            thread_engine* e;
+                            explicit worker_task(thread_engine* e) : e(e) {}
+                            void operator()(void) { e->work(); }
+                        };
+
+                        raw_file& file;
+                        std::deque<slot_type*> queue;
+                        std::vector<util::thread::thread*> threads;
+                        bool stopping;
+
+                        util::thread::mutex m;
+                        util::thread::condition queued;
+                        util::thread::condition completed;
+
+                    public:
+                        // constructor
+                        thread_engine(raw_file& file, unsigned int n)
+                            : file(file), stopping(false) {
+                            for (unsigned int i = 0; i < n; ++i) {
+                                threads.push_back(new util::thread::thread(
+                                            worker_task(this)));
+                            }
+                        }
+
+                        // destructor
+                        ~thread_engine(void) {
+                            {
+                                util::thread::scoped_lock lock(m);
+                                stopping = true;
+                            }
+                            queued.notify_all();
+                            // join all threads
+                            for (std::size_t i = 0; i < threads.size(); ++i) {
+                                delete threads[i];
+                            }
+                        }
+
+                        bool is_available(void) const {
+                            for (std::size_t i = 0; i < threads.size(); ++i) {
+                                if (!threads[i]->joinable()) return false;
+                            }
+                            return !threads.empty();
+                        }
+
+                        bool submit(slot_type& slot) {
+                            {
+                                util::thread::scoped_lock lock(m);
+                                slot.state = QUEUED;
+                                queue.push_back(&slot);
+                            }
+                            queued.notify_one();
+                            return true;
+                        }
+
+                        bool wait(slot_type& slot) {
+                            util::thread::scoped_lock lock(m);
+                            while (slot.state == QUEUED) completed.wait(m);
+                            return slot.state == READY;
+                        }
+
+                    private:
+                        void work(void) {
+                            for (;;) {
+                                slot_type* slot;
+                                {
+                                    util::thread::scoped_lock lock(m);
+                                    while (queue.empty() && !stopping) {
+                                        queued.wait(m);
+                                    }
+                                    if (stopping) return;
+                                    slot = queue.front();
+                                    queue.pop_front();
+                                }
+
+                                const bool succeeded = file.read(
+                                        slot->offset, slot->buffer->data(),
+                                        slot->size);
+
+                                {
+                                    util::thread::scoped_lock lock(m);
+                                    slot->done = succeeded ? slot->size : 0;
+                                    slot->state = succeeded ? READY : FAILED;
+                                }
+                                completed.notify_all();
+                            }
+                        }
+
+                        // not copyable
+                        thread_engine(const thread_engine&);
+                        thread_engine& operator=(const thread_engine&);
+                };
+
+                std::size_t block_bytes;
+                std::size_t depth;
+
+                raw_file file;
+                slots_type slots;
+                engine_base* engine;
+                backend_type kind;
+                uint64_t cursor, last;
+                std::size_t block;
+                std::size_t head;
+                // the slot that is handed to the consumer
+                slot_type* handed;
+                bool error;
+
+            public:
+                // constructor
+                explicit async_reader(std::size_t block_bytes = 1 << 20,
+                                      std::size_t depth = default_depth)
+                    : block_bytes(block_bytes), depth(depth),
+                      engine(0), kind(NOTHING), handed(0), error(false) {
+                    if (this->block_bytes == 0) this->block_bytes = 1;
+                    if (this->depth == 0) this->depth = default_depth;
+                }
+
+                // destructor
+                ~async_reader(void) { close(); }
+
+                // open and close
+                // This reads [first, last) of the file in the blocks of the
+                // largest multiple of unit that doesn't exceed block_bytes.
+                bool open(const char* path, uint64_t first, uint64_t last,
+                          std::size_t unit = 1) {
+                    close();
+
+                    if (first > last || unit == 0) {
+                        DBGLOG("Invalid region: " << first << " - " << last);
+                        return false;
+                    }
+                    if (!file.open(path, raw_file::READ)) return false;
+
+                    cursor = first;
+                    this->last = last;
+                    block = (block_bytes > unit) ? block_bytes / unit * unit
+                                                 : unit;
+
+                    slots.resize(depth);
+                    for (std::size_t i = 0; i < slots.size(); ++i) {
+                        slots[i].buffer = new aligned_buffer(
+                                block, raw_file::direct_alignment);
+                        slots[i].state = IDLE;
+                        slots[i].submitted = false;
+                        if (slots[i].buffer->data() == 0) {
+                            DBGLOG("Can't allocate buffers");
+                            close();
+                            return false;
+                        }
+                    }
+
+                    if (!start_engine()) {
+                        DBGLOG("Can't start any I/O backends");
+                        close();
+                        return false;
+                    }
+
+                    for (head = 0; head < slots.size(); ++head) {
+                        if (!fill(slots[head])) break;
+                    }
+                    head = 0;
+                    return !error;
+                }
+
+                void close(void) {
+                    delete engine;
+                    engine = 0;
+                    kind = NOTHING;
+                    for (std::size_t i = 0; i < slots.size(); ++i) {
+                        delete slots[i].buffer;
+                    }
+                    slots.clear();
+                    file.close();
+                    handed = 0;
+                    error = false;
+                }
+
+                bool is_open(void) const { return engine != 0; }
+
+                // This returns the next block in the order of the file, or
+                // false at the end of the region or on errors.
+                bool next(buffer_type& buffer) {
+                    if (engine == 0 || error) return false;
+
+                    // recycle the previous block
+                    if (handed != 0) {
+                        fill(*handed);
+                        handed = 0;
+                        if (error) return false;
+                    }
+
+                    slot_type& slot = slots[head];
+                    if (!slot.submitted) return false;
+                    if (!engine->wait(slot)) {
+                        error = true;
+                        return false;
+                    }
+
+                    buffer.offset = slot.offset;
+                    buffer.data = slot.buffer->data();
+                    buffer.size = slot.size;
+                    handed = &slot;
+                    head = (head + 1) % slots.size();
+                    return true;
+                }
+
+                // getters
+                bool failed(void) const { return error; }
+                backend_type backend(void) const { return kind; }
+
+            private:
+                bool start_engine(void) {
+#ifdef ASYNCIO_IO_URING
+                    uring_engine* uring =
+                        new uring_engine(file.native_handle(), slots);
+                    if (uring->is_available()) {
+                        engine = uring;
+                        kind = IO_URING;
+                        return true;
+                    }
+                    delete uring;
+#endif
+                    thread_engine* threads = new thread_engine(
+                            file, static_cast<unsigned int>(slots.size()));
+                    if (threads->is_available()) {
+                        engine = threads;
+                        kind = THREADS;
+                        return true;
+                    }
+                    delete threads;
+                    return false;
+                }
+
+                // This submits a read of the next block to the slot.
+                // This returns false at the end of the region.
+                bool fill(slot_type& slot) {
+                    if (cursor >= last) {
+                        slot.submitted = false;
+                        return false;
+                    }
+                    slot.offset = cursor;
+                    slot.size = static_cast<std::size_t>(
+                            std::min<uint64_t>(block, last - cursor));
+                    slot.done = 0;
+                    cursor += slot.size;
+                    slot.submitted = true;
+                    if (!engine->submit(slot)) error = true;
+                    return !error;
+                }
+
+                // not copyable
+                async_reader(const async_reader&);
+                async_reader& operator=(const async_reader&);
+        };
+    }
+}
+
+#endif // ASYNCIO_HPP
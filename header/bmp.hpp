@@ -10,12 +10,16 @@
 #ifndef BMP_HPP
 #define BMP_HPP
 
+#include <cassert>
+#include <cstddef>
+#include <cstring>
 #include <istream>
 #include <ostream>
 #include <stdint.h>
 
 #include "cast.hpp"
 #include "dlogger.hpp"
+#include "mmap.hpp"
 
 namespace format {
     namespace windows_bitmap {
@@ -30,11 +34,25 @@ namespace format {
         };
 
         // basic properties of 24bit Windows Bitmap
+        // A negative height means that the rows are stored top-down.
         struct elements_type {
             int32_t width;
             int32_t height;
         };
 
+        // the bytes of a row that is padded to 4 bytes boundary
+        // This is calculated in 64 bits not to wrap with huge widths.
+        inline uint64_t row_bytes(int32_t width, uint16_t bits_per_pixel) {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(width))
+                    * bits_per_pixel + 31) / 32 * 4;
+        }
+
+        // the number of rows
+        inline uint32_t numof_rows(int32_t height) {
+            return height < 0 ? static_cast<uint32_t>(-(height + 1)) + 1
+                              : static_cast<uint32_t>(height);
+        }
+
 #pragma pack(push, 2)
         struct header_type {
             uint16_t kind;
@@ -92,9 +110,9 @@ namespace format {
                       numof_planes(one_plane),
                       bits_per_pixel(bytes_per_pixel * bit),
                       compression_kind(NONE),
-                      image_bytes((e.width * bytes_per_pixel + alignment
-                                  - ((e.width * bytes_per_pixel) % alignment))
-                              * e.height),
+                      image_bytes(static_cast<uint32_t>(
+                              row_bytes(e.width, bytes_per_pixel * bit)
+                              * numof_rows(e.height))),
                       horizontal_resolution(zero_resolution),
                       vertical_resolution(zero_resolution),
                       numof_colors(no_use_color_palette),
@@ -102,7 +120,7 @@ namespace format {
                 {}
 
                 // utility function
-                bool validate(void) {
+                bool validate(void) const {
                     if (header_bytes != info_header_bytes) {
                         DBGLOG( "There is a difference between a size of the"
                                 " information header and expected it"
@@ -117,9 +135,13 @@ namespace format {
                         return false;
                     }
 
-                    uint32_t calculated_image_bytes =
-                        width * height * bits_per_pixel / bit;
-                    if (image_bytes != calculated_image_bytes) {
+                    // A row is 2^45 bytes at most, so this doesn't wrap
+                    // unless the row is rejected.
+                    const uint64_t row = row_bytes(width, bits_per_pixel);
+                    const uint64_t calculated_image_bytes =
+                        row * numof_rows(height);
+                    if (row > 0xffffffff
+                            || image_bytes != calculated_image_bytes) {
                         DBGLOG( "A size of image data and calculated value"
                                 " from width, height and bits per pixel: "
                                 << image_bytes << " != "
@@ -154,10 +176,10 @@ namespace format {
             header_type(void) {}
             explicit header_type(const elements_type& e)
                 : kind(bmp_kind),
-                  file_bytes(header_all_bytes
-                          + (e.width * bytes_per_pixel + alignment
-                              - ((e.width * bytes_per_pixel) % alignment))
-                          * e.height),
+                  file_bytes(static_cast<uint32_t>(header_all_bytes
+                          + row_bytes(e.width,
+                              bytes_per_pixel * info_header_type::bit)
+                              * numof_rows(e.height))),
                   reserved01(reserved_padding),
                   reserved02(reserved_padding),
                   offset(header_all_bytes),
@@ -165,7 +187,7 @@ namespace format {
             {}
 
             // utility function
-            bool validate(void) {
+            bool validate(void) const {
                 if (kind != bmp_kind) {
                     DBGLOG("The file type is not Windows Bitmap"
                             << std::hex << "0x" << kind << " != "
@@ -185,7 +207,7 @@ namespace format {
 
             template<typename Char>
             bool validate(std::basic_istream<Char>& in) const {
-                typename std::basic_istream<Char>::streampos current =
+                typename std::basic_istream<Char>::pos_type current =
                     in.tellg();
                 in.seekg(0, std::ios::end);
                 uint32_t file_size = static_cast<uint32_t>(in.tellg());
@@ -204,7 +226,7 @@ namespace format {
 
             template<typename Char>
             bool validate(std::basic_ostream<Char>& out) const {
-                typename std::basic_ostream<Char>::streampos current =
+                typename std::basic_ostream<Char>::pos_type current =
                     out.tellp();
                 out.seekp(0, std::ios::end);
                 uint32_t file_size = static_cast<uint32_t>(out.tellp());
@@ -223,7 +245,7 @@ namespace format {
 
             // getter
             // expect NRVO
-            elements_type elements(void) {
+            elements_type elements(void) const {
                 elements_type e = {
                     info_header.width,
                     info_header.height
@@ -262,6 +284,177 @@ namespace format {
                     sizeof(header_type));
             return out;
         }
+
+        // a pixel of 24bit Windows Bitmap
+#pragma pack(push, 1)
+        struct bgr_type {
+            uint8_t blue;
+            uint8_t green;
+            uint8_t red;
+        };
+#pragma pack(pop)
+
+        /*
+         *  A class to access the pixels of 24bit Windows Bitmap file through
+         *  the memory mapping without any copies.
+         *  Usage:
+         *
+         *      format::windows_bitmap::image_view image("foo.bmp");
+         *      if (!image.validate()) return 1;
+         *      for (uint32_t y = 0; y < image.height(); ++y) {
+         *          const bgr_type* row = image.row(y);
+         *          for (uint32_t x = 0; x < image.width(); ++x) {
+         *              ... row[x].red ...
+         *          }
+         *      }
+         *
+         *  The rows are numbered from the top in spite of the order in the
+         *  file: bottom-up (positive height) or top-down (negative height).
+         *  The padding at the end of rows is skipped by row(1), and
+         *  stride() is the distance between rows in the file. Open it with
+         *  READ_WRITE to modify pixels in place.
+         *
+         *  Call validate() before any other getters.
+         * */
+        class image_view {
+            public:
+                typedef bgr_type    pixel_type;
+
+                enum mode_type {
+                    READ_ONLY   = util::file::mapping::READ_ONLY,
+                    READ_WRITE  = util::file::mapping::READ_WRITE
+                };
+
+            private:
+                util::file::mapping file;
+                header_type properties;
+
+            public:
+                // constructor
+                image_view(void) {}
+                explicit image_view(const char* path,
+                                    mode_type mode = READ_ONLY) {
+                    open(path, mode);
+                }
+
+                // open and close
+                bool open(const char* path, mode_type mode = READ_ONLY) {
+                    if (!file.open(path,
+                                static_cast<util::file::mapping::mode_type>(
+                                    mode))) {
+                        return false;
+                    }
+                    // validate() checks the size of the file
+                    if (file.size() >= sizeof(header_type)) {
+                        std::memcpy(&properties, file.data(),
+                                sizeof(header_type));
+                    }
+                    return true;
+                }
+                void close(void) { file.close(); }
+                bool is_open(void) const { return file.is_open(); }
+
+                // utility function
+                bool validate(void) const {
+                    if (!file.is_open()) {
+                        DBGLOG("The file is not opened");
+                        return false;
+                    }
+                    if (file.size() < sizeof(header_type)) {
+                        DBGLOG("The file is smaller than the header: "
+                                << file.size());
+                        return false;
+                    }
+                    if (!properties.validate()
+                            || !properties.info_header.validate()) {
+                        return false;
+                    }
+                    if (properties.info_header.bits_per_pixel
+                            != header_type::bytes_per_pixel
+                                * header_type::info_header_type::bit) {
+                        DBGLOG("I treat only 24bit Windows Bitmap file: "
+                                << properties.info_header.bits_per_pixel);
+                        return false;
+                    }
+                    if (properties.info_header.width <= 0) {
+                        DBGLOG("Invalid width: "
+                                << properties.info_header.width);
+                        return false;
+                    }
+
+                    const uint64_t row = row_bytes(
+                            properties.info_header.width,
+                            properties.info_header.bits_per_pixel);
+                    if (static_cast<uint64_t>(width()) * sizeof(pixel_type)
+                            > row) {
+                        DBGLOG("The pixels are larger than the row: "
+                                << width() << " pixels in " << row
+                                << " bytes");
+                        return false;
+                    }
+                    const uint64_t end = properties.offset + row * height();
+                    if (end > file.size()) {
+                        DBGLOG("The file is smaller than the image: "
+                                << file.size() << " < " << end);
+                        return false;
+                    }
+                    return true;
+                }
+
+                // getters
+                const header_type& header(void) const { return properties; }
+                elements_type elements(void) const {
+                    return properties.elements();
+                }
+                uint32_t width(void) const {
+                    return static_cast<uint32_t>(properties.info_header.width);
+                }
+                uint32_t height(void) const {
+                    return numof_rows(properties.info_header.height);
+                }
+                bool is_top_down(void) const {
+                    return properties.info_header.height < 0;
+                }
+                std::size_t stride(void) const {
+                    return static_cast<std::size_t>(row_bytes(
+                                properties.info_header.width,
+                                properties.info_header.bits_per_pixel));
+                }
+
+                // the rows from the top
+                const pixel_type* row(uint32_t y) const {
+                    return util::cast::constpointer_cast<const pixel_type*>(
+                            row_data(y));
+                }
+                pixel_type* row(uint32_t y) {
+                    return util::cast::pointer_cast<pixel_type*>(
+                            const_cast<char*>(row_data(y)));
+                }
+
+                const pixel_type& operator()(uint32_t x, uint32_t y) const {
+                    assert(x < width());
+                    return row(y)[x];
+                }
+                pixel_type& operator()(uint32_t x, uint32_t y) {
+                    assert(x < width());
+                    return row(y)[x];
+                }
+
+                // the whole pixel array in the order of the file
+                const char* data(void) const {
+                    return file.data() + properties.offset;
+                }
+                std::size_t data_size(void) const {
+                    return stride() * height();
+                }
+
+            private:
+                const char* row_data(uint32_t y) const {
+                    assert(y < height());
+                    const uint32_t n = is_top_down() ? y : height() - 1 - y;
+                    return data() + static_cast<std::size_t>(n) * stride();
+                }
+        };
     }
 }
 
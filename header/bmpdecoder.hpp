@@ -0,0 +1,680 @@
+/*
+ * bmpdecoder.hpp
+ *  a class to decode Windows Bitmap files of any common formats into BGR24
+ *  or RGBA32 pixels
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ *
+ * formats
+ *  bits    compression                 pixels
+ *   1      NONE                        palette
+ *   4      NONE, RUN_LENGTH_4BPP       palette
+ *   8      NONE, RUN_LENGTH_8BPP       palette
+ *  16      NONE (5-5-5), BIT_FIELDS    bit fields
+ *  24      NONE                        BGR
+ *  32      NONE (BGRX), BIT_FIELDS     bit fields
+ *
+ *  The information header can be BITMAPCOREHEADER (12 bytes),
+ *  BITMAPINFOHEADER (40 bytes) or its successors up to BITMAPV5HEADER. The
+ *  bit fields are scaled to 8 bits; the alpha is 255 unless the file has
+ *  the alpha mask.
+ * */
+
+#ifndef BMPDECODER_HPP
+#define BMPDECODER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "bmp.hpp"
+#include "cast.hpp"
+#include "dlogger.hpp"
+#include "pixconv.hpp"
+#include "simd.hpp"
+
+namespace format {
+    namespace windows_bitmap {
+        /*
+         *  A channel in bit fields.
+         *  The value is ((pixel & mask) >> shift) * scale >> 8 | fill, that
+         *  maps the maximum of the field to 255. shift drops the low bits
+         *  of the fields that are wider than 8 bits.
+         * */
+        struct bitfield_type {
+            uint32_t mask;
+            unsigned int shift;
+            uint32_t scale;
+            uint32_t fill;
+
+            // constructor
+            bitfield_type(void) : mask(0), shift(0), scale(0), fill(0) {}
+            bitfield_type(uint32_t field_mask, uint32_t default_value)
+                : mask(field_mask), shift(0), scale(0), fill(0) {
+                if (mask == 0) {
+                    fill = default_value;
+                    return;
+                }
+
+                unsigned int bits = 0;
+                while (((mask >> shift) & 1) == 0) ++shift;
+                while (shift + bits < 32 && ((mask >> (shift + bits)) & 1)) {
+                    ++bits;
+                }
+                if (bits > 8) {
+                    shift += bits - 8;
+                    bits = 8;
+                }
+                mask = mask >> shift << shift;
+                const uint32_t maximum = (1u << bits) - 1;
+                // ceil(255 * 256 / maximum)
+                scale = (255 * 256 + maximum - 1) / maximum;
+            }
+
+            uint8_t operator()(uint32_t pixel) const {
+                return static_cast<uint8_t>(
+                        ((((pixel & mask) >> shift) * scale) >> 8) | fill);
+            }
+        };
+
+        /*
+         *  SIMD kernels of bit fields -> RGBA32
+         *  They return the number of processed pixels like pixel_kernel.
+         *  The fields are red, green, blue and alpha.
+         * */
+        template<const unsigned int Byte> struct bitfield_kernel {
+            static std::size_t
+            unpack(const char*, const bitfield_type*, char*, std::size_t) {
+                return 0;
+            }
+        };
+
+#ifdef SIMD_SSE2
+        // the common part: 8 pixels in 2 vectors of 32 bits -> RGBA32
+        struct bitfield_unpacker {
+            __m128i mask[4];
+            __m128i shift[4];
+            __m128i scale[4];
+            __m128i fill[4];
+
+            explicit bitfield_unpacker(const bitfield_type* fields) {
+                for (unsigned int c = 0; c < 4; ++c) {
+                    mask[c] = _mm_set1_epi32(
+                            static_cast<int>(fields[c].mask));
+                    shift[c] = _mm_cvtsi32_si128(
+                            static_cast<int>(fields[c].shift));
+                    scale[c] = _mm_set1_epi16(
+                            static_cast<short>(fields[c].scale));
+                    fill[c] = _mm_set1_epi16(
+                            static_cast<short>(fields[c].fill));
+                }
+            }
+
+            // 8 values of the channel c in 16 bits
+            __m128i channel(__m128i lo, __m128i hi, unsigned int c) const {
+                lo = _mm_srl_epi32(_mm_and_si128(lo, mask[c]), shift[c]);
+                hi = _mm_srl_epi32(_mm_and_si128(hi, mask[c]), shift[c]);
+                const __m128i v = _mm_slli_epi16(_mm_packs_epi32(lo, hi), 8);
+                return _mm_or_si128(_mm_mulhi_epu16(v, scale[c]), fill[c]);
+            }
+
+            void operator()(__m128i lo, __m128i hi, char* dst) const {
+                using namespace util::simd;
+                const __m128i rg = _mm_or_si128(channel(lo, hi, 0),
+                        _mm_slli_epi16(channel(lo, hi, 1), 8));
+                const __m128i ba = _mm_or_si128(channel(lo, hi, 2),
+                        _mm_slli_epi16(channel(lo, hi, 3), 8));
+                store128(dst, _mm_unpacklo_epi16(rg, ba));
+                store128(dst + 16, _mm_unpackhi_epi16(rg, ba));
+            }
+        };
+
+        template<> struct bitfield_kernel<2> {
+            static std::size_t
+            unpack( const char* src, const bitfield_type* fields, char* dst,
+                    std::size_t n) {
+                using namespace util::simd;
+                const bitfield_unpacker unpacker(fields);
+                const __m128i zero = _mm_setzero_si128();
+                std::size_t i = 0;
+                for (; i + 8 <= n; i += 8) {
+                    const __m128i v = load128(src + i * 2);
+                    unpacker(_mm_unpacklo_epi16(v, zero),
+                             _mm_unpackhi_epi16(v, zero), dst + i * 4);
+                }
+                return i;
+            }
+        };
+
+        template<> struct bitfield_kernel<4> {
+            static std::size_t
+            unpack( const char* src, const bitfield_type* fields, char* dst,
+                    std::size_t n) {
+                using namespace util::simd;
+                const bitfield_unpacker unpacker(fields);
+                std::size_t i = 0;
+                for (; i + 8 <= n; i += 8) {
+                    unpacker(load128(src + i * 4), load128(src + i * 4 + 16),
+                             dst + i * 4);
+                }
+                return i;
+            }
+        };
+#endif // SIMD_SSE2
+
+        // bit fields -> RGBA32
+        template<const unsigned int Byte>
+        inline void
+        unpack_bitfields(   const char* src, std::size_t numof_pixels,
+                            const bitfield_type* fields, rgba_type* dst) {
+            std::size_t i = bitfield_kernel<Byte>::unpack(src, fields,
+                    util::cast::pointer_cast<char*>(dst), numof_pixels);
+            for (; i < numof_pixels; ++i) {
+                uint32_t pixel = 0;
+                for (unsigned int b = 0; b < Byte; ++b) {
+                    pixel |= static_cast<uint32_t>(static_cast<uint8_t>(
+                                src[i * Byte + b])) << (b * 8);
+                }
+                dst[i].red = fields[0](pixel);
+                dst[i].green = fields[1](pixel);
+                dst[i].blue = fields[2](pixel);
+                dst[i].alpha = fields[3](pixel);
+            }
+        }
+
+        // to make pixels of the output format
+        template<typename Pixel> struct pixel_traits;
+        template<> struct pixel_traits<bgr_type> {
+            static bgr_type make(uint8_t r, uint8_t g, uint8_t b, uint8_t) {
+                bgr_type p = { b, g, r };
+                return p;
+            }
+        };
+        template<> struct pixel_traits<rgba_type> {
+            static rgba_type make(uint8_t r, uint8_t g, uint8_t b,
+                                  uint8_t a) {
+                rgba_type p = { r, g, b, a };
+                return p;
+            }
+        };
+
+        /*
+         *  A class to decode Windows Bitmap file on memory.
+         *  Usage:
+         *
+         *      util::file::mapping file("foo.bmp");
+         *      format::windows_bitmap::decoder bmp;
+         *      if (!bmp.read(file.data(), file.size())) return 1;
+         *      std::vector<rgba_type> pixels(bmp.width() * bmp.height());
+         *      if (!bmp.decode(&pixels[0],
+         *                  bmp.width() * sizeof(rgba_type))) {
+         *          return 1;
+         *      }
+         *
+         *  The pixels are stored from the top row, and stride is the
+         *  distance in bytes from a row to the next row below. The pixels
+         *  that are skipped by run length encoding are zero (transparent
+         *  black). The memory must be kept while this object is used.
+         * */
+        class decoder {
+            public:
+                typedef header_type::info_header_type::compression_type
+                    compression_type;
+
+                static const uint32_t core_header_bytes = 12;
+                static const uint32_t file_header_bytes = 14;
+
+            private:
+                const char* file;
+                std::size_t file_size;
+                int32_t w;
+                int32_t h;
+                uint16_t bits;
+                uint32_t compression;
+                uint32_t offset;
+                // red, green, blue and alpha
+                bitfield_type fields[4];
+                // BGRX
+                std::vector<rgba_type> palette;
+
+            public:
+                // constructor
+                decoder(void) : file(0), file_size(0) {}
+                decoder(const char* data, std::size_t size) {
+                    read(data, size);
+                }
+
+                // This reads the headers and the palette.
+                bool read(const char* data, std::size_t size) {
+                    file = 0;
+                    file_size = 0;
+                    palette.clear();
+
+                    if (size < file_header_bytes + core_header_bytes
+                            || get16(data) != header_type::bmp_kind) {
+                        DBGLOG("The file type is not Windows Bitmap");
+                        return false;
+                    }
+                    offset = get32(data + 10);
+                    const char* info = data + file_header_bytes;
+                    const uint32_t info_bytes = get32(info);
+                    if (info_bytes != core_header_bytes && info_bytes < 40) {
+                        DBGLOG("Unknown information header: " << info_bytes);
+                        return false;
+                    }
+                    // info_bytes is read from the file, so compare it
+                    // without adding not to wrap
+                    if (info_bytes > size - file_header_bytes) {
+                        DBGLOG("The file is smaller than the header");
+                        return false;
+                    }
+
+                    std::size_t palette_offset =
+                        static_cast<std::size_t>(file_header_bytes)
+                        + info_bytes;
+                    std::size_t entry_bytes = 4;
+                    uint32_t numof_colors = 0;
+                    if (info_bytes == core_header_bytes) {
+                        w = static_cast<int16_t>(get16(info + 4));
+                        h = static_cast<int16_t>(get16(info + 6));
+                        bits = get16(info + 10);
+                        compression = header_type::info_header_type::NONE;
+                        entry_bytes = 3;
+                    }
+                    else {
+                        w = static_cast<int32_t>(get32(info + 4));
+                        h = static_cast<int32_t>(get32(info + 8));
+                        bits = get16(info + 14);
+                        compression = get32(info + 16);
+                        numof_colors = get32(info + 32);
+
+                        // the masks follow BITMAPINFOHEADER, or are in the
+                        // later headers
+                        const bool alpha_bitfields = (compression == 6);
+                        if (alpha_bitfields) {
+                            compression = header_type::info_header_type::
+                                BIT_FIELDS;
+                        }
+                        if (compression == header_type::info_header_type::
+                                BIT_FIELDS) {
+                            const uint32_t numof_masks =
+                                (info_bytes >= 56 || alpha_bitfields) ? 4 : 3;
+                            const char* masks = info + 40;
+                            const uint32_t masks_end = file_header_bytes
+                                + 40 + numof_masks * 4;
+                            if (masks_end > size) {
+                                DBGLOG("The file is smaller than the masks");
+                                return false;
+                            }
+                            if (palette_offset < masks_end) {
+                                palette_offset = masks_end;
+                            }
+                            fields[0] = bitfield_type(get32(masks), 0);
+                            fields[1] = bitfield_type(get32(masks + 4), 0);
+                            fields[2] = bitfield_type(get32(masks + 8), 0);
+                            fields[3] = bitfield_type(numof_masks == 4
+                                    ? get32(masks + 12) : 0, 0xff);
+                        }
+                    }
+
+                    if (!validate()) return false;
+
+                    // the default bit fields
+                    if (compression == header_type::info_header_type::NONE) {
+                        if (bits == 16) {
+                            fields[0] = bitfield_type(0x7c00, 0);
+                            fields[1] = bitfield_type(0x03e0, 0);
+                            fields[2] = bitfield_type(0x001f, 0);
+                            fields[3] = bitfield_type(0, 0xff);
+                        }
+                        else if (bits == 32) {
+                            fields[0] = bitfield_type(0x00ff0000, 0);
+                            fields[1] = bitfield_type(0x0000ff00, 0);
+                            fields[2] = bitfield_type(0x000000ff, 0);
+                            fields[3] = bitfield_type(0, 0xff);
+                        }
+                    }
+
+                    // the palette, the entries over the maximum or the
+                    // file are ignored
+                    if (bits <= 8) {
+                        const uint32_t maximum = 1u << bits;
+                        if (numof_colors == 0 || numof_colors > maximum) {
+                            numof_colors = maximum;
+                        }
+                        const std::size_t end = (offset < size)
+                            ? offset : size;
+                        if (palette_offset < end && (end - palette_offset)
+                                / entry_bytes < numof_colors) {
+                            numof_colors = static_cast<uint32_t>(
+                                    (end - palette_offset) / entry_bytes);
+                        }
+                        else if (palette_offset >= end) {
+                            numof_colors = 0;
+                        }
+                        // indices out of the palette are black
+                        palette.assign(maximum, rgba_type());
+                        for (uint32_t i = 0; i < numof_colors; ++i) {
+                            const char* e = data + palette_offset
+                                + i * entry_bytes;
+                            palette[i].blue = static_cast<uint8_t>(e[0]);
+                            palette[i].green = static_cast<uint8_t>(e[1]);
+                            palette[i].red = static_cast<uint8_t>(e[2]);
+                            palette[i].alpha = 0xff;
+                        }
+                        for (uint32_t i = numof_colors; i < maximum; ++i) {
+                            palette[i].alpha = 0xff;
+                        }
+                    }
+
+                    if (compression != header_type::info_header_type::
+                                RUN_LENGTH_8BPP
+                            && compression != header_type::info_header_type::
+                                RUN_LENGTH_4BPP) {
+                        const uint64_t needed = static_cast<uint64_t>(offset)
+                            + static_cast<uint64_t>(row_size()) * height();
+                        if (needed > size) {
+                            DBGLOG("The file is smaller than the image: "
+                                    << size << " < " << needed);
+                            return false;
+                        }
+                    }
+                    else if (offset > size) {
+                        DBGLOG("The offset is out of the file: " << offset);
+                        return false;
+                    }
+
+                    file = data;
+                    file_size = size;
+                    return true;
+                }
+
+                // getters
+                bool is_read(void) const { return file != 0; }
+                uint32_t width(void) const { return static_cast<uint32_t>(w); }
+                uint32_t height(void) const { return numof_rows(h); }
+                bool is_top_down(void) const { return h < 0; }
+                uint16_t bits_per_pixel(void) const { return bits; }
+                uint32_t compression_kind(void) const { return compression; }
+                elements_type elements(void) const {
+                    elements_type e = { w, h };
+                    return e;
+                }
+
+                // decoding
+                bool decode(bgr_type* dst, std::ptrdiff_t stride) const {
+                    return decode_pixels(dst, stride);
+                }
+                bool decode(rgba_type* dst, std::ptrdiff_t stride) const {
+                    return decode_pixels(dst, stride);
+                }
+
+            private:
+                static uint16_t get16(const char* p) {
+                    return static_cast<uint16_t>(
+                              static_cast<uint8_t>(p[0])
+                            | static_cast<uint8_t>(p[1]) << 8);
+                }
+                static uint32_t get32(const char* p) {
+                    return    static_cast<uint32_t>(get16(p))
+                            | static_cast<uint32_t>(get16(p + 2)) << 16;
+                }
+
+                bool validate(void) const {
+                    typedef header_type::info_header_type info;
+
+                    if (w <= 0 || h == 0) {
+                        DBGLOG("Invalid size: " << w << "x" << h);
+                        return false;
+                    }
+
+                    bool supported = false;
+                    switch (compression) {
+                        case info::NONE:
+                            supported = bits == 1 || bits == 4 || bits == 8
+                                || bits == 16 || bits == 24 || bits == 32;
+                            break;
+                        case info::RUN_LENGTH_8BPP:
+                            supported = (bits == 8) && (h > 0);
+                            break;
+                        case info::RUN_LENGTH_4BPP:
+                            supported = (bits == 4) && (h > 0);
+                            break;
+                        case info::BIT_FIELDS:
+                            supported = (bits == 16 || bits == 32)
+                                && fields[0].mask != 0;
+                            break;
+                    }
+                    if (!supported) {
+                        DBGLOG("Unsupported format: " << bits << " bits,"
+                                " compression " << compression);
+                        return false;
+                    }
+                    return true;
+                }
+
+                uint64_t row_size(void) const {
+                    return (static_cast<uint64_t>(w) * bits + 31) / 32 * 4;
+                }
+
+                const char* file_row(uint32_t y) const {
+                    const uint32_t n = is_top_down() ? y : height() - 1 - y;
+                    return file + offset
+                        + static_cast<std::size_t>(row_size()) * n;
+                }
+
+                template<typename Pixel>
+                static Pixel* row_of(Pixel* top, std::ptrdiff_t stride,
+                                     uint32_t y) {
+                    return util::cast::pointer_cast<Pixel*>(
+                            util::cast::pointer_cast<char*>(top)
+                            + static_cast<std::ptrdiff_t>(y) * stride);
+                }
+
+                template<typename Pixel>
+                bool decode_pixels(Pixel* dst, std::ptrdiff_t stride) const {
+                    typedef header_type::info_header_type info;
+                    if (file == 0) {
+                        DBGLOG("The headers are not read");
+                        return false;
+                    }
+                    switch (compression) {
+                        case info::RUN_LENGTH_8BPP:
+                        case info::RUN_LENGTH_4BPP:
+                            return decode_run_length(dst, stride);
+                    }
+                    switch (bits) {
+                        case 1: decode_indexed<1>(dst, stride); break;
+                        case 4: decode_indexed<4>(dst, stride); break;
+                        case 8: decode_indexed<8>(dst, stride); break;
+                        case 16:
+                        case 32: decode_bitfields(dst, stride); break;
+                        case 24: decode_bgr(dst, stride); break;
+                    }
+                    return true;
+                }
+
+                // the palette in the output format
+                template<typename Pixel>
+                void make_colors(std::vector<Pixel>& colors) const {
+                    colors.resize(palette.size());
+                    for (std::size_t i = 0; i < palette.size(); ++i) {
+                        colors[i] = pixel_traits<Pixel>::make(
+                                palette[i].red, palette[i].green,
+                                palette[i].blue, palette[i].alpha);
+                    }
+                }
+
+                /*
+                 *  Bits pixels are expanded with the table of all bytes:
+                 *  table[byte * ppb + k] is the color of the k-th pixel in
+                 *  the byte, where ppb is 8 / Bits pixels per byte.
+                 * */
+                template<const unsigned int Bits, typename Pixel>
+                void decode_indexed(Pixel* dst, std::ptrdiff_t stride) const {
+                    const unsigned int ppb = 8 / Bits;
+                    const unsigned int index_mask = (1u << Bits) - 1;
+                    std::vector<Pixel> colors;
+                    make_colors(colors);
+                    std::vector<Pixel> table(256 * ppb);
+                    for (unsigned int b = 0; b < 256; ++b) {
+                        for (unsigned int k = 0; k < ppb; ++k) {
+                            table[b * ppb + k] = colors[
+                                (b >> (8 - Bits * (k + 1))) & index_mask];
+                        }
+                    }
+
+                    const uint32_t width = this->width();
+                    const uint32_t whole = width / ppb;
+                    const uint32_t rest = width % ppb;
+                    for (uint32_t y = 0; y < height(); ++y) {
+                        const uint8_t* src =
+                            util::cast::constpointer_cast<const uint8_t*>(
+                                    file_row(y));
+                        Pixel* row = row_of(dst, stride, y);
+                        for (uint32_t x = 0; x < whole; ++x, row += ppb) {
+                            std::memcpy(row, &table[src[x] * ppb],
+                                    ppb * sizeof(Pixel));
+                        }
+                        if (rest > 0) {
+                            std::memcpy(row, &table[src[whole] * ppb],
+                                    rest * sizeof(Pixel));
+                        }
+                    }
+                }
+
+                void decode_bgr(bgr_type* dst, std::ptrdiff_t stride) const {
+                    for (uint32_t y = 0; y < height(); ++y) {
+                        std::memcpy(row_of(dst, stride, y), file_row(y),
+                                width() * sizeof(bgr_type));
+                    }
+                }
+                void decode_bgr(rgba_type* dst, std::ptrdiff_t stride) const {
+                    for (uint32_t y = 0; y < height(); ++y) {
+                        bgr_to_rgba(
+                            util::cast::constpointer_cast<const bgr_type*>(
+                                file_row(y)),
+                            width(), row_of(dst, stride, y));
+                    }
+                }
+
+                void unpack_row(const char* src, rgba_type* dst) const {
+                    if (bits == 16) {
+                        unpack_bitfields<2>(src, width(), fields, dst);
+                    }
+                    else {
+                        unpack_bitfields<4>(src, width(), fields, dst);
+                    }
+                }
+                void decode_bitfields(  rgba_type* dst,
+                                        std::ptrdiff_t stride) const {
+                    for (uint32_t y = 0; y < height(); ++y) {
+                        unpack_row(file_row(y), row_of(dst, stride, y));
+                    }
+                }
+                void decode_bitfields(  bgr_type* dst,
+                                        std::ptrdiff_t stride) const {
+                    std::vector<rgba_type> buffer(width());
+                    for (uint32_t y = 0; y < height(); ++y) {
+                        unpack_row(file_row(y), &buffer[0]);
+                        rgba_to_bgr(&buffer[0], width(),
+                                row_of(dst, stride, y));
+                    }
+                }
+
+                /*
+                 *  RLE8 and RLE4
+                 *  The image is bottom-up. A pair of bytes is a run (count,
+                 *  index), or an escape (0, code): 0 for the end of line, 1
+                 *  for the end of bitmap, 2 for a delta (dx, dy) and the
+                 *  others for "code" absolute indices that are padded to 2
+                 *  bytes. RLE4 runs alternate the 2 indices in the byte.
+                 * */
+                template<typename Pixel>
+                bool decode_run_length(Pixel* dst, std::ptrdiff_t stride) const {
+                    const bool four = (compression
+                            == header_type::info_header_type::RUN_LENGTH_4BPP);
+                    std::vector<Pixel> colors;
+                    make_colors(colors);
+
+                    const Pixel blank = Pixel();
+                    for (uint32_t y = 0; y < height(); ++y) {
+                        Pixel* row = row_of(dst, stride, y);
+                        std::fill(row, row + width(), blank);
+                    }
+
+                    const uint8_t* p =
+                        util::cast::constpointer_cast<const uint8_t*>(
+                                file + offset);
+                    const uint8_t* const end =
+                        util::cast::constpointer_cast<const uint8_t*>(
+                                file + file_size);
+                    // the position from the bottom-left
+                    uint32_t x = 0, r = 0;
+                    while (end - p >= 2 && r < height()) {
+                        const uint8_t count = p[0];
+                        const uint8_t code = p[1];
+                        p += 2;
+
+                        if (count > 0) {
+                            Pixel* row = row_of(dst, stride, height() - 1 - r);
+                            for (unsigned int i = 0;
+                                    i < count && x < width(); ++i, ++x) {
+                                const uint8_t index = !four ? code
+                                    : (i & 1) ? (code & 0x0f) : (code >> 4);
+                                row[x] = colors[index];
+                            }
+                            continue;
+                        }
+
+                        switch (code) {
+                            case 0:     // end of line
+                                x = 0;
+                                ++r;
+                                break;
+                            case 1:     // end of bitmap
+                                return true;
+                            case 2:     // delta
+                                if (end - p < 2) return false;
+                                x += p[0];
+                                r += p[1];
+                                p += 2;
+                                break;
+                            default: {  // absolute
+                                const std::size_t bytes = four
+                                    ? (code + 1) / 2 : code;
+                                const std::size_t padded = (bytes + 1) & ~1;
+                                if (static_cast<std::size_t>(end - p)
+                                        < bytes) {
+                                    DBGLOG("Truncated RLE data");
+                                    return false;
+                                }
+                                if (r < height()) {
+                                    Pixel* row = row_of(dst, stride,
+                                            height() - 1 - r);
+                                    for (unsigned int i = 0;
+                                            i < code && x < width();
+                                            ++i, ++x) {
+                                        const uint8_t index = !four ? p[i]
+                                            : (i & 1) ? (p[i / 2] & 0x0f)
+                                                      : (p[i / 2] >> 4);
+                                        row[x] = colors[index];
+                                    }
+                                }
+                                p += (static_cast<std::size_t>(end - p)
+                                        < padded) ? bytes : padded;
+                                break;
+                            }
+                        }
+                    }
+                    // Some encoders omit the end of bitmap.
+                    return true;
+                }
+        };
+    }
+}
+
+#endif // BMPDECODER_HPP
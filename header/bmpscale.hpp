@@ -0,0 +1,517 @@
+/*
+ * bmpscale.hpp
+ *  classes to resize 24bit pixels with separable filters: box, bilinear and
+ *  Lanczos-3
+ *
+ *  scaler uses thread.hpp, so link the thread library with GCC:
+ *
+ *      > g++ -Wall --pedantic -pthread main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ *
+ * method
+ *  The filter is applied to the rows (horizontal pass) and to the columns
+ *  of the result (vertical pass). The weights of each output column and
+ *  row are calculated once. On downscaling, the filter is stretched by the
+ *  ratio, so all source pixels are taken into account. The weights out of
+ *  the image are dropped and the rest are normalized.
+ *
+ *  The pixels are processed as 4 floats (blue, green, red and 0) while
+ *  filtering, and rounded to the nearest at last.
+ * */
+
+#ifndef BMPSCALE_HPP
+#define BMPSCALE_HPP
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include "bmp.hpp"
+#include "cast.hpp"
+#include "dlogger.hpp"
+#include "simd.hpp"
+#include "thread.hpp"
+
+namespace format {
+    namespace windows_bitmap {
+        enum filter_type {
+            BOX,
+            BILINEAR,
+            LANCZOS3
+        };
+
+        /*
+         *  the weights of an axis
+         *  The output pixel i is the sum of weights(i)[k] * source[first(i)
+         *  + k] for k in [0, count(i)).
+         * */
+        class weight_table {
+            private:
+                uint32_t numof_taps;
+                std::vector<uint32_t> firsts;
+                std::vector<uint32_t> counts;
+                // numof_taps weights for each output
+                std::vector<float> weights;
+
+            public:
+                // constructor
+                weight_table(   uint32_t source_size, uint32_t output_size,
+                                filter_type filter)
+                    : numof_taps(0),
+                      firsts(output_size), counts(output_size) {
+                    assert(source_size > 0 && output_size > 0);
+                    const double ratio =
+                        static_cast<double>(output_size) / source_size;
+                    const double stretch = ratio < 1 ? 1 / ratio : 1;
+                    const double support = radius(filter) * stretch;
+
+                    // the range of each output
+                    for (uint32_t i = 0; i < output_size; ++i) {
+                        const double center = (i + 0.5) / ratio - 0.5;
+                        double left = std::ceil(center - support);
+                        double right = std::floor(center + support);
+                        if (left < 0) left = 0;
+                        const double end = source_size - 1.0;
+                        if (right > end) right = end;
+                        if (right < left) {
+                            right = left = (center < 0) ? 0
+                                : (center > end) ? end
+                                : std::floor(center + 0.5);
+                        }
+                        firsts[i] = static_cast<uint32_t>(left);
+                        counts[i] = static_cast<uint32_t>(right - left) + 1;
+                        if (counts[i] > numof_taps) numof_taps = counts[i];
+                    }
+
+                    weights.assign(
+                            static_cast<std::size_t>(output_size) * numof_taps,
+                            0);
+                    for (uint32_t i = 0; i < output_size; ++i) {
+                        const double center = (i + 0.5) / ratio - 0.5;
+                        float* w = &weights[
+                            static_cast<std::size_t>(i) * numof_taps];
+                        double sum = 0;
+                        for (uint32_t k = 0; k < counts[i]; ++k) {
+                            const double t =
+                                (firsts[i] + k - center) / stretch;
+                            w[k] = static_cast<float>(kernel(filter, t));
+                            sum += w[k];
+                        }
+                        if (sum == 0) {
+                            // the nearest
+                            const uint32_t k = static_cast<uint32_t>(
+                                    std::floor(center + 0.5) > firsts[i]
+                                    ? std::floor(center + 0.5) - firsts[i]
+                                    : 0);
+                            w[k < counts[i] ? k : counts[i] - 1] = 1;
+                            continue;
+                        }
+                        for (uint32_t k = 0; k < counts[i]; ++k) {
+                            w[k] = static_cast<float>(w[k] / sum);
+                        }
+                    }
+                }
+
+                // getters
+                uint32_t size(void) const {
+                    return static_cast<uint32_t>(firsts.size());
+                }
+                uint32_t taps(void) const { return numof_taps; }
+                uint32_t first(uint32_t i) const { return firsts[i]; }
+                uint32_t count(uint32_t i) const { return counts[i]; }
+                const float* operator[](uint32_t i) const {
+                    return &weights[static_cast<std::size_t>(i) * numof_taps];
+                }
+
+                static double radius(filter_type filter) {
+                    switch (filter) {
+                        case BOX:       return 0.5;
+                        case BILINEAR:  return 1;
+                        default:        return 3;
+                    }
+                }
+
+                static double kernel(filter_type filter, double t) {
+                    const double pi = 3.14159265358979323846;
+                    const double a = t < 0 ? -t : t;
+                    switch (filter) {
+                        case BOX:
+                            return (-0.5 <= t && t < 0.5) ? 1 : 0;
+                        case BILINEAR:
+                            return a < 1 ? 1 - a : 0;
+                        default:
+                            if (a >= 3) return 0;
+                            if (a == 0) return 1;
+                            return 3 * std::sin(pi * a) * std::sin(pi * a / 3)
+                                / (pi * pi * a * a);
+                    }
+                }
+        };
+
+        // BGR24 -> 4 floats per pixel
+        inline void
+        expand_pixels(const bgr_type* src, std::size_t n, float* dst) {
+            for (std::size_t i = 0; i < n; ++i) {
+                dst[i * 4 + 0] = src[i].blue;
+                dst[i * 4 + 1] = src[i].green;
+                dst[i * 4 + 2] = src[i].red;
+                dst[i * 4 + 3] = 0;
+            }
+        }
+
+        // the horizontal pass on a row of 4 floats per pixel
+        inline void
+        filter_row(const float* src, const weight_table& w, float* dst) {
+            for (uint32_t i = 0; i < w.size(); ++i) {
+                const float* p =
+                    src + static_cast<std::size_t>(w.first(i)) * 4;
+                const float* weights = w[i];
+                const uint32_t count = w.count(i);
+#ifdef SIMD_SSE2
+                __m128 acc = _mm_setzero_ps();
+                for (uint32_t k = 0; k < count; ++k) {
+                    acc = _mm_add_ps(acc, _mm_mul_ps(
+                                _mm_set1_ps(weights[k]),
+                                _mm_loadu_ps(p + k * 4)));
+                }
+                _mm_storeu_ps(dst + static_cast<std::size_t>(i) * 4, acc);
+#else
+                float acc[4] = { 0, 0, 0, 0 };
+                for (uint32_t k = 0; k < count; ++k) {
+                    for (unsigned int c = 0; c < 4; ++c) {
+                        acc[c] += weights[k] * p[k * 4 + c];
+                    }
+                }
+                for (unsigned int c = 0; c < 4; ++c) dst[i * 4 + c] = acc[c];
+#endif
+            }
+        }
+
+        // the vertical pass: dst = sum of weights[k] * rows[k]
+        inline void
+        filter_column(  const float* const* rows, const float* weights,
+                        uint32_t count, std::size_t n, float* dst) {
+            std::size_t i = 0;
+#if defined(SIMD_AVX2)
+            for (; i + 8 <= n; i += 8) {
+                __m256 acc = _mm256_setzero_ps();
+                for (uint32_t k = 0; k < count; ++k) {
+                    acc = _mm256_add_ps(acc, _mm256_mul_ps(
+                                _mm256_set1_ps(weights[k]),
+                                _mm256_loadu_ps(rows[k] + i)));
+                }
+                _mm256_storeu_ps(dst + i, acc);
+            }
+#endif
+#ifdef SIMD_SSE2
+            for (; i + 4 <= n; i += 4) {
+                __m128 acc = _mm_setzero_ps();
+                for (uint32_t k = 0; k < count; ++k) {
+                    acc = _mm_add_ps(acc, _mm_mul_ps(
+                                _mm_set1_ps(weights[k]),
+                                _mm_loadu_ps(rows[k] + i)));
+                }
+                _mm_storeu_ps(dst + i, acc);
+            }
+#endif
+            for (; i < n; ++i) {
+                float acc = 0;
+                for (uint32_t k = 0; k < count; ++k) {
+                    acc += weights[k] * rows[k][i];
+                }
+                dst[i] = acc;
+            }
+        }
+
+        // 4 floats per pixel -> BGR24, clamped and rounded
+        inline void
+        store_pixels(const float* src, std::size_t n, bgr_type* dst) {
+            std::size_t i = 0;
+#ifdef SIMD_SSE2
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 maximum = _mm_set1_ps(255);
+            const __m128 half = _mm_set1_ps(0.5f);
+            for (; i + 4 <= n; i += 4) {
+                __m128i v[4];
+                for (unsigned int j = 0; j < 4; ++j) {
+                    const __m128 f = _mm_min_ps(_mm_max_ps(
+                                _mm_loadu_ps(src + (i + j) * 4), zero),
+                            maximum);
+                    v[j] = _mm_cvttps_epi32(_mm_add_ps(f, half));
+                }
+                // BGRX of 4 pixels
+                uint8_t bgrx[16];
+                util::simd::store128(bgrx,
+                        _mm_packus_epi16(
+                            _mm_packs_epi32(v[0], v[1]),
+                            _mm_packs_epi32(v[2], v[3])));
+                for (unsigned int j = 0; j < 4; ++j) {
+                    dst[i + j].blue = bgrx[j * 4 + 0];
+                    dst[i + j].green = bgrx[j * 4 + 1];
+                    dst[i + j].red = bgrx[j * 4 + 2];
+                }
+            }
+#endif
+            for (; i < n; ++i) {
+                uint8_t c[3];
+                for (unsigned int j = 0; j < 3; ++j) {
+                    float f = src[i * 4 + j];
+                    f = f < 0 ? 0 : f > 255 ? 255 : f;
+                    c[j] = static_cast<uint8_t>(static_cast<int>(f + 0.5f));
+                }
+                dst[i].blue = c[0];
+                dst[i].green = c[1];
+                dst[i].red = c[2];
+            }
+        }
+
+        /*
+         *  A class to resize a whole image on multiple threads.
+         *  Usage:
+         *
+         *      format::windows_bitmap::image_view image("foo.bmp");
+         *      if (!image.validate()) return 1;
+         *      format::windows_bitmap::scaler s(
+         *              image.width(), image.height(), 160, 120,
+         *              format::windows_bitmap::LANCZOS3);
+         *      std::vector<bgr_type> thumbnail(160 * 120);
+         *      s.scale(image, &thumbnail[0], 160 * sizeof(bgr_type));
+         *
+         *  The pixels are passed as the pointer to the top row and the
+         *  stride, that is the distance in bytes from a row to the next row
+         *  below and can be negative. The output rows are split into bands
+         *  of band_rows rows, and each thread filters the source rows that
+         *  a band needs horizontally and then vertically. numof_threads is
+         *  the number of threads; 0 means
+         *  util::thread::hardware_concurrency(), and 1 scales in the
+         *  calling thread.
+         * */
+        class scaler {
+            public:
+                static const uint32_t default_band_rows = 32;
+
+            private:
+                // thread body
+                struct band_task {
+                    scaler* s;
+                    explicit band_task(scaler* s) : s(s) {}
+                    void operator()(void) { s->scale_bands(); }
+                };
+
+                weight_table horizontal;
+                weight_table vertical;
+                uint32_t source_width;
+                util::thread::chunk_pool pool;
+                uint32_t band_rows;
+
+                // the state while scale(4)
+                const char* source;
+                std::ptrdiff_t source_stride;
+                char* output;
+                std::ptrdiff_t output_stride;
+
+            public:
+                // constructor
+                scaler( uint32_t source_width, uint32_t source_height,
+                        uint32_t output_width, uint32_t output_height,
+                        filter_type filter = LANCZOS3,
+                        unsigned int numof_threads = 0,
+                        uint32_t band_rows = default_band_rows)
+                    : horizontal(source_width, output_width, filter),
+                      vertical(source_height, output_height, filter),
+                      source_width(source_width),
+                      pool(numof_threads),
+                      band_rows(band_rows > 0 ? band_rows : 1) {}
+
+                // getters
+                uint32_t output_width(void) const { return horizontal.size(); }
+                uint32_t output_height(void) const { return vertical.size(); }
+
+                void scale( const bgr_type* src, std::ptrdiff_t src_stride,
+                            bgr_type* dst, std::ptrdiff_t dst_stride) {
+                    source = util::cast::constpointer_cast<const char*>(src);
+                    source_stride = src_stride;
+                    output = util::cast::pointer_cast<char*>(dst);
+                    output_stride = dst_stride;
+                    pool.run((output_height() + band_rows - 1) / band_rows,
+                            band_task(this));
+                }
+
+                void scale( const image_view& image,
+                            bgr_type* dst, std::ptrdiff_t dst_stride) {
+                    const std::ptrdiff_t stride =
+                        static_cast<std::ptrdiff_t>(image.stride());
+                    scale(image.row(0), image.is_top_down() ? stride : -stride,
+                            dst, dst_stride);
+                }
+
+            private:
+                void scale_bands(void) {
+                    std::vector<float> expanded(
+                            static_cast<std::size_t>(source_width) * 4);
+                    std::vector<float> filtered;
+                    std::vector<const float*> rows(vertical.taps());
+                    std::vector<float> result(
+                            static_cast<std::size_t>(output_width()) * 4);
+                    const std::size_t row_floats =
+                        static_cast<std::size_t>(output_width()) * 4;
+
+                    std::size_t i;
+                    while (pool.take(i)) {
+                        const uint32_t first =
+                            static_cast<uint32_t>(i) * band_rows;
+                        const uint32_t last =
+                            (first + band_rows < output_height())
+                            ? first + band_rows : output_height();
+                        // the source rows that the band needs
+                        const uint32_t top = vertical.first(first);
+                        const uint32_t bottom = vertical.first(last - 1)
+                            + vertical.count(last - 1);
+                        filtered.resize((bottom - top) * row_floats);
+                        for (uint32_t y = top; y < bottom; ++y) {
+                            expand_pixels(
+                                    util::cast::constpointer_cast<
+                                        const bgr_type*>(source
+                                        + static_cast<std::ptrdiff_t>(y)
+                                            * source_stride),
+                                    source_width, &expanded[0]);
+                            filter_row(&expanded[0], horizontal,
+                                    &filtered[(y - top) * row_floats]);
+                        }
+
+                        for (uint32_t y = first; y < last; ++y) {
+                            for (uint32_t k = 0; k < vertical.count(y); ++k) {
+                                rows[k] = &filtered[
+                                    (vertical.first(y) + k - top)
+                                        * row_floats];
+                            }
+                            filter_column(&rows[0], vertical[y],
+                                    vertical.count(y), row_floats,
+                                    &result[0]);
+                            store_pixels(&result[0], output_width(),
+                                    util::cast::pointer_cast<bgr_type*>(
+                                        output + static_cast<std::ptrdiff_t>(y)
+                                            * output_stride));
+                        }
+                    }
+                }
+
+                // not copyable
+                scaler(const scaler&);
+                scaler& operator=(const scaler&);
+        };
+
+        /*
+         *  A class to resize an image row by row.
+         *  Usage:
+         *
+         *      format::windows_bitmap::stream_scaler s(
+         *              width, height, 160, 120);
+         *      std::vector<bgr_type> row(160);
+         *      for (uint32_t y = 0; y < height; ++y) {
+         *          if (!s.push(source_row(y))) return 1;
+         *          while (s.ready()) {
+         *              s.pop(&row[0]);
+         *              ... write row ...
+         *          }
+         *      }
+         *
+         *  The source rows are pushed from the top, and the output rows are
+         *  popped from the top as soon as all source rows they need are
+         *  pushed. Only the source rows filtered horizontally that the next
+         *  output row needs are kept, so the memory is proportional to the
+         *  output width and the number of taps, not to the source image.
+         *  push(1) fails if the output rows that are ready are not popped.
+         * */
+        class stream_scaler {
+            private:
+                weight_table horizontal;
+                weight_table vertical;
+                uint32_t source_width;
+                uint32_t source_height;
+                std::vector<float> expanded;
+                // the ring buffer of rows filtered horizontally, the source
+                // row y is at y % vertical.taps()
+                std::vector<float> ring;
+                std::vector<const float*> rows;
+                std::vector<float> result;
+                uint32_t numof_pushed;
+                uint32_t next_row;
+
+            public:
+                // constructor
+                stream_scaler(  uint32_t source_width, uint32_t source_height,
+                                uint32_t output_width, uint32_t output_height,
+                                filter_type filter = LANCZOS3)
+                    : horizontal(source_width, output_width, filter),
+                      vertical(source_height, output_height, filter),
+                      source_width(source_width),
+                      source_height(source_height),
+                      expanded(static_cast<std::size_t>(source_width) * 4),
+                      ring(static_cast<std::size_t>(vertical.taps())
+                              * output_width * 4),
+                      rows(vertical.taps()),
+                      result(static_cast<std::size_t>(output_width) * 4),
+                      numof_pushed(0), next_row(0) {}
+
+                // getters
+                uint32_t output_width(void) const { return horizontal.size(); }
+                uint32_t output_height(void) const { return vertical.size(); }
+                bool is_finished(void) const {
+                    return next_row == output_height();
+                }
+
+                // This filters the next source row horizontally.
+                bool push(const bgr_type* row) {
+                    if (numof_pushed == source_height) {
+                        DBGLOG("All rows are pushed already");
+                        return false;
+                    }
+                    if (!is_finished() && numof_pushed
+                            >= vertical.first(next_row) + vertical.taps()) {
+                        DBGLOG("The output row " << next_row
+                                << " is not popped");
+                        return false;
+                    }
+                    expand_pixels(row, source_width, &expanded[0]);
+                    filter_row(&expanded[0], horizontal,
+                            ring_row(numof_pushed));
+                    ++numof_pushed;
+                    return true;
+                }
+
+                // whether the next output row can be popped
+                bool ready(void) const {
+                    return !is_finished() && vertical.first(next_row)
+                        + vertical.count(next_row) <= numof_pushed;
+                }
+
+                // This writes the next output row.
+                bool pop(bgr_type* row) {
+                    if (!ready()) return false;
+                    const uint32_t first = vertical.first(next_row);
+                    const uint32_t count = vertical.count(next_row);
+                    for (uint32_t k = 0; k < count; ++k) {
+                        rows[k] = ring_row(first + k);
+                    }
+                    filter_column(&rows[0], vertical[next_row], count,
+                            result.size(), &result[0]);
+                    store_pixels(&result[0], output_width(), row);
+                    ++next_row;
+                    return true;
+                }
+
+            private:
+                float* ring_row(uint32_t y) {
+                    return &ring[static_cast<std::size_t>(y % vertical.taps())
+                        * output_width() * 4];
+                }
+        };
+    }
+}
+
+#endif // BMPSCALE_HPP
@@ -0,0 +1,188 @@
+/*
+ * bmpwriter.hpp
+ *  a class to write 24bit Windows Bitmap file from a pixel buffer on
+ *  multiple threads
+ *
+ *  This uses thread.hpp, so link the thread library with GCC:
+ *
+ *      > g++ -Wall --pedantic -pthread main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#ifndef BMPWRITER_HPP
+#define BMPWRITER_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+#include "bmp.hpp"
+#include "cast.hpp"
+#include "dlogger.hpp"
+#include "rawfile.hpp"
+#include "thread.hpp"
+
+namespace format {
+    namespace windows_bitmap {
+        /*
+         *  A class to write 24bit Windows Bitmap file from a pixel buffer.
+         *  Usage:
+         *
+         *      format::windows_bitmap::elements_type e = {width, height};
+         *      std::vector<bgr_type> pixels(width * height);  // top first
+         *      format::windows_bitmap::writer out;
+         *      if (!out.write("foo.bmp", e, &pixels[0],
+         *                  width * sizeof(bgr_type))) {
+         *          return 1;
+         *      }
+         *
+         *  pixels points the top row, and stride is the distance in bytes
+         *  from a row to the next row below, that can be negative. The rows
+         *  are stored bottom-up if the height is positive, and top-down if
+         *  negative, as the format says.
+         *
+         *  The file is allocated at first, and the rows are split into bands
+         *  of band_bytes or so. Each thread pads the rows of a band into its
+         *  own buffer and writes it to the region of the band with
+         *  pwrite(4). numof_threads is the number of threads; 0 means
+         *  util::thread::hardware_concurrency(), and 1 writes in the calling
+         *  thread.
+         * */
+        class writer {
+            public:
+                static const std::size_t default_band_bytes = 1 << 20;
+
+            private:
+                // thread body
+                struct band_task {
+                    writer* w;
+                    explicit band_task(writer* w) : w(w) {}
+                    void operator()(void) { w->write_bands(); }
+                };
+
+                util::thread::chunk_pool pool;
+                std::size_t band_bytes;
+
+                // the state while write(4)
+                util::file::raw_file file;
+                const char* top;
+                std::ptrdiff_t stride;
+                uint32_t width;
+                uint32_t height;
+                bool bottom_up;
+                uint32_t row_size;
+                // the pixels of a row without the padding
+                std::size_t pixel_bytes;
+                uint32_t band_rows;
+                bool failed;
+
+                // for failed
+                util::thread::mutex m;
+
+            public:
+                // constructor
+                explicit writer(unsigned int numof_threads = 0,
+                                std::size_t band_bytes = default_band_bytes)
+                    : pool(numof_threads), band_bytes(band_bytes) {}
+
+                bool write( const char* path, const elements_type& e,
+                            const bgr_type* pixels, std::ptrdiff_t stride) {
+                    if (e.width <= 0 || e.height == 0) {
+                        DBGLOG("Invalid size: "
+                                << e.width << "x" << e.height);
+                        return false;
+                    }
+
+                    const uint16_t bits_per_pixel =
+                        header_type::bytes_per_pixel
+                        * header_type::info_header_type::bit;
+                    // The row is less than 2^33 bytes, so this doesn't wrap.
+                    const uint64_t row = row_bytes(e.width, bits_per_pixel);
+                    if (sizeof(header_type) + row * numof_rows(e.height)
+                            > 0xffffffff) {
+                        DBGLOG("Too large image: "
+                                << e.width << "x" << e.height);
+                        return false;
+                    }
+
+                    const header_type header(e);
+                    if (!file.open(path, util::file::raw_file::WRITE)) {
+                        return false;
+                    }
+                    // allocate the whole file at first
+                    if (!file.truncate(header.file_bytes)
+                            || !file.write(0,
+                                util::cast::constpointer_cast<const char*>(
+                                    &header),
+                                sizeof(header))) {
+                        file.close();
+                        return false;
+                    }
+
+                    top = util::cast::constpointer_cast<const char*>(pixels);
+                    this->stride = stride;
+                    width = static_cast<uint32_t>(e.width);
+                    height = numof_rows(e.height);
+                    bottom_up = e.height > 0;
+                    row_size = static_cast<uint32_t>(row);
+                    pixel_bytes = static_cast<std::size_t>(width)
+                        * sizeof(bgr_type);
+                    band_rows = static_cast<uint32_t>(band_bytes / row_size);
+                    if (band_rows == 0) band_rows = 1;
+                    failed = false;
+                    pool.run((height + band_rows - 1) / band_rows,
+                            band_task(this));
+
+                    file.close();
+                    return !failed;
+                }
+
+            private:
+                void write_bands(void) {
+                    std::vector<char> buffer;
+                    std::size_t i;
+                    while (pool.take(i)) {
+                        {
+                            util::thread::scoped_lock lock(m);
+                            if (failed) return;
+                        }
+                        const uint32_t band = static_cast<uint32_t>(i);
+
+                        // the rows of the band in the order of the file
+                        const uint32_t first = band * band_rows;
+                        const uint32_t last = (first + band_rows < height)
+                            ? first + band_rows : height;
+                        buffer.assign(
+                                static_cast<std::size_t>(last - first)
+                                    * row_size, 0);
+                        for (uint32_t r = first; r < last; ++r) {
+                            const uint32_t y = bottom_up ? height - 1 - r : r;
+                            std::memcpy(
+                                    &buffer[static_cast<std::size_t>(r - first)
+                                        * row_size],
+                                    top + static_cast<std::ptrdiff_t>(y)
+                                        * stride,
+                                    pixel_bytes);
+                        }
+
+                        const uint64_t offset = sizeof(header_type)
+                            + static_cast<uint64_t>(first) * row_size;
+                        if (!file.write(offset, &buffer[0], buffer.size())) {
+                            util::thread::scoped_lock lock(m);
+                            failed = true;
+                            return;
+                        }
+                    }
+                }
+
+                // not copyable
+                writer(const writer&);
+                writer& operator=(const writer&);
+        };
+    }
+}
+
+#endif // BMPWRITER_HPP
@@ -0,0 +1,474 @@
+/*
+ * corpus.hpp
+ *  a scanner to validate the headers of many Windows Bitmap and WAV files
+ *  on multiple threads
+ *
+ *  This uses thread.hpp, so link the thread library with GCC:
+ *
+ *      > g++ -Wall --pedantic -pthread main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ *
+ * method
+ *  Each file costs a statx(2) (stat(2) or GetFileAttributesEx(3) where it
+ *  isn't available) for the type and the size, and an open(2) and a
+ *  pread(4) of the first probe_bytes. Any streams are not used. The header
+ *  in the probe is validated against the size from statx(2):
+ *
+ *      Windows Bitmap  header_type::validate(0) and the file size, the
+ *                      same as validate(1) with std::istream
+ *      WAV             chunk_index, so LIST chunks and RF64 are accepted.
+ *                      The chunk headers out of the probe are read by
+ *                      additional pread(4), that are rare.
+ * */
+
+#ifndef CORPUS_HPP
+#define CORPUS_HPP
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#   ifndef NOMINMAX
+#       define NOMINMAX     // keep std::min(2) and std::max(2) usable
+#   endif
+#   include <windows.h>     // for GetFileAttributesEx(3), FindFirstFile(2)
+#else
+#   include <dirent.h>      // for opendir(1), readdir(1)
+#   include <fcntl.h>       // for AT_FDCWD
+#   include <sys/stat.h>    // for statx(5), stat(2)
+#endif
+
+#include "bmp.hpp"
+#include "cast.hpp"
+#include "dlogger.hpp"
+#include "rawfile.hpp"
+#include "thread.hpp"
+#include "wav.hpp"
+
+namespace format {
+    namespace corpus {
+        enum kind_type {
+            UNKNOWN,
+            WINDOWS_BITMAP,
+            RIFF_WAV
+        };
+
+        enum status_type {
+            VALID,
+            // can't stat, open or read
+            UNREADABLE,
+            // a directory, a device, ...
+            NOT_REGULAR,
+            // neither Windows Bitmap nor WAV
+            UNKNOWN_FORMAT,
+            // smaller than the header says
+            TRUNCATED,
+            // the header is broken or not supported
+            BAD_HEADER,
+            // larger than the header says
+            SIZE_MISMATCH
+        };
+
+        inline const char* kind_name(kind_type kind) {
+            switch (kind) {
+                case WINDOWS_BITMAP:    return "bmp";
+                case RIFF_WAV:          return "wav";
+                default:                return "-";
+            }
+        }
+
+        inline const char* status_name(status_type status) {
+            switch (status) {
+                case VALID:             return "valid";
+                case UNREADABLE:        return "unreadable";
+                case NOT_REGULAR:       return "not-regular";
+                case UNKNOWN_FORMAT:    return "unknown-format";
+                case TRUNCATED:         return "truncated";
+                case BAD_HEADER:        return "bad-header";
+                case SIZE_MISMATCH:     return "size-mismatch";
+                default:                return "?";
+            }
+        }
+
+        struct result_type {
+            std::string path;
+            kind_type kind;
+            status_type status;
+            uint64_t size;
+
+            // constructor
+            result_type(void) : kind(UNKNOWN), status(UNREADABLE), size(0) {}
+        };
+
+        /*
+         *  the type and the size of the file without opening it
+         *  false if the file doesn't exist
+         * */
+        inline bool
+        file_status(const char* path, bool& regular, uint64_t& size) {
+#if defined(_MSC_VER)
+            WIN32_FILE_ATTRIBUTE_DATA data;
+            if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+                return false;
+            }
+            regular = (data.dwFileAttributes
+                    & (FILE_ATTRIBUTE_DIRECTORY | FILE_ATTRIBUTE_DEVICE)) == 0;
+            size = static_cast<uint64_t>(data.nFileSizeHigh) << 32
+                | data.nFileSizeLow;
+#elif defined(STATX_SIZE)
+            struct statx st;
+            if (statx(AT_FDCWD, path, 0, STATX_TYPE | STATX_SIZE, &st) != 0) {
+                return false;
+            }
+            regular = S_ISREG(st.stx_mode);
+            size = st.stx_size;
+#else
+            struct stat st;
+            if (stat(path, &st) != 0) return false;
+            regular = S_ISREG(st.st_mode);
+            size = static_cast<uint64_t>(st.st_size);
+#endif
+            return true;
+        }
+
+        /*
+         *  This appends the paths of the files under the directory
+         *  recursively to paths, and sorts them. The symbolic links to
+         *  directories are not followed.
+         * */
+        inline bool
+        list_files(const std::string& directory,
+                   std::vector<std::string>& paths) {
+            const std::vector<std::string>::size_type first = paths.size();
+            std::vector<std::string> directories(1, directory);
+            while (!directories.empty()) {
+                const std::string current = directories.back();
+                directories.pop_back();
+                const std::string prefix =
+                    (current.empty() || current[current.size() - 1] == '/'
+                        || current[current.size() - 1] == '\\')
+                    ? current : current + '/';
+
+#ifdef _MSC_VER
+                WIN32_FIND_DATAA entry;
+                HANDLE handle =
+                    FindFirstFileA((prefix + '*').c_str(), &entry);
+                if (handle == INVALID_HANDLE_VALUE) {
+                    DBGLOG("Can't open the directory: " << current);
+                    return false;
+                }
+                do {
+                    const std::string name(entry.cFileName);
+                    if (name == "." || name == "..") continue;
+                    if ((entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                            && !(entry.dwFileAttributes
+                                & FILE_ATTRIBUTE_REPARSE_POINT)) {
+                        directories.push_back(prefix + name);
+                    }
+                    else {
+                        paths.push_back(prefix + name);
+                    }
+                } while (FindNextFileA(handle, &entry));
+                FindClose(handle);
+#else
+                DIR* dir = opendir(current.c_str());
+                if (dir == 0) {
+                    DBGLOG("Can't open the directory: " << current);
+                    return false;
+                }
+                while (const struct dirent* entry = readdir(dir)) {
+                    const std::string name(entry->d_name);
+                    if (name == "." || name == "..") continue;
+                    bool is_directory = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+                    if (entry->d_type == DT_DIR) {
+                        is_directory = true;
+                    }
+                    else if (entry->d_type == DT_UNKNOWN) {
+#endif
+                        struct stat st;
+                        is_directory =
+                            lstat((prefix + name).c_str(), &st) == 0
+                            && S_ISDIR(st.st_mode);
+#ifdef _DIRENT_HAVE_D_TYPE
+                    }
+#endif
+                    if (is_directory) directories.push_back(prefix + name);
+                    else paths.push_back(prefix + name);
+                }
+                closedir(dir);
+#endif
+            }
+            std::sort(paths.begin() + first, paths.end());
+            return true;
+        }
+
+        // This appends the paths in lines of the stream to paths.
+        template<typename Char>
+        inline void
+        read_list(std::basic_istream<Char>& in,
+                  std::vector<std::string>& paths) {
+            std::basic_string<Char> line;
+            while (std::getline(in, line)) {
+                if (!line.empty() && line[line.size() - 1] == '\r') {
+                    line.erase(line.size() - 1);
+                }
+                if (!line.empty()) {
+                    paths.push_back(std::string(line.begin(), line.end()));
+                }
+            }
+        }
+
+        /*
+         *  A class to validate the headers of many files.
+         *  Usage:
+         *
+         *      std::vector<std::string> paths;
+         *      format::corpus::list_files("ingest/", paths);
+         *      format::corpus::scanner s;
+         *      std::vector<format::corpus::result_type> results;
+         *      s.scan(paths, results);
+         *      format::corpus::report(std::cout, results);
+         *
+         *  results[i] is the result of paths[i]. The paths are taken by the
+         *  calling thread and numof_threads - 1 threads in batches.
+         *  numof_threads is the number of threads; 0 means
+         *  util::thread::hardware_concurrency(), and 1 scans in the calling
+         *  thread. check(2) validates one file.
+         * */
+        class scanner {
+            public:
+                static const std::size_t default_probe_bytes = 4096;
+                static const std::size_t batch_size = 64;
+
+            private:
+                // thread body
+                struct scan_task {
+                    scanner* s;
+                    explicit scan_task(scanner* s) : s(s) {}
+                    void operator()(void) { s->scan_batches(); }
+                };
+
+                // the probe and the rest of the file for chunk_index
+                struct probe_source {
+                    util::file::raw_file* file;
+                    const std::vector<char>* probe;
+                    uint64_t length;
+
+                    probe_source(   util::file::raw_file& file,
+                                    const std::vector<char>& probe,
+                                    uint64_t length)
+                        : file(&file), probe(&probe), length(length) {}
+                    uint64_t size(void) const { return length; }
+                    bool read(uint64_t offset, char* dst, std::size_t n) {
+                        if (offset + n <= probe->size()) {
+                            std::memcpy(dst, &(*probe)[0] + offset, n);
+                            return true;
+                        }
+                        return file->read(offset, dst, n);
+                    }
+                };
+
+                util::thread::chunk_pool pool;
+                std::size_t probe_bytes;
+
+                // the state while scan(2)
+                const std::vector<std::string>* paths;
+                std::vector<result_type>* results;
+
+            public:
+                // constructor
+                explicit scanner(
+                        unsigned int numof_threads = 0,
+                        std::size_t probe_bytes = default_probe_bytes)
+                    : pool(numof_threads),
+                      probe_bytes(std::max(probe_bytes,
+                                  static_cast<std::size_t>(
+                                      sizeof(windows_bitmap::header_type)))) {}
+
+                void scan(  const std::vector<std::string>& paths,
+                            std::vector<result_type>& results) {
+                    results.assign(paths.size(), result_type());
+                    this->paths = &paths;
+                    this->results = &results;
+                    pool.run((paths.size() + batch_size - 1) / batch_size,
+                            scan_task(this));
+                }
+
+                // probe is the buffer that is reused
+                result_type
+                check(const std::string& path, std::vector<char>& probe) const {
+                    result_type result;
+                    result.path = path;
+
+                    bool regular;
+                    if (!file_status(path.c_str(), regular, result.size)) {
+                        result.status = UNREADABLE;
+                        return result;
+                    }
+                    if (!regular) {
+                        result.status = NOT_REGULAR;
+                        return result;
+                    }
+
+                    util::file::raw_file file;
+                    if (!file.open(path.c_str(), util::file::raw_file::READ)) {
+                        result.status = UNREADABLE;
+                        return result;
+                    }
+                    probe.resize(static_cast<std::size_t>(
+                                std::min<uint64_t>(probe_bytes, result.size)));
+                    if (!probe.empty()
+                            && !file.read(0, &probe[0], probe.size())) {
+                        result.status = UNREADABLE;
+                        return result;
+                    }
+
+                    result.kind = detect(probe);
+                    switch (result.kind) {
+                        case WINDOWS_BITMAP:
+                            result.status = check_bmp(probe, result.size);
+                            break;
+                        case RIFF_WAV:
+                            result.status = check_wav(file, probe,
+                                    result.size);
+                            break;
+                        default:
+                            result.status = is_short_riff(probe)
+                                ? TRUNCATED : UNKNOWN_FORMAT;
+                            break;
+                    }
+                    return result;
+                }
+
+            private:
+                void scan_batches(void) {
+                    std::vector<char> probe(probe_bytes);
+                    std::size_t batch;
+                    while (pool.take(batch)) {
+                        const std::size_t first = batch * batch_size;
+                        const std::size_t last =
+                            std::min(first + batch_size, paths->size());
+                        for (std::size_t i = first; i < last; ++i) {
+                            (*results)[i] = check((*paths)[i], probe);
+                        }
+                    }
+                }
+
+                static kind_type detect(const std::vector<char>& probe) {
+                    if (probe.size() >= 2
+                            && probe[0] == 'B' && probe[1] == 'M') {
+                        return WINDOWS_BITMAP;
+                    }
+                    if (probe.size() >= 12
+                            && (   std::memcmp(&probe[0], "RIFF", 4) == 0
+                                || std::memcmp(&probe[0], "RF64", 4) == 0
+                                || std::memcmp(&probe[0], "BW64", 4) == 0)
+                            && std::memcmp(&probe[8], "WAVE", 4) == 0) {
+                        return RIFF_WAV;
+                    }
+                    return UNKNOWN;
+                }
+
+                // too small to detect but may be WAV
+                static bool is_short_riff(const std::vector<char>& probe) {
+                    if (probe.size() >= 12) return false;
+                    const std::size_t n = std::min<std::size_t>(
+                            probe.size(), 4);
+                    return n == 0 || std::memcmp(&probe[0], "RIFF", n) == 0
+                        || std::memcmp(&probe[0], "RF64", n) == 0
+                        || std::memcmp(&probe[0], "BW64", n) == 0;
+                }
+
+                static status_type
+                check_bmp(const std::vector<char>& probe, uint64_t size) {
+                    using windows_bitmap::header_type;
+                    if (probe.size() < sizeof(header_type)) return TRUNCATED;
+
+                    header_type header;
+                    std::memcpy(&header, &probe[0], sizeof(header));
+                    if (!header.validate() || !header.info_header.validate()) {
+                        return BAD_HEADER;
+                    }
+                    if (size < header.file_bytes) return TRUNCATED;
+                    if (size != header.file_bytes) return SIZE_MISMATCH;
+                    return VALID;
+                }
+
+                static status_type
+                check_wav(  util::file::raw_file& file,
+                            const std::vector<char>& probe, uint64_t size) {
+                    using riff_wav::header_type;
+                    using riff_wav::chunk_type;
+                    uint32_t riff[3];
+                    std::memcpy(riff, &probe[0], sizeof(riff));
+                    probe_source source(file, probe, size);
+
+                    // RF64 and BW64 have the size in ds64 chunk
+                    uint64_t riff_size = riff[1];
+                    if (riff[0] != header_type::riff_id) {
+                        uint32_t h[2];
+                        riff_wav::ds64_type ds64;
+                        if (!source.read(sizeof(riff),
+                                    util::cast::pointer_cast<char*>(h),
+                                    chunk_type::header_size)
+                                || h[0] != chunk_type::ds64_id
+                                || !source.read(
+                                    sizeof(riff) + chunk_type::header_size,
+                                    util::cast::pointer_cast<char*>(&ds64),
+                                    sizeof(ds64))) {
+                            return BAD_HEADER;
+                        }
+                        riff_size = ds64.riff_size;
+                    }
+                    // detect(1) has seen 12 bytes at least
+                    if (riff_size > size - chunk_type::header_size) {
+                        return TRUNCATED;
+                    }
+
+                    riff_wav::chunk_index index;
+                    if (!index.read_from(source)) return BAD_HEADER;
+                    if (riff_size + chunk_type::header_size != size) {
+                        return SIZE_MISMATCH;
+                    }
+                    return VALID;
+                }
+
+                // not copyable
+                scanner(const scanner&);
+                scanner& operator=(const scanner&);
+        };
+
+        /*
+         *  This writes the invalid files as "status<TAB>kind<TAB>path"
+         *  lines (all files if verbose is true) and a summary line.
+         * */
+        template<typename Char>
+        inline std::basic_ostream<Char>&
+        report( std::basic_ostream<Char>& out,
+                const std::vector<result_type>& results,
+                bool verbose = false) {
+            std::size_t numof_valid = 0;
+            for (std::vector<result_type>::const_iterator itr =
+                    results.begin(); itr != results.end(); ++itr) {
+                if (itr->status == VALID) ++numof_valid;
+                if (itr->status == VALID && !verbose) continue;
+                out << status_name(itr->status) << '\t'
+                    << kind_name(itr->kind) << '\t'
+                    << itr->path.c_str() << '\n';
+            }
+            out << results.size() << " files, " << numof_valid << " valid, "
+                << results.size() - numof_valid << " invalid" << std::endl;
+            return out;
+        }
+    }
+}
+
+#endif // CORPUS_HPP
@@ -0,0 +1,699 @@
+/*
+ * csv.hpp
+ *  a class to read delimited text like CSV and TSV into typed columns
+ *
+ *  This uses thread.hpp, so link the thread library with GCC:
+ *
+ *      > g++ -Wall --pedantic -pthread main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#ifndef CSV_HPP
+#define CSV_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "dlogger.hpp"
+#include "mmap.hpp"
+#include "string.hpp"
+#include "thread.hpp"
+#include "typeconv.hpp"
+
+namespace format {
+    namespace csv {
+        /*
+         *  The way to delimit the fields.
+         *  delimiter separates the fields, and LF or CR LF separates the
+         *  records. A field that begins with quote can contain the
+         *  delimiter and line breaks, and a doubled quote in it is a quote.
+         *  A quote in the other fields is an error unless escape is given.
+         *  escape makes the next character literal in any field. '\0'
+         *  disables quote or escape. If header is true, the first record
+         *  is the names of the columns.
+         * */
+        struct dialect_type {
+            char delimiter;
+            char quote;
+            char escape;
+            bool header;
+
+            explicit dialect_type(  char delimiter = ',', char quote = '"',
+                                    char escape = '\0', bool header = false)
+                : delimiter(delimiter), quote(quote), escape(escape),
+                  header(header) {}
+        };
+
+        // RFC 4180
+        inline dialect_type csv(bool header = false) {
+            return dialect_type(',', '"', '\0', header);
+        }
+        // tab separated values with backslash escapes
+        inline dialect_type tsv(bool header = false) {
+            return dialect_type('\t', '\0', '\\', header);
+        }
+
+        // the destination of a column
+        class column_base {
+            public:
+                virtual ~column_base(void) {}
+
+                // This returns false if field can't be converted.
+                virtual bool push(  util::string::typeconverter& converter,
+                                    const util::string::string_ref& field)
+                    = 0;
+
+                virtual std::size_t size(void) const = 0;
+                virtual void resize(std::size_t n) = 0;
+                virtual void reserve(std::size_t n) = 0;
+
+                // a column of the same type that owns its vector
+                virtual column_base* spawn(void) const = 0;
+                // This moves the values to dst from offset, that is a
+                // column of the same type and large enough.
+                virtual void move_to(column_base& dst, std::size_t offset)
+                    = 0;
+        };
+
+        // An empty field is T().
+        template<typename T>
+            class column : public column_base {
+                private:
+                    std::vector<T> owned;
+                    std::vector<T>* values;
+
+                public:
+                    // constructor
+                    column(void) : values(&owned) {}
+                    explicit column(std::vector<T>& values)
+                        : values(&values) {}
+
+                    bool push(  util::string::typeconverter& converter,
+                                const util::string::string_ref& field) {
+                        values->push_back(T());
+                        return field.empty()
+                            || converter.strto(field, values->back());
+                    }
+
+                    std::size_t size(void) const { return values->size(); }
+                    void resize(std::size_t n) { values->resize(n); }
+                    void reserve(std::size_t n) { values->reserve(n); }
+
+                    column_base* spawn(void) const { return new column; }
+                    void move_to(column_base& dst, std::size_t offset) {
+                        std::vector<T>& to =
+                            *static_cast<column&>(dst).values;
+                        std::swap_ranges(values->begin(), values->end(),
+                                to.begin() + offset);
+                    }
+
+                private:
+                    // not copyable
+                    column(const column&);
+                    column& operator=(const column&);
+            };
+
+        // std::string takes the field as is
+        template<>
+            inline bool column<std::string>::push(
+                    util::string::typeconverter&,
+                    const util::string::string_ref& field) {
+                values->push_back(std::string(field.data(), field.size()));
+                return true;
+            }
+
+        /*
+         *  A class to read delimited text into the vectors of the columns.
+         *  Usage:
+         *
+         *      std::vector<int> ids;
+         *      std::vector<std::string> names;
+         *      std::vector<double> prices;
+         *      format::csv::reader in(format::csv::csv(true));
+         *      in.bind(0, ids).bind(1, names).bind(2, prices);
+         *      if (!in.read("foo.csv")) return 1;
+         *
+         *  The fields of a record are appended to the vectors that are
+         *  bound to their indices, and the other fields are skipped. The
+         *  fields are converted in place by the fast path of
+         *  util::string::typeconverter, and only the fields that have
+         *  quotes or escapes are copied, so no lines or fields are made as
+         *  std::string except the columns of std::string.
+         *
+         *  read(1) with a path maps the whole file into memory, and
+         *  read(1) with a stream reads it in blocks of block_bytes. Empty
+         *  lines are skipped. A record must have the fields for all of the
+         *  bound columns, and a bound field must be converted entirely. If
+         *  not, read(1) fails, and the vectors have the records before the
+         *  bad one.
+         *
+         *  A file or a range of memory is split into chunks of block_bytes
+         *  at least at the breaks of the records, and the chunks are parsed
+         *  on numof_threads threads into their own columns, that are moved
+         *  to the bound vectors in order at last. numof_threads is the
+         *  number of threads; 0 means util::thread::hardware_concurrency(),
+         *  and 1 reads in the calling thread. The breaks are found by the
+         *  parity of the quotes, that is why a quote can't be in an
+         *  unquoted field. A dialect that has both of quote and escape,
+         *  and a stream are read in the calling thread.
+         * */
+        class reader {
+            public:
+                static const std::size_t default_block_bytes = 1 << 20;
+
+            private:
+                // the results of parse_record(3)
+                enum state_type {
+                    RECORD,
+                    INCOMPLETE,
+                    FAILED
+                };
+
+                // a part of the range that a worker parses
+                struct chunk_type {
+                    const char* first;
+                    const char* last;
+                    std::size_t quotes;
+                    reader* worker;
+                    bool ok;
+                };
+
+                // thread body
+                template<void (reader::*Body)(void)>
+                    struct chunk_task {
+                        reader* r;
+                        explicit chunk_task(reader* r) : r(r) {}
+                        void operator()(void) { (r->*Body)(); }
+                    };
+
+                dialect_type dialect;
+                std::size_t block_bytes;
+                util::thread::chunk_pool pool;
+                // by the indices of the fields, and NULL if not bound
+                std::vector<column_base*> columns;
+                std::vector<std::string> column_names;
+                util::string::typeconverter converter;
+
+                // the state while read(1)
+                std::vector<std::size_t> base_sizes;
+                std::size_t numof_records;
+                bool in_header;
+                // a field that has quotes or escapes
+                std::string unescaped;
+
+                // the state while reading on multiple threads
+                std::vector<chunk_type> chunks;
+                // the first bad chunk, or the number of the chunks
+                std::size_t failed_chunk;
+                util::thread::mutex m;
+
+            public:
+                // constructor
+                explicit reader(const dialect_type& dialect = dialect_type(),
+                                std::size_t block_bytes = default_block_bytes,
+                                unsigned int numof_threads = 0)
+                    : dialect(dialect), block_bytes(block_bytes),
+                      pool(numof_threads),
+                      numof_records(0), in_header(false) {
+                    if (this->block_bytes == 0) {
+                        this->block_bytes = default_block_bytes;
+                    }
+                }
+
+                // destructor
+                ~reader(void) {
+                    for (std::size_t i = 0; i < columns.size(); ++i) {
+                        delete columns[i];
+                    }
+                }
+
+                // This replaces the vector that is bound to index.
+                template<typename T>
+                    reader& bind(std::size_t index, std::vector<T>& values) {
+                        if (index >= columns.size()) {
+                            columns.resize(index + 1, 0);
+                        }
+                        delete columns[index];
+                        columns[index] = new column<T>(values);
+                        return *this;
+                    }
+
+                // getters
+                // the header of the last read(1)
+                const std::vector<std::string>& names(void) const {
+                    return column_names;
+                }
+                // the records that are read by the last read(1)
+                std::size_t records(void) const { return numof_records; }
+
+                // read
+                bool read(const char* path) {
+                    util::file::mapping m(path);
+                    if (!m.is_open()) return false;
+                    if (!read(m.begin(), m.end())) {
+                        DBGLOG("Can't read the file: " << path);
+                        return false;
+                    }
+                    return true;
+                }
+
+                bool read(const char* first, const char* last) {
+                    const std::size_t numof_chunks = std::min<std::size_t>(
+                            (last - first) / block_bytes,
+                            pool.concurrency() * 4);
+                    if (numof_chunks > 1 && pool.concurrency() > 1
+                            && (dialect.quote == '\0'
+                                || dialect.escape == '\0')) {
+                        return read_chunks(first, last, numof_chunks);
+                    }
+
+                    begin();
+                    // The line breaks give enough capacity unless the
+                    // fields have them.
+                    const std::size_t n =
+                        util::string::count(first, last, "\n", 1) + 1;
+                    for (std::size_t i = 0; i < columns.size(); ++i) {
+                        if (columns[i] != 0) {
+                            columns[i]->reserve(base_sizes[i] + n);
+                        }
+                    }
+                    return parse(first, last, true);
+                }
+
+                bool read(std::istream& in) {
+                    begin();
+                    std::vector<char> buffer(block_bytes);
+                    std::size_t filled = 0;
+                    for (;;) {
+                        // a record that is longer than the buffer
+                        if (filled == buffer.size()) {
+                            buffer.resize(buffer.size() * 2);
+                        }
+                        in.read(&buffer[filled],
+                                static_cast<std::streamsize>(
+                                    buffer.size() - filled));
+                        filled += static_cast<std::size_t>(in.gcount());
+                        if (in.bad()) {
+                            DBGLOG("Can't read the stream.");
+                            return false;
+                        }
+                        const bool final = in.eof();
+
+                        const char* p = &buffer[0];
+                        if (!parse(p, p + filled, final)) return false;
+                        if (final) return true;
+
+                        // the incomplete record to the head
+                        const std::size_t consumed = p - &buffer[0];
+                        filled -= consumed;
+                        std::memmove(&buffer[0], p, filled);
+                    }
+                }
+
+            private:
+                // This reads [first, last) in n chunks on the threads.
+                bool read_chunks(   const char* first, const char* last,
+                                    std::size_t n) {
+                    begin();
+                    const char* const origin = first;
+                    while (in_header && first != last) {
+                        if (parse_record(first, last, true) == FAILED) {
+                            return false;
+                        }
+                    }
+
+                    // the chunks of the same size at first
+                    const std::size_t size = last - first;
+                    chunks.resize(n);
+                    for (std::size_t i = 0; i < n; ++i) {
+                        chunk_type& c = chunks[i];
+                        c.first = first + size / n * i;
+                        c.last = (i + 1 < n) ? first + size / n * (i + 1)
+                                             : last;
+                        c.quotes = 0;
+                        c.worker = 0;
+                        c.ok = false;
+                    }
+                    if (dialect.quote != '\0') {
+                        pool.run(chunks.size(),
+                                chunk_task<&reader::count_quotes>(this));
+                    }
+
+                    // the breaks of the records after the heads
+                    bool quoted = false;
+                    for (std::size_t i = 1; i < n; ++i) {
+                        if (chunks[i - 1].quotes % 2) quoted = !quoted;
+                        const char* head = chunks[i - 1].first;
+                        if (chunks[i].first > head) {
+                            head = next_record(chunks[i].first, last,
+                                    origin, quoted);
+                        }
+                        chunks[i - 1].last = head;
+                        chunks[i].first = head;
+                    }
+
+                    const dialect_type body(dialect.delimiter,
+                            dialect.quote, dialect.escape, false);
+                    for (std::size_t i = 0; i < n; ++i) {
+                        reader* w = new reader(body, block_bytes, 1);
+                        w->columns.resize(columns.size(), 0);
+                        for (std::size_t j = 0; j < columns.size(); ++j) {
+                            if (columns[j] != 0) {
+                                w->columns[j] = columns[j]->spawn();
+                            }
+                        }
+                        chunks[i].worker = w;
+                    }
+                    failed_chunk = n;
+                    pool.run(chunks.size(),
+                            chunk_task<&reader::parse_chunks>(this));
+
+                    // the chunks until the bad one
+                    std::size_t numof_chunks = 0;
+                    while (numof_chunks < n) {
+                        const chunk_type& c = chunks[numof_chunks++];
+                        numof_records += c.worker->numof_records;
+                        if (!c.ok) {
+                            DBGLOG("Can't read the chunk from the byte "
+                                    << c.first - origin);
+                            break;
+                        }
+                    }
+                    for (std::size_t j = 0; j < columns.size(); ++j) {
+                        if (columns[j] != 0) {
+                            columns[j]->resize(base_sizes[j] + numof_records);
+                        }
+                    }
+                    for (std::size_t i = numof_chunks; i < n; ++i) {
+                        delete chunks[i].worker;
+                    }
+                    chunks.resize(numof_chunks);
+                    pool.run(chunks.size(),
+                            chunk_task<&reader::move_chunks>(this));
+
+                    for (std::size_t i = 0; i < numof_chunks; ++i) {
+                        delete chunks[i].worker;
+                    }
+                    chunks.clear();
+                    return failed_chunk == n;
+                }
+
+                void count_quotes(void) {
+                    std::size_t i;
+                    while (pool.take(i)) {
+                        chunk_type& c = chunks[i];
+                        c.quotes = util::string::count(
+                                c.first, c.last, &dialect.quote, 1);
+                    }
+                }
+
+                // The chunks after a bad one are skipped, but the ones
+                // before it are parsed to keep their records.
+                void parse_chunks(void) {
+                    std::size_t i;
+                    while (pool.take(i)) {
+                        {
+                            util::thread::scoped_lock lock(m);
+                            if (i > failed_chunk) return;
+                        }
+                        chunk_type& c = chunks[i];
+                        c.ok = c.worker->read(c.first, c.last);
+                        if (!c.ok) {
+                            util::thread::scoped_lock lock(m);
+                            if (i < failed_chunk) failed_chunk = i;
+                        }
+                    }
+                }
+
+                void move_chunks(void) {
+                    std::size_t i;
+                    while (pool.take(i)) {
+                        // the records before the chunk
+                        std::size_t offset = 0;
+                        for (std::size_t k = 0; k < i; ++k) {
+                            offset += chunks[k].worker->numof_records;
+                        }
+                        reader* w = chunks[i].worker;
+                        for (std::size_t j = 0; j < columns.size(); ++j) {
+                            if (columns[j] != 0) {
+                                w->columns[j]->move_to(*columns[j],
+                                        base_sizes[j] + offset);
+                            }
+                        }
+                    }
+                }
+
+                // The head of the record after p. quoted is whether p is
+                // in a quoted field, and origin is the head of the range.
+                const char* next_record(const char* p, const char* last,
+                                        const char* origin,
+                                        bool quoted) const {
+                    const char quote =
+                        dialect.quote ? dialect.quote : '\n';
+                    for (;;) {
+                        p = util::string::find_first_of(
+                                p, last, quote, '\n', '\n');
+                        if (p == last) return last;
+                        if (*p != '\n') {
+                            quoted = !quoted;
+                        }
+                        else if (!quoted && !is_escaped(p, origin)) {
+                            return p + 1;
+                        }
+                        ++p;
+                    }
+                }
+
+                // whether odd escapes are before p
+                bool is_escaped(const char* p, const char* origin) const {
+                    if (dialect.escape == '\0') return false;
+                    bool escaped = false;
+                    while (p != origin && *--p == dialect.escape) {
+                        escaped = !escaped;
+                    }
+                    return escaped;
+                }
+
+                void begin(void) {
+                    base_sizes.assign(columns.size(), 0);
+                    for (std::size_t i = 0; i < columns.size(); ++i) {
+                        if (columns[i] != 0) {
+                            base_sizes[i] = columns[i]->size();
+                        }
+                    }
+                    numof_records = 0;
+                    in_header = dialect.header;
+                    if (in_header) column_names.clear();
+                }
+
+                // This removes the fields of the record that isn't
+                // complete.
+                void rollback(void) {
+                    for (std::size_t i = 0; i < columns.size(); ++i) {
+                        if (columns[i] != 0) {
+                            columns[i]->resize(base_sizes[i] + numof_records);
+                        }
+                    }
+                }
+
+                // This reads the records from p, and leaves p at the head
+                // of the record that continues after last unless final.
+                bool parse(const char*& p, const char* last, bool final) {
+                    while (p != last) {
+                        const char* next = p;
+                        const state_type state =
+                            parse_record(next, last, final);
+                        if (state != RECORD) {
+                            if (!in_header) rollback();
+                            return state == INCOMPLETE;
+                        }
+                        p = next;
+                    }
+                    return true;
+                }
+
+                state_type parse_record(const char*& p, const char* last,
+                                        bool final) {
+                    // an empty line
+                    if (*p == '\r') {
+                        if (p + 1 == last) {
+                            if (!final) return INCOMPLETE;
+                            ++p;
+                            return RECORD;
+                        }
+                        if (p[1] == '\n') {
+                            p += 2;
+                            return RECORD;
+                        }
+                    }
+                    if (*p == '\n') {
+                        ++p;
+                        return RECORD;
+                    }
+                    if (in_header) column_names.clear();
+
+                    const char delimiter = dialect.delimiter;
+                    const char quote = dialect.quote;
+                    const char escape = dialect.escape;
+                    // the characters to stop at, with duplicates for '\0'
+                    const char unquoted_stop =
+                        escape ? escape : quote ? quote : '\n';
+                    const char quoted_stop = escape ? escape : quote;
+
+                    std::size_t index = 0;
+                    for (;; ++index) {
+                        util::string::string_ref field;
+
+                        if (quote != '\0' && p != last && *p == quote) {
+                            unescaped.clear();
+                            ++p;
+                            for (;;) {
+                                const char* q = util::string::find_first_of(
+                                        p, last, quote, quote, quoted_stop);
+                                unescaped.append(p, q);
+                                if (q == last) {
+                                    if (!final) return INCOMPLETE;
+                                    DBGLOG("Unterminated quote in the record "
+                                            << record_number());
+                                    return FAILED;
+                                }
+                                if (q + 1 == last && !final) {
+                                    return INCOMPLETE;
+                                }
+                                if (*q == escape) {
+                                    if (q + 1 == last) {
+                                        DBGLOG("Escape at the end of the"
+                                                " record "
+                                                << record_number());
+                                        return FAILED;
+                                    }
+                                    unescaped += q[1];
+                                    p = q + 2;
+                                    continue;
+                                }
+                                // a doubled quote
+                                if (q + 1 != last && q[1] == quote) {
+                                    unescaped += quote;
+                                    p = q + 2;
+                                    continue;
+                                }
+                                p = q + 1;
+                                break;
+                            }
+                            field = unescaped;
+
+                            // CR of CR LF, or at the end
+                            if (p != last && *p == '\r') {
+                                if (p + 1 != last) {
+                                    if (p[1] == '\n') ++p;
+                                }
+                                else {
+                                    if (!final) return INCOMPLETE;
+                                    ++p;
+                                }
+                            }
+                            if (p != last && *p != delimiter && *p != '\n') {
+                                DBGLOG("Characters after the quote in the"
+                                        " record " << record_number());
+                                return FAILED;
+                            }
+                        }
+                        else {
+                            const char* const head = p;
+                            p = util::string::find_first_of(
+                                    p, last, delimiter, '\n', unquoted_stop);
+                            if (p != last && *p == escape && escape != '\0') {
+                                unescaped.assign(head, p);
+                                while (p != last && *p == escape) {
+                                    if (p + 1 == last) {
+                                        if (!final) return INCOMPLETE;
+                                        DBGLOG("Escape at the end of the"
+                                                " record "
+                                                << record_number());
+                                        return FAILED;
+                                    }
+                                    unescaped += p[1];
+                                    const char* const rest = p + 2;
+                                    p = util::string::find_first_of(
+                                            rest, last, delimiter, '\n',
+                                            escape);
+                                    unescaped.append(rest, p);
+                                }
+                                field = unescaped;
+                            }
+                            else if (p != last && *p == quote
+                                    && quote != '\0') {
+                                DBGLOG("Quote in the unquoted field of the"
+                                        " record " << record_number());
+                                return FAILED;
+                            }
+                            else {
+                                field = util::string::string_ref(
+                                        head, p - head);
+                            }
+                            // CR of CR LF, or at the end
+                            if ((p == last || *p == '\n') && !field.empty()
+                                    && field[field.size() - 1] == '\r') {
+                                field = util::string::string_ref(
+                                        field.data(), field.size() - 1);
+                            }
+                        }
+
+                        if (p == last && !final) return INCOMPLETE;
+                        if (!store(index, field)) return FAILED;
+                        if (p == last) break;
+                        if (*p++ == '\n') break;
+                    }
+
+                    if (in_header) {
+                        in_header = false;
+                        return RECORD;
+                    }
+                    if (index + 1 < columns.size()) {
+                        DBGLOG("Too few fields in the record "
+                                << record_number() << ": " << index + 1);
+                        return FAILED;
+                    }
+                    ++numof_records;
+                    return RECORD;
+                }
+
+                bool store( std::size_t index,
+                            const util::string::string_ref& field) {
+                    if (in_header) {
+                        column_names.push_back(
+                                std::string(field.data(), field.size()));
+                        return true;
+                    }
+                    if (index >= columns.size() || columns[index] == 0) {
+                        return true;
+                    }
+                    if (!columns[index]->push(converter, field)) {
+                        DBGLOG("Can't convert the field " << index
+                                << " of the record " << record_number()
+                                << ": " << field);
+                        return false;
+                    }
+                    return true;
+                }
+
+                // 1 origin, including the header
+                std::size_t record_number(void) const {
+                    return numof_records
+                        + ((dialect.header && !in_header) ? 2 : 1);
+                }
+
+                // not copyable
+                reader(const reader&);
+                reader& operator=(const reader&);
+        };
+    }
+}
+
+#endif // CSV_HPP
@@ -0,0 +1,206 @@
+/*
+ * mmap.hpp
+ *  a class to map a whole file into memory
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#ifndef MMAP_HPP
+#define MMAP_HPP
+
+#include <cstddef>
+
+#ifdef _MSC_VER
+#   ifndef NOMINMAX
+#       define NOMINMAX     // keep std::min(2) and std::max(2) usable
+#   endif
+#   include <windows.h>     // for CreateFile(7), MapViewOfFile(5)
+#else
+#   include <fcntl.h>       // for open(2)
+#   include <sys/mman.h>    // for mmap(6), munmap(2)
+#   include <sys/stat.h>    // for fstat(2)
+#   include <unistd.h>      // for close(1)
+#endif
+
+#include "dlogger.hpp"
+
+namespace util {
+    namespace file {
+        /*
+         *  A class to map a whole file into memory.
+         *  Usage:
+         *
+         *      util::file::mapping m("foo.wav");
+         *      if (!m.is_open()) return 1;
+         *      std::copy(m.begin(), m.end(), ...);
+         *
+         *  This object is not copyable. The mapping is released when the
+         *  object is destroyed or close() is called.
+         * */
+        class mapping {
+            public:
+                typedef char            value_type;
+                typedef char*           iterator;
+                typedef const char*     const_iterator;
+                typedef std::size_t     size_type;
+
+                enum mode_type {
+                    READ_ONLY,
+                    READ_WRITE
+                };
+
+            private:
+                char* head;
+                size_type length;
+                bool opened;
+#ifdef _MSC_VER
+                HANDLE file;
+                HANDLE map;
+#endif
+
+            public:
+                // constructor
+                mapping(void) : head(0), length(0), opened(false) {
+#ifdef _MSC_VER
+                    file = INVALID_HANDLE_VALUE;
+                    map = 0;
+#endif
+                }
+                explicit mapping(const char* path, mode_type mode = READ_ONLY)
+                    : head(0), length(0), opened(false) {
+#ifdef _MSC_VER
+                    file = INVALID_HANDLE_VALUE;
+                    map = 0;
+#endif
+                    open(path, mode);
+                }
+
+                // destructor
+                ~mapping(void) { close(); }
+
+                // open and close
+                bool open(const char* path, mode_type mode = READ_ONLY) {
+                    close();
+
+#ifdef _MSC_VER
+                    const bool writable = (mode == READ_WRITE);
+                    file = CreateFileA(path,
+                            writable ? (GENERIC_READ | GENERIC_WRITE)
+                                     : GENERIC_READ,
+                            FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+                    if (file == INVALID_HANDLE_VALUE) {
+                        DBGLOG("Can't open the file: " << path);
+                        return false;
+                    }
+
+                    LARGE_INTEGER file_size;
+                    if (!GetFileSizeEx(file, &file_size)) {
+                        DBGLOG("Can't get the size of the file: " << path);
+                        close();
+                        return false;
+                    }
+                    // an empty file can't be mapped, but it's not an error
+                    if (file_size.QuadPart == 0) {
+                        opened = true;
+                        return true;
+                    }
+
+                    map = CreateFileMappingA(file, NULL,
+                            writable ? PAGE_READWRITE : PAGE_READONLY,
+                            0, 0, NULL);
+                    if (map == 0) {
+                        DBGLOG("Can't create a file mapping object: " << path);
+                        close();
+                        return false;
+                    }
+
+                    head = static_cast<char*>(MapViewOfFile(map,
+                                writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+                                0, 0, 0));
+                    if (head == 0) {
+                        DBGLOG("Can't map the file: " << path);
+                        close();
+                        return false;
+                    }
+                    length = static_cast<size_type>(file_size.QuadPart);
+#else
+                    const bool writable = (mode == READ_WRITE);
+                    int fd = ::open(path, writable ? O_RDWR : O_RDONLY);
+                    if (fd < 0) {
+                        DBGLOG("Can't open the file: " << path);
+                        return false;
+                    }
+
+                    struct stat st;
+                    if (fstat(fd, &st) != 0) {
+                        DBGLOG("Can't get the size of the file: " << path);
+                        ::close(fd);
+                        return false;
+                    }
+                    // an empty file can't be mapped, but it's not an error
+                    if (st.st_size == 0) {
+                        ::close(fd);
+                        opened = true;
+                        return true;
+                    }
+
+                    void* p = mmap(0, static_cast<size_type>(st.st_size),
+                            writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                            MAP_SHARED, fd, 0);
+                    // The mapping keeps a reference to the file, so the
+                    // descriptor isn't needed any more.
+                    ::close(fd);
+                    if (p == MAP_FAILED) {
+                        DBGLOG("Can't map the file: " << path);
+                        return false;
+                    }
+
+                    head = static_cast<char*>(p);
+                    length = static_cast<size_type>(st.st_size);
+#endif
+
+                    opened = true;
+                    return true;
+                }
+
+                void close(void) {
+#ifdef _MSC_VER
+                    if (head != 0) UnmapViewOfFile(head);
+                    if (map != 0) CloseHandle(map);
+                    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+                    map = 0;
+                    file = INVALID_HANDLE_VALUE;
+#else
+                    if (head != 0) munmap(head, length);
+#endif
+                    head = 0;
+                    length = 0;
+                    opened = false;
+                }
+
+                // Mapping an empty file succeeds, but data() returns NULL
+                // then.
+                bool is_open(void) const { return opened; }
+
+                // getters
+                char* data(void) { return head; }
+                const char* data(void) const { return head; }
+                size_type size(void) const { return length; }
+                bool empty(void) const { return length == 0; }
+
+                iterator begin(void) { return head; }
+                iterator end(void) { return head + length; }
+                const_iterator begin(void) const { return head; }
+                const_iterator end(void) const { return head + length; }
+
+            private:
+                // not copyable
+                mapping(const mapping&);
+                mapping& operator=(const mapping&);
+        };
+    }
+}
+
+#endif // MMAP_HPP
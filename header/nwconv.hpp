@@ -4,19 +4,432 @@
  *
  *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
  *  see LICENSE for redistributing, modifying, and so on.
+ *
+ * fast path
+ *  When the codecvt facet of the locale is UTF-8, basic_nwconv<wchar_t,
+ *  char, State> converts by the functions in util::string::utf8 instead of
+ *  the facet. wchar_t is UTF-32, or UTF-16 if it has 2 bytes. ASCII is
+ *  converted 16 or 32 characters at once with SSE2 or AVX2, see simd.hpp.
+ *  The input that isn't valid goes through the facet, so the errors are
+ *  same.
  * */
 
 #ifndef NWCONV_HPP
 #define NWCONV_HPP
 
+#include <cstddef>
+#include <cwchar>
 #include <locale>
+#include <streambuf>
 #include <string>
 #include <vector>
 #include <stdexcept>
+#include "simd.hpp"
 #include "wexcept.hpp"
 
 namespace util {
     namespace string {
+        namespace utf8 {
+            // the code points that are encoded to the surrogates of UTF-16
+            static const unsigned long surrogate_first = 0xd800;
+            static const unsigned long surrogate_last = 0xdfff;
+            static const unsigned long max_code_point = 0x10ffff;
+
+            /*
+             *  UTF-8 in [first, last) -> wchar_t from dst
+             *  dst must have last - first characters at least. This
+             *  returns the next of the last character, or NULL if src isn't
+             *  valid, that has an overlong form, a surrogate or a code
+             *  point over U+10FFFF.
+             * */
+            inline wchar_t* decode(const char* first, const char* last,
+                                    wchar_t* dst) {
+                const unsigned char* p =
+                    reinterpret_cast<const unsigned char*>(first);
+                const unsigned char* const end =
+                    reinterpret_cast<const unsigned char*>(last);
+                while (p != end) {
+                    // ASCII
+#ifdef SIMD_AVX2
+                    while (end - p >= 32) {
+                        if (_mm256_movemask_epi8(util::simd::load256(p))) {
+                            break;
+                        }
+                        if (sizeof(wchar_t) == 2) {
+                            util::simd::store256(dst,
+                                    _mm256_cvtepu8_epi16(
+                                        util::simd::load128(p)));
+                            util::simd::store256(dst + 16,
+                                    _mm256_cvtepu8_epi16(
+                                        util::simd::load128(p + 16)));
+                        }
+                        else {
+                            for (int i = 0; i < 32; i += 8) {
+                                util::simd::store256(dst + i,
+                                        _mm256_cvtepu8_epi32(
+                                            _mm_loadl_epi64(
+                                                reinterpret_cast<
+                                                    const __m128i*>(p + i))));
+                            }
+                        }
+                        p += 32;
+                        dst += 32;
+                    }
+#endif
+#ifdef SIMD_SSE2
+                    while (end - p >= 16) {
+                        const __m128i v = util::simd::load128(p);
+                        if (_mm_movemask_epi8(v)) break;
+                        const __m128i zero = _mm_setzero_si128();
+                        const __m128i lo = _mm_unpacklo_epi8(v, zero);
+                        const __m128i hi = _mm_unpackhi_epi8(v, zero);
+                        if (sizeof(wchar_t) == 2) {
+                            util::simd::store128(dst, lo);
+                            util::simd::store128(dst + 8, hi);
+                        }
+                        else {
+                            util::simd::store128(dst,
+                                    _mm_unpacklo_epi16(lo, zero));
+                            util::simd::store128(dst + 4,
+                                    _mm_unpackhi_epi16(lo, zero));
+                            util::simd::store128(dst + 8,
+                                    _mm_unpacklo_epi16(hi, zero));
+                            util::simd::store128(dst + 12,
+                                    _mm_unpackhi_epi16(hi, zero));
+                        }
+                        p += 16;
+                        dst += 16;
+                    }
+#endif
+                    while (p != end && *p < 0x80) *dst++ = *p++;
+                    if (p == end) break;
+
+                    // a multibyte sequence
+                    const unsigned char c = *p;
+                    std::size_t length;
+                    unsigned long cp;
+                    // the range of the second byte
+                    unsigned char low = 0x80;
+                    unsigned char high = 0xbf;
+                    if (c < 0xc2) return 0;
+                    else if (c < 0xe0) {
+                        length = 2;
+                        cp = c & 0x1f;
+                    }
+                    else if (c < 0xf0) {
+                        length = 3;
+                        cp = c & 0x0f;
+                        if (c == 0xe0) low = 0xa0;
+                        if (c == 0xed) high = 0x9f;
+                    }
+                    else if (c < 0xf5) {
+                        length = 4;
+                        cp = c & 0x07;
+                        if (c == 0xf0) low = 0x90;
+                        if (c == 0xf4) high = 0x8f;
+                    }
+                    else return 0;
+
+                    if (static_cast<std::size_t>(end - p) < length
+                            || p[1] < low || p[1] > high) {
+                        return 0;
+                    }
+                    for (std::size_t i = 1; i < length; ++i) {
+                        if ((p[i] & 0xc0) != 0x80) return 0;
+                        cp = (cp << 6) | (p[i] & 0x3f);
+                    }
+                    p += length;
+
+                    if (sizeof(wchar_t) == 2 && cp > 0xffff) {
+                        cp -= 0x10000;
+                        *dst++ = static_cast<wchar_t>(
+                                surrogate_first + (cp >> 10));
+                        *dst++ = static_cast<wchar_t>(
+                                0xdc00 + (cp & 0x3ff));
+                    }
+                    else {
+                        *dst++ = static_cast<wchar_t>(cp);
+                    }
+                }
+                return dst;
+            }
+
+            // the code point at p, or a value over max_code_point if not
+            // valid
+            inline unsigned long code_point(const wchar_t*& p,
+                                            const wchar_t* last) {
+                unsigned long cp = static_cast<unsigned long>(*p++);
+                if (sizeof(wchar_t) == 2) {
+                    cp &= 0xffff;
+                    if (cp >= surrogate_first && cp <= surrogate_last) {
+                        const unsigned long low = (p != last)
+                            ? (static_cast<unsigned long>(*p) & 0xffff) : 0;
+                        if (cp >= 0xdc00 || low < 0xdc00 || low > 0xdfff) {
+                            return max_code_point + 1;
+                        }
+                        ++p;
+                        return 0x10000 + ((cp - surrogate_first) << 10)
+                            + (low - 0xdc00);
+                    }
+                }
+                else if (cp >= surrogate_first && cp <= surrogate_last) {
+                    return max_code_point + 1;
+                }
+                return cp;
+            }
+
+            // the ASCII characters from p, that are 16 at least or none
+            inline std::size_t ascii_prefix(const wchar_t* p,
+                                            const wchar_t* last) {
+                std::size_t n = 0;
+#ifdef SIMD_SSE2
+                const __m128i zero = _mm_setzero_si128();
+                if (sizeof(wchar_t) == 2) {
+                    const __m128i mask = _mm_set1_epi16(~0x7f);
+                    for (; last - p >= 16; p += 16, n += 16) {
+                        const __m128i v = _mm_or_si128(
+                                util::simd::load128(p),
+                                util::simd::load128(p + 8));
+                        if (_mm_movemask_epi8(_mm_cmpeq_epi16(
+                                        _mm_and_si128(v, mask), zero))
+                                != 0xffff) {
+                            break;
+                        }
+                    }
+                }
+                else {
+                    const __m128i mask = _mm_set1_epi32(~0x7f);
+                    for (; last - p >= 16; p += 16, n += 16) {
+                        const __m128i v = _mm_or_si128(
+                                _mm_or_si128(
+                                    util::simd::load128(p),
+                                    util::simd::load128(p + 4)),
+                                _mm_or_si128(
+                                    util::simd::load128(p + 8),
+                                    util::simd::load128(p + 12)));
+                        if (_mm_movemask_epi8(_mm_cmpeq_epi32(
+                                        _mm_and_si128(v, mask), zero))
+                                != 0xffff) {
+                            break;
+                        }
+                    }
+                }
+#else
+                static_cast<void>(p);
+                static_cast<void>(last);
+#endif
+                return n;
+            }
+
+            /*
+             *  the bytes of [first, last) in UTF-8
+             *  This returns false if src has a surrogate that isn't paired
+             *  or a code point over U+10FFFF.
+             * */
+            inline bool encoded_size(   const wchar_t* first,
+                                        const wchar_t* last,
+                                        std::size_t& size) {
+                std::size_t n = 0;
+                while (first != last) {
+                    const std::size_t ascii = ascii_prefix(first, last);
+                    first += ascii;
+                    n += ascii;
+                    if (first == last) break;
+
+                    const unsigned long cp = code_point(first, last);
+                    if (cp < 0x80) n += 1;
+                    else if (cp < 0x800) n += 2;
+                    else if (cp < 0x10000) n += 3;
+                    else if (cp <= max_code_point) n += 4;
+                    else return false;
+                }
+                size = n;
+                return true;
+            }
+
+            /*
+             *  wchar_t in [first, last) -> UTF-8 from dst
+             *  [first, last) must be valid as encoded_size(3) says, and dst
+             *  must have the size of it. This returns the next of the last
+             *  byte.
+             * */
+            inline char* encode(const wchar_t* first, const wchar_t* last,
+                                char* dst) {
+                while (first != last) {
+                    const std::size_t ascii = ascii_prefix(first, last);
+#ifdef SIMD_SSE2
+                    for (std::size_t i = 0; i < ascii; i += 16) {
+                        __m128i v;
+                        if (sizeof(wchar_t) == 2) {
+                            v = _mm_packus_epi16(
+                                    util::simd::load128(first + i),
+                                    util::simd::load128(first + i + 8));
+                        }
+                        else {
+                            v = _mm_packus_epi16(
+                                    _mm_packs_epi32(
+                                        util::simd::load128(first + i),
+                                        util::simd::load128(first + i + 4)),
+                                    _mm_packs_epi32(
+                                        util::simd::load128(first + i + 8),
+                                        util::simd::load128(
+                                            first + i + 12)));
+                        }
+                        util::simd::store128(dst + i, v);
+                    }
+#endif
+                    first += ascii;
+                    dst += ascii;
+                    if (first == last) break;
+
+                    const unsigned long cp = code_point(first, last);
+                    if (cp < 0x80) {
+                        *dst++ = static_cast<char>(cp);
+                    }
+                    else if (cp < 0x800) {
+                        *dst++ = static_cast<char>(0xc0 | (cp >> 6));
+                        *dst++ = static_cast<char>(0x80 | (cp & 0x3f));
+                    }
+                    else if (cp < 0x10000) {
+                        *dst++ = static_cast<char>(0xe0 | (cp >> 12));
+                        *dst++ = static_cast<char>(
+                                0x80 | ((cp >> 6) & 0x3f));
+                        *dst++ = static_cast<char>(0x80 | (cp & 0x3f));
+                    }
+                    else {
+                        *dst++ = static_cast<char>(0xf0 | (cp >> 18));
+                        *dst++ = static_cast<char>(
+                                0x80 | ((cp >> 12) & 0x3f));
+                        *dst++ = static_cast<char>(
+                                0x80 | ((cp >> 6) & 0x3f));
+                        *dst++ = static_cast<char>(0x80 | (cp & 0x3f));
+                    }
+                }
+                return dst;
+            }
+
+            /*
+             *  The fast path of basic_nwconv for the types. This is
+             *  available for wchar_t and char only, and the functions return
+             *  false for the other types. ntow(3) and wton(3) append to dst,
+             *  and complete(2) returns the end of the sequences that aren't
+             *  split at last.
+             * */
+            template<typename Internal, typename External>
+                struct fast_path {
+                    template<typename Codecvt>
+                        static bool is_utf8(const Codecvt&) { return false; }
+                    template<typename Char>
+                        static const Char* complete(const Char*,
+                                                    const Char* last) {
+                            return last;
+                        }
+                    static bool ntow(   const External*, const External*,
+                                        std::basic_string<Internal>&) {
+                        return false;
+                    }
+                    static bool wton(   const Internal*, const Internal*,
+                                        std::basic_string<External>&) {
+                        return false;
+                    }
+                };
+
+            template<>
+                struct fast_path<wchar_t, char> {
+                    // whether conv converts the samples as UTF-8
+                    template<typename State>
+                        static bool is_utf8(
+                                const std::codecvt<wchar_t, char, State>&
+                                    conv) {
+                            // "Aé€" and U+1F600
+                            static const char narrow[] =
+                                "A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80";
+                            const std::size_t narrow_size =
+                                sizeof(narrow) - 1;
+                            wchar_t wide[sizeof(narrow)];
+                            wchar_t* const wide_end = decode(
+                                    narrow, narrow + narrow_size, wide);
+
+                            wchar_t in[sizeof(narrow)];
+                            const char* from_next;
+                            wchar_t* in_next;
+                            State in_state = State();
+                            if (conv.in(in_state,
+                                        narrow, narrow + narrow_size,
+                                        from_next,
+                                        in, in + sizeof(narrow), in_next)
+                                    != std::codecvt_base::ok
+                                    || std::wstring(in, in_next)
+                                        != std::wstring(wide, wide_end)) {
+                                return false;
+                            }
+
+                            char out[sizeof(narrow)];
+                            const wchar_t* out_from_next;
+                            char* out_next;
+                            State out_state = State();
+                            return conv.out(out_state,
+                                        wide, wide_end, out_from_next,
+                                        out, out + sizeof(narrow), out_next)
+                                    == std::codecvt_base::ok
+                                && std::string(out, out_next)
+                                    == std::string(narrow, narrow_size);
+                        }
+
+                    // the lead byte of a sequence that isn't complete
+                    static const char* complete(const char* first,
+                                                const char* last) {
+                        for (std::ptrdiff_t i = 1;
+                                i <= 3 && i <= last - first; ++i) {
+                            const unsigned char c =
+                                static_cast<unsigned char>(last[-i]);
+                            if ((c & 0xc0) == 0x80) continue;
+                            const std::ptrdiff_t length = (c >= 0xf0) ? 4
+                                : (c >= 0xe0) ? 3 : (c >= 0xc0) ? 2 : 1;
+                            return (length > i) ? last - i : last;
+                        }
+                        return last;
+                    }
+                    // the high surrogate of UTF-16
+                    static const wchar_t* complete( const wchar_t* first,
+                                                    const wchar_t* last) {
+                        if (sizeof(wchar_t) == 2 && first != last) {
+                            const unsigned long c =
+                                static_cast<unsigned long>(last[-1]) & 0xffff;
+                            if (c >= surrogate_first && c < 0xdc00) {
+                                return last - 1;
+                            }
+                        }
+                        return last;
+                    }
+
+                    static bool ntow(   const char* first, const char* last,
+                                        std::wstring& dst) {
+                        const std::size_t size = dst.size();
+                        dst.resize(size + (last - first));
+                        const wchar_t* const end =
+                            decode(first, last, &dst[size]);
+                        if (end == 0) {
+                            dst.resize(size);
+                            return false;
+                        }
+                        dst.resize(end - dst.data());
+                        return true;
+                    }
+
+                    static bool wton(   const wchar_t* first,
+                                        const wchar_t* last,
+                                        std::string& dst) {
+                        std::size_t size;
+                        if (!encoded_size(first, last, size)) return false;
+                        const std::size_t head = dst.size();
+                        dst.resize(head + size);
+                        encode(first, last, &dst[head]);
+                        return true;
+                    }
+                };
+        }
+
         template<typename Internal, typename External, typename State>
             class basic_nwconv {
                 private:
@@ -28,56 +441,44 @@ namespace util {
                     typedef std::basic_string<intern_type>          intern_string_type;
                     typedef std::basic_string<extern_type>          extern_string_type;
 
-                    // cache a reference and objects
-                    const codecvt_type& codecvt(void) const {
-                        static const codecvt_type& conv = std::use_facet<codecvt_type>(loc);
-                        return conv;
-                    }
-                    state_type& in_state(void) const {
-                        static state_type in_stat;
-                        return in_stat;
-                    }
-                    state_type& out_state(void) const {
-                        static state_type out_stat;
-                        return out_stat;
-                    }
-
                     // member variables
+                    // loc owns the facet, so conv is valid while this
+                    // object is alive.
                     std::locale loc;
+                    const codecvt_type* conv;
+                    bool utf8_facet;
+
+                    const codecvt_type& codecvt(void) const { return *conv; }
 
                 public:
                     // constructor
+                    // Each conversion starts from the initial state of its
+                    // own, so the conversions are reentrant and an object
+                    // can be shared by threads without locks.
                     explicit
                     basic_nwconv(const std::locale& loc = std::locale())
-                    : loc(loc) {
+                    : loc(loc), conv(0), utf8_facet(false) {
                         if (!std::has_facet<codecvt_type>(loc))
                             throw std::logic_error("Specified locale doesn't have codecvt facet.");
+                        conv = &std::use_facet<codecvt_type>(this->loc);
+                        utf8_facet = utf8::fast_path<intern_type, extern_type>
+                            ::is_utf8(*conv);
                     }
 
                     // narrow to wide
                     intern_string_type ntow(const extern_string_type& src) const {
-                        // preparations
-                        // a size of src string
-                        const std::size_t size = src.length();
-
-                        // no more task
-                        if (size == 0) return intern_string_type();
-
-                        // buffers
-                        std::vector<intern_type> dst_vctr(size);
-                        intern_type* const dst = &dst_vctr[0];
-                        // a dummy variable and a pointer to the next position
-                        const extern_type* dummy;
-                        intern_type* next;
-                        // cache the first position of c style characters
-                        const extern_type* const s = src.c_str();
-
-                        // do it
-                        if (codecvt().in(
-                                    in_state(),
-                                    s,   s   + size, dummy,
-                                    dst, dst + size, next) == codecvt_type::ok) {
-                            return std::wstring(dst, next - dst);
+                        intern_string_type dst;
+                        ntow(src, dst);
+                        return dst;
+                    }
+
+                    // This reuses the capacity of dst.
+                    void ntow(const extern_string_type& src, intern_string_type& dst) const {
+                        dst.clear();
+                        const extern_type* const s = src.data();
+                        state_type state = state_type();
+                        if (ntow(state, s, s + src.size(), dst, true) == s + src.size()) {
+                            return;
                         }
 
                         std::string errmsg("failed: ");
@@ -85,45 +486,395 @@ namespace util {
                         throw std::logic_error(errmsg);
                     }
 
+                    /*
+                     *  narrow to wide chunk by chunk
+                     *  This appends the characters of [first, last) to dst,
+                     *  and returns the head of the sequence that continues
+                     *  after last, or NULL if they aren't valid. state is
+                     *  the state of the facet through the chunks. See
+                     *  basic_widener for usual uses.
+                     * */
+                    const extern_type* ntow(state_type& state,
+                                            const extern_type* first,
+                                            const extern_type* last,
+                                            intern_string_type& dst) const {
+                        return ntow(state, first, last, dst, false);
+                    }
+
                     // wide to narrow
                     extern_string_type wton(const intern_string_type& src) const {
-                        // preparations
-                        // a size of src string
-                        const std::size_t src_size = src.length();
-
-                        // no more task
-                        if (src_size == 0) return extern_string_type();
+                        extern_string_type dst;
+                        wton(src, dst);
+                        return dst;
+                    }
 
-                        // calc a size of dst string
-                        // This value is expected maximum.
-                        const std::size_t dst_size = codecvt().max_length() * src_size;
-                        // buffers
-                        std::vector<extern_type> dst_vctr(dst_size);
-                        extern_type* const dst = &dst_vctr[0];
-                        // a dummy variable and a pointer to the next position
-                        const intern_type* dummy;
-                        extern_type* next;
-                        // cache the first position of c style characters
-                        const intern_type* const s = src.c_str();
-
-                        // do it
-                        if (codecvt().out(
-                                    out_state(),
-                                    s,   s   + src_size, dummy,
-                                    dst, dst + dst_size, next) == codecvt_type::ok) {
-                            return std::string(dst, next - dst);
+                    // This reuses the capacity of dst.
+                    void wton(const intern_string_type& src, extern_string_type& dst) const {
+                        dst.clear();
+                        const intern_type* const s = src.data();
+                        state_type state = state_type();
+                        if (wton(state, s, s + src.size(), dst, true) == s + src.size()) {
+                            return;
                         }
 
                         std::wstring errmsg(L"failed: ");
                         errmsg.append(src);
                         throw util::exception::wlogic_error(errmsg);
                     }
+
+                    // wide to narrow chunk by chunk
+                    // The same as ntow(4), see basic_narrower.
+                    const intern_type* wton(state_type& state,
+                                            const intern_type* first,
+                                            const intern_type* last,
+                                            extern_string_type& dst) const {
+                        return wton(state, first, last, dst, false);
+                    }
+
+                private:
+                    // The fast path leaves the sequence that is split at
+                    // last to the next chunk unless final. The facet decides
+                    // with the state for a whole string.
+                    const extern_type* ntow(state_type& state,
+                                            const extern_type* first,
+                                            const extern_type* last,
+                                            intern_string_type& dst,
+                                            bool final) const {
+                        // the fast path for UTF-8
+                        if (utf8_facet) {
+                            const extern_type* const end = final ? last
+                                : utf8::fast_path<intern_type, extern_type>
+                                    ::complete(first, last);
+                            if (first == end) return end;
+                            if (utf8::fast_path<intern_type, extern_type>
+                                    ::ntow(first, end, dst)) {
+                                return end;
+                            }
+                        }
+                        if (first == last) return last;
+
+                        // A wide character needs a narrow character at
+                        // least.
+                        const std::size_t size = dst.size();
+                        dst.resize(size + (last - first));
+                        intern_type* const to = &dst[size];
+                        const extern_type* next;
+                        intern_type* to_next;
+                        const std::codecvt_base::result result = codecvt().in(
+                                state,
+                                first, last, next,
+                                to, to + (last - first), to_next);
+                        dst.resize(size + (to_next - to));
+                        if (result != codecvt_type::ok
+                                && result != codecvt_type::partial) {
+                            return 0;
+                        }
+                        return next;
+                    }
+
+                    const intern_type* wton(state_type& state,
+                                            const intern_type* first,
+                                            const intern_type* last,
+                                            extern_string_type& dst,
+                                            bool final) const {
+                        // the fast path for UTF-8
+                        if (utf8_facet) {
+                            const intern_type* const end = final ? last
+                                : utf8::fast_path<intern_type, extern_type>
+                                    ::complete(first, last);
+                            if (first == end) return end;
+                            if (utf8::fast_path<intern_type, extern_type>
+                                    ::wton(first, end, dst)) {
+                                return end;
+                            }
+                        }
+                        if (first == last) return last;
+
+                        // This value is expected maximum.
+                        const std::size_t capacity =
+                            codecvt().max_length() * (last - first);
+                        const std::size_t size = dst.size();
+                        dst.resize(size + capacity);
+                        extern_type* const to = &dst[size];
+                        const intern_type* next;
+                        extern_type* to_next;
+                        const std::codecvt_base::result result = codecvt().out(
+                                state,
+                                first, last, next,
+                                to, to + capacity, to_next);
+                        dst.resize(size + (to_next - to));
+                        if (result != codecvt_type::ok
+                                && result != codecvt_type::partial) {
+                            return 0;
+                        }
+                        return next;
+                    }
+            };
+
+        // whether state is the initial, that is known for mbstate_t only
+        template<typename State>
+            inline bool is_initial_state(const State&) { return true; }
+        inline bool is_initial_state(const std::mbstate_t& state) {
+            return std::mbsinit(&state) != 0;
+        }
+
+        /*
+         *  A class to convert narrow characters to wide chunk by chunk.
+         *  Usage:
+         *
+         *      util::string::nwconv conv(std::locale(""));
+         *      util::string::widener w(conv);
+         *      char buffer[4096];
+         *      std::wstring dst;
+         *      while (in.read(buffer, sizeof(buffer)) || in.gcount()) {
+         *          dst.clear();    // reuse the capacity
+         *          if (!w.convert(buffer, buffer + in.gcount(), dst)) {
+         *              return 1;   // not valid
+         *          }
+         *          ...
+         *      }
+         *      if (!w.finish()) return 1;  // truncated
+         *
+         *  A multibyte sequence that is split by the chunks is kept until
+         *  the next chunk, with the state of the facet. conv must live
+         *  longer than this.
+         * */
+        template<typename Internal, typename External, typename State>
+            class basic_widener {
+                private:
+                    // typedefs
+                    typedef basic_nwconv<Internal, External, State> nwconv_type;
+
+                    // member variables
+                    const nwconv_type* conv;
+                    State state;
+                    std::basic_string<External> pending;
+
+                public:
+                    // constructor
+                    explicit basic_widener(const nwconv_type& conv)
+                    : conv(&conv), state() {}
+
+                    // This appends the characters of [first, last) to dst,
+                    // and returns false if they aren't valid.
+                    bool convert(   const External* first,
+                                    const External* last,
+                                    std::basic_string<Internal>& dst) {
+                        // the rest of the sequence at the last chunk
+                        while (!pending.empty() && first != last) {
+                            pending += *first++;
+                            const External* const head = pending.data();
+                            const External* const tail = head + pending.size();
+                            const External* const next =
+                                conv->ntow(state, head, tail, dst);
+                            if (next == 0) return false;
+                            pending.erase(0, next - head);
+                        }
+                        if (first == last) return true;
+
+                        const External* const next =
+                            conv->ntow(state, first, last, dst);
+                        if (next == 0) return false;
+                        pending.assign(next, last);
+                        return true;
+                    }
+
+                    // This returns false if a sequence isn't complete, and
+                    // resets the state for the next stream.
+                    bool finish(void) {
+                        const bool complete =
+                            pending.empty() && is_initial_state(state);
+                        reset();
+                        return complete;
+                    }
+
+                    void reset(void) {
+                        state = State();
+                        pending.clear();
+                    }
+            };
+
+        // A class to convert wide characters to narrow chunk by chunk.
+        // The same as basic_widener.
+        template<typename Internal, typename External, typename State>
+            class basic_narrower {
+                private:
+                    // typedefs
+                    typedef basic_nwconv<Internal, External, State> nwconv_type;
+
+                    // member variables
+                    const nwconv_type* conv;
+                    State state;
+                    std::basic_string<Internal> pending;
+
+                public:
+                    // constructor
+                    explicit basic_narrower(const nwconv_type& conv)
+                    : conv(&conv), state() {}
+
+                    bool convert(   const Internal* first,
+                                    const Internal* last,
+                                    std::basic_string<External>& dst) {
+                        // the rest of the sequence at the last chunk
+                        while (!pending.empty() && first != last) {
+                            pending += *first++;
+                            const Internal* const head = pending.data();
+                            const Internal* const tail = head + pending.size();
+                            const Internal* const next =
+                                conv->wton(state, head, tail, dst);
+                            if (next == 0) return false;
+                            pending.erase(0, next - head);
+                        }
+                        if (first == last) return true;
+
+                        const Internal* const next =
+                            conv->wton(state, first, last, dst);
+                        if (next == 0) return false;
+                        pending.assign(next, last);
+                        return true;
+                    }
+
+                    bool finish(void) {
+                        const bool complete =
+                            pending.empty() && is_initial_state(state);
+                        reset();
+                        return complete;
+                    }
+
+                    void reset(void) {
+                        state = State();
+                        pending.clear();
+                    }
+            };
+
+        /*
+         *  A stream buffer of wide characters on a stream buffer of narrow
+         *  characters, that converts them chunk by chunk with the
+         *  constant memory.
+         *  Usage:
+         *
+         *      std::ifstream file("foo.txt", std::ios::binary);
+         *      util::string::nwconv conv(std::locale(""));
+         *      util::string::wide_streambuf buffer(file.rdbuf(), conv);
+         *      std::wistream in(&buffer);
+         *      std::wstring line;
+         *      while (std::getline(in, line)) ...
+         *
+         *  The characters that aren't valid throw the same exceptions as
+         *  ntow(1) and wton(1), so the stream sets badbit. The output is
+         *  flushed by sync(0) and the destructor. narrow and conv must live
+         *  longer than this.
+         * */
+        template<typename Internal, typename External, typename State>
+            class basic_wide_streambuf : public std::basic_streambuf<Internal> {
+                public:
+                    // typedefs
+                    typedef std::basic_streambuf<Internal>  base_type;
+                    typedef typename base_type::traits_type traits_type;
+                    typedef typename base_type::int_type    int_type;
+                    typedef basic_nwconv<Internal, External, State> nwconv_type;
+
+                    static const std::size_t default_buffer_size = 1 << 16;
+
+                private:
+                    // member variables
+                    std::basic_streambuf<External>* narrow;
+                    basic_widener<Internal, External, State> widener;
+                    basic_narrower<Internal, External, State> narrower;
+                    std::vector<External> input;
+                    std::basic_string<Internal> get_area;
+                    std::vector<Internal> put_area;
+                    std::basic_string<External> output;
+
+                public:
+                    // constructor
+                    basic_wide_streambuf(
+                            std::basic_streambuf<External>* narrow,
+                            const nwconv_type& conv,
+                            std::size_t buffer_size = default_buffer_size)
+                    : narrow(narrow), widener(conv), narrower(conv),
+                      input(buffer_size ? buffer_size : 1),
+                      put_area(buffer_size ? buffer_size : 1) {
+                        this->setp(&put_area[0], &put_area[0] + put_area.size());
+                    }
+
+                    // destructor
+                    ~basic_wide_streambuf(void) {
+                        try {
+                            sync();
+                        }
+                        catch (...) {
+                            // an invalid character at the last
+                        }
+                    }
+
+                protected:
+                    int_type underflow(void) {
+                        if (this->gptr() < this->egptr()) {
+                            return traits_type::to_int_type(*this->gptr());
+                        }
+
+                        get_area.clear();
+                        while (get_area.empty()) {
+                            const std::streamsize n = narrow->sgetn(
+                                    &input[0],
+                                    static_cast<std::streamsize>(input.size()));
+                            if (n <= 0) {
+                                if (!widener.finish()) {
+                                    throw std::logic_error("failed: truncated sequence");
+                                }
+                                return traits_type::eof();
+                            }
+                            if (!widener.convert(&input[0], &input[0] + n, get_area)) {
+                                throw std::logic_error("failed: invalid sequence");
+                            }
+                        }
+
+                        Internal* const head = &get_area[0];
+                        this->setg(head, head, head + get_area.size());
+                        return traits_type::to_int_type(*head);
+                    }
+
+                    int_type overflow(int_type c) {
+                        flush();
+                        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                            *this->pptr() = traits_type::to_char_type(c);
+                            this->pbump(1);
+                        }
+                        return traits_type::not_eof(c);
+                    }
+
+                    int sync(void) {
+                        flush();
+                        return narrow->pubsync();
+                    }
+
+                private:
+                    // This converts the put area and writes it.
+                    void flush(void) {
+                        output.clear();
+                        if (!narrower.convert(this->pbase(), this->pptr(), output)) {
+                            throw util::exception::wlogic_error(L"failed: invalid character");
+                        }
+                        this->setp(this->pbase(), this->epptr());
+                        const std::streamsize n =
+                            static_cast<std::streamsize>(output.size());
+                        if (n != 0 && narrow->sputn(output.data(), n) != n) {
+                            throw std::runtime_error("failed: can't write");
+                        }
+                    }
+
+                    // not copyable
+                    basic_wide_streambuf(const basic_wide_streambuf&);
+                    basic_wide_streambuf& operator=(const basic_wide_streambuf&);
             };
 
         // for convenience
-        typedef basic_nwconv<wchar_t, char, mbstate_t> nwconv;
+        typedef basic_nwconv<wchar_t, char, mbstate_t>          nwconv;
+        typedef basic_widener<wchar_t, char, mbstate_t>         widener;
+        typedef basic_narrower<wchar_t, char, mbstate_t>        narrower;
+        typedef basic_wide_streambuf<wchar_t, char, mbstate_t>  wide_streambuf;
     }
 }
 
 #endif // NWCONV_HPP
-
@@ -0,0 +1,523 @@
+/*
+ * pcmconv.hpp
+ *  functions to convert blocks of linear PCM samples between integer and
+ *  normalized float formats
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ *
+ * formats
+ *  bit depth   integer format          float value
+ *   8          unsigned, offset 128    (x - 128) / 128
+ *  16          signed little-endian    x / 32768
+ *  24          signed little-endian,   x / 8388608
+ *              packed in 3 bytes
+ *  32          signed little-endian    x / 2147483648
+ *
+ *  Narrowing float to integer rounds to the nearest (ties to even) and clips
+ *  to the range of the format. TPDF dither can be added before rounding.
+ * */
+
+#ifndef PCMCONV_HPP
+#define PCMCONV_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#include "dlogger.hpp"
+#include "simd.hpp"
+
+namespace format {
+    namespace riff_wav {
+        /*
+         *  A generator of TPDF (triangular probability density function)
+         *  dither. This returns noise in (-1, 1) LSB.
+         *  Each object has its own state, so use an object per thread.
+         * */
+        class tpdf_dither {
+            private:
+                uint32_t state;
+
+            public:
+                // constructor
+                explicit tpdf_dither(uint32_t seed = 0x9e3779b9)
+                    : state(seed == 0 ? 1 : seed) {}
+
+                float operator()(void) { return uniform() + uniform(); }
+
+                // fill a buffer with noise
+                void generate(float* first, float* last) {
+                    for (; first != last; ++first) *first = (*this)();
+                }
+
+            private:
+                // xorshift32
+                uint32_t next(void) {
+                    state ^= state << 13;
+                    state ^= state >> 17;
+                    state ^= state << 5;
+                    return state;
+                }
+
+                // [-0.5, 0.5)
+                float uniform(void) {
+                    return static_cast<float>(next() >> 8)
+                        * (1.0f / 16777216.0f) - 0.5f;
+                }
+        };
+
+        /*
+         *  traits of sample formats
+         *      scale       the value that is mapped to 1.0
+         *      minimum     the minimum value in float
+         *      maximum     the maximum value in float
+         *                  This is 2147483520 for 32 bits, the greatest float
+         *                  that is less than 2^31.
+         *      load(1)     an integer from the format
+         *      store(2)    an integer to the format
+         * */
+        template<const unsigned int Byte> struct pcm_traits;
+
+        template<> struct pcm_traits<1> {
+            static float scale(void) { return 128.0f; }
+            static float minimum(void) { return -128.0f; }
+            static float maximum(void) { return 127.0f; }
+            static int32_t load(const char* p) {
+                return static_cast<int32_t>(static_cast<uint8_t>(*p)) - 128;
+            }
+            static void store(int32_t v, char* p) {
+                *p = static_cast<char>(v + 128);
+            }
+        };
+
+        template<> struct pcm_traits<2> {
+            static float scale(void) { return 32768.0f; }
+            static float minimum(void) { return -32768.0f; }
+            static float maximum(void) { return 32767.0f; }
+            static int32_t load(const char* p) {
+                int16_t v;
+                std::memcpy(&v, p, sizeof(v));
+                return v;
+            }
+            static void store(int32_t v, char* p) {
+                int16_t s = static_cast<int16_t>(v);
+                std::memcpy(p, &s, sizeof(s));
+            }
+        };
+
+        template<> struct pcm_traits<3> {
+            static float scale(void) { return 8388608.0f; }
+            static float minimum(void) { return -8388608.0f; }
+            static float maximum(void) { return 8388607.0f; }
+            static int32_t load(const char* p) {
+                const int32_t v =
+                      static_cast<int32_t>(static_cast<uint8_t>(p[0]))
+                    | static_cast<int32_t>(static_cast<uint8_t>(p[1])) << 8
+                    | static_cast<int32_t>(static_cast<uint8_t>(p[2])) << 16;
+                // sign extension
+                return (v ^ 0x800000) - 0x800000;
+            }
+            static void store(int32_t v, char* p) {
+                p[0] = static_cast<char>(v);
+                p[1] = static_cast<char>(v >> 8);
+                p[2] = static_cast<char>(v >> 16);
+            }
+        };
+
+        template<> struct pcm_traits<4> {
+            static float scale(void) { return 2147483648.0f; }
+            static float minimum(void) { return -2147483648.0f; }
+            static float maximum(void) { return 2147483520.0f; }
+            static int32_t load(const char* p) {
+                int32_t v;
+                std::memcpy(&v, p, sizeof(v));
+                return v;
+            }
+            static void store(int32_t v, char* p) {
+                std::memcpy(p, &v, sizeof(v));
+            }
+        };
+
+        /*
+         *  SIMD kernels
+         *  They process the samples as many as possible and return the
+         *  number of processed samples. The rest is processed by scalar
+         *  codes in pcm_converter. The primary template has no kernels.
+         *
+         *  noise can be NULL for no dither.
+         * */
+        template<const unsigned int Byte> struct pcm_kernel {
+            static std::size_t
+            to_float(const char*, float*, std::size_t) { return 0; }
+            static std::size_t
+            from_float(const float*, const float*, char*, std::size_t) {
+                return 0;
+            }
+        };
+
+#ifdef SIMD_SSE2
+        // the common part of narrowing: scale, dither, clip and round
+        inline __m128i
+        pcm_narrow(const float* src, const float* noise, std::size_t i,
+                __m128 scale, __m128 minimum, __m128 maximum) {
+            __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+            if (noise != 0) v = _mm_add_ps(v, _mm_loadu_ps(noise + i));
+            v = _mm_max_ps(_mm_min_ps(v, maximum), minimum);
+            return _mm_cvtps_epi32(v);
+        }
+#ifdef SIMD_AVX2
+        inline __m256i
+        pcm_narrow(const float* src, const float* noise, std::size_t i,
+                __m256 scale, __m256 minimum, __m256 maximum) {
+            __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+            if (noise != 0) v = _mm256_add_ps(v, _mm256_loadu_ps(noise + i));
+            v = _mm256_max_ps(_mm256_min_ps(v, maximum), minimum);
+            return _mm256_cvtps_epi32(v);
+        }
+#endif
+
+        template<> struct pcm_kernel<1> {
+            typedef pcm_traits<1> traits;
+
+            static std::size_t
+            to_float(const char* src, float* dst, std::size_t n) {
+                using namespace util::simd;
+                const __m128 k = _mm_set1_ps(1.0f / traits::scale());
+                const __m128i offset = _mm_set1_epi16(128);
+                const __m128i zero = _mm_setzero_si128();
+                std::size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    __m128i x = load128(src + i);
+                    __m128i lo = _mm_sub_epi16(
+                            _mm_unpacklo_epi8(x, zero), offset);
+                    __m128i hi = _mm_sub_epi16(
+                            _mm_unpackhi_epi8(x, zero), offset);
+                    store8(dst + i,      lo, k);
+                    store8(dst + i + 8,  hi, k);
+                }
+                return i;
+            }
+
+            static std::size_t
+            from_float( const float* src, const float* noise, char* dst,
+                        std::size_t n) {
+                using namespace util::simd;
+                const __m128 scale = _mm_set1_ps(traits::scale());
+                const __m128 minimum = _mm_set1_ps(traits::minimum());
+                const __m128 maximum = _mm_set1_ps(traits::maximum());
+                const __m128i offset = _mm_set1_epi16(128);
+                std::size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    __m128i a = pcm_narrow(src, noise, i,
+                            scale, minimum, maximum);
+                    __m128i b = pcm_narrow(src, noise, i + 4,
+                            scale, minimum, maximum);
+                    __m128i c = pcm_narrow(src, noise, i + 8,
+                            scale, minimum, maximum);
+                    __m128i d = pcm_narrow(src, noise, i + 12,
+                            scale, minimum, maximum);
+                    __m128i lo = _mm_add_epi16(_mm_packs_epi32(a, b), offset);
+                    __m128i hi = _mm_add_epi16(_mm_packs_epi32(c, d), offset);
+                    store128(dst + i, _mm_packus_epi16(lo, hi));
+                }
+                return i;
+            }
+
+            private:
+                // 8 samples in 16 bits -> 8 floats
+                static void store8(float* dst, __m128i x, __m128 k) {
+                    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+                    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+                    _mm_storeu_ps(dst,     _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+                    _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+                }
+        };
+
+        template<> struct pcm_kernel<2> {
+            typedef pcm_traits<2> traits;
+
+            static std::size_t
+            to_float(const char* src, float* dst, std::size_t n) {
+                using namespace util::simd;
+                std::size_t i = 0;
+#ifdef SIMD_AVX2
+                const __m256 k8 = _mm256_set1_ps(1.0f / traits::scale());
+                for (; i + 16 <= n; i += 16) {
+                    __m256i a = _mm256_cvtepi16_epi32(load128(src + i * 2));
+                    __m256i b = _mm256_cvtepi16_epi32(
+                            load128(src + i * 2 + 16));
+                    _mm256_storeu_ps(dst + i,
+                            _mm256_mul_ps(_mm256_cvtepi32_ps(a), k8));
+                    _mm256_storeu_ps(dst + i + 8,
+                            _mm256_mul_ps(_mm256_cvtepi32_ps(b), k8));
+                }
+#endif
+                const __m128 k = _mm_set1_ps(1.0f / traits::scale());
+                for (; i + 8 <= n; i += 8) {
+                    __m128i x = load128(src + i * 2);
+                    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+                    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+                    _mm_storeu_ps(dst + i,
+                            _mm_mul_ps(_mm_cvtepi32_ps(lo), k));
+                    _mm_storeu_ps(dst + i + 4,
+                            _mm_mul_ps(_mm_cvtepi32_ps(hi), k));
+                }
+                return i;
+            }
+
+            static std::size_t
+            from_float( const float* src, const float* noise, char* dst,
+                        std::size_t n) {
+                using namespace util::simd;
+                std::size_t i = 0;
+#ifdef SIMD_AVX2
+                const __m256 scale8 = _mm256_set1_ps(traits::scale());
+                const __m256 minimum8 = _mm256_set1_ps(traits::minimum());
+                const __m256 maximum8 = _mm256_set1_ps(traits::maximum());
+                for (; i + 16 <= n; i += 16) {
+                    __m256i a = pcm_narrow(src, noise, i,
+                            scale8, minimum8, maximum8);
+                    __m256i b = pcm_narrow(src, noise, i + 8,
+                            scale8, minimum8, maximum8);
+                    store256(dst + i * 2, _mm256_permute4x64_epi64(
+                                _mm256_packs_epi32(a, b), 0xd8));
+                }
+#endif
+                const __m128 scale = _mm_set1_ps(traits::scale());
+                const __m128 minimum = _mm_set1_ps(traits::minimum());
+                const __m128 maximum = _mm_set1_ps(traits::maximum());
+                for (; i + 8 <= n; i += 8) {
+                    __m128i a = pcm_narrow(src, noise, i,
+                            scale, minimum, maximum);
+                    __m128i b = pcm_narrow(src, noise, i + 4,
+                            scale, minimum, maximum);
+                    store128(dst + i * 2, _mm_packs_epi32(a, b));
+                }
+                return i;
+            }
+        };
+
+#ifdef SIMD_SSSE3
+        template<> struct pcm_kernel<3> {
+            typedef pcm_traits<3> traits;
+
+            static std::size_t
+            to_float(const char* src, float* dst, std::size_t n) {
+                using namespace util::simd;
+                // 3 bytes -> the upper 3 bytes of 4 bytes
+                const __m128i widen = _mm_setr_epi8(
+                        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+                std::size_t i = 0;
+                // Loads read 16 bytes for 12 bytes, so don't go over the end.
+#ifdef SIMD_AVX2
+                const __m256 k8 = _mm256_set1_ps(1.0f / 2147483648.0f);
+                const __m256i widen8 = _mm256_broadcastsi128_si256(widen);
+                for (; (i + 8) * 3 + 4 <= n * 3; i += 8) {
+                    __m256i x = _mm256_inserti128_si256(
+                            _mm256_castsi128_si256(load128(src + i * 3)),
+                            load128(src + i * 3 + 12), 1);
+                    __m256i v = _mm256_shuffle_epi8(x, widen8);
+                    _mm256_storeu_ps(dst + i,
+                            _mm256_mul_ps(_mm256_cvtepi32_ps(v), k8));
+                }
+#endif
+                // 2^-31, because the samples are shifted by 8 bits
+                const __m128 k = _mm_set1_ps(1.0f / 2147483648.0f);
+                for (; (i + 4) * 3 + 4 <= n * 3; i += 4) {
+                    __m128i v = _mm_shuffle_epi8(load128(src + i * 3), widen);
+                    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), k));
+                }
+                return i;
+            }
+
+            static std::size_t
+            from_float( const float* src, const float* noise, char* dst,
+                        std::size_t n) {
+                // 4 bytes -> the lower 3 bytes
+                const __m128i narrow = _mm_setr_epi8(
+                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                        -1, -1, -1, -1);
+                const __m128 scale = _mm_set1_ps(traits::scale());
+                const __m128 minimum = _mm_set1_ps(traits::minimum());
+                const __m128 maximum = _mm_set1_ps(traits::maximum());
+                std::size_t i = 0;
+                for (; i + 4 <= n; i += 4) {
+                    __m128i v = _mm_shuffle_epi8(pcm_narrow(src, noise, i,
+                                scale, minimum, maximum), narrow);
+                    // store 12 bytes
+                    char* d = dst + i * 3;
+                    _mm_storel_epi64(
+                            util::cast::pointer_cast<__m128i*>(d), v);
+                    const int32_t rest =
+                        _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+                    std::memcpy(d + 8, &rest, sizeof(rest));
+                }
+                return i;
+            }
+        };
+#endif // SIMD_SSSE3
+
+        template<> struct pcm_kernel<4> {
+            typedef pcm_traits<4> traits;
+
+            static std::size_t
+            to_float(const char* src, float* dst, std::size_t n) {
+                using namespace util::simd;
+                std::size_t i = 0;
+#ifdef SIMD_AVX2
+                const __m256 k8 = _mm256_set1_ps(1.0f / traits::scale());
+                for (; i + 8 <= n; i += 8) {
+                    __m256i v = load256(src + i * 4);
+                    _mm256_storeu_ps(dst + i,
+                            _mm256_mul_ps(_mm256_cvtepi32_ps(v), k8));
+                }
+#endif
+                const __m128 k = _mm_set1_ps(1.0f / traits::scale());
+                for (; i + 4 <= n; i += 4) {
+                    __m128i v = load128(src + i * 4);
+                    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), k));
+                }
+                return i;
+            }
+
+            static std::size_t
+            from_float( const float* src, const float* noise, char* dst,
+                        std::size_t n) {
+                using namespace util::simd;
+                std::size_t i = 0;
+#ifdef SIMD_AVX2
+                const __m256 scale8 = _mm256_set1_ps(traits::scale());
+                const __m256 minimum8 = _mm256_set1_ps(traits::minimum());
+                const __m256 maximum8 = _mm256_set1_ps(traits::maximum());
+                for (; i + 8 <= n; i += 8) {
+                    store256(dst + i * 4, pcm_narrow(src, noise, i,
+                                scale8, minimum8, maximum8));
+                }
+#endif
+                const __m128 scale = _mm_set1_ps(traits::scale());
+                const __m128 minimum = _mm_set1_ps(traits::minimum());
+                const __m128 maximum = _mm_set1_ps(traits::maximum());
+                for (; i + 4 <= n; i += 4) {
+                    store128(dst + i * 4, pcm_narrow(src, noise, i,
+                                scale, minimum, maximum));
+                }
+                return i;
+            }
+        };
+#endif // SIMD_SSE2
+
+        /*
+         *  converters for a format
+         *  The scalar codes give the same results as SIMD kernels.
+         * */
+        template<const unsigned int Byte>
+        struct pcm_converter {
+            typedef pcm_traits<Byte>    traits;
+            typedef pcm_kernel<Byte>    kernel;
+
+            static void to_float(const char* src, float* dst, std::size_t n) {
+                const float k = 1.0f / traits::scale();
+                for (std::size_t i = kernel::to_float(src, dst, n);
+                        i < n; ++i) {
+                    dst[i] = static_cast<float>(traits::load(src + i * Byte))
+                        * k;
+                }
+            }
+
+            static void from_float( const float* src, const float* noise,
+                                    char* dst, std::size_t n) {
+                for (std::size_t i = kernel::from_float(src, noise, dst, n);
+                        i < n; ++i) {
+                    float v = src[i] * traits::scale();
+                    if (noise != 0) v += noise[i];
+                    // same as minps and maxps even if v is NaN
+                    v = (v < traits::maximum()) ? v : traits::maximum();
+                    v = (v > traits::minimum()) ? v : traits::minimum();
+                    traits::store(static_cast<int32_t>(round(v)),
+                            dst + i * Byte);
+                }
+            }
+
+            private:
+                // round half to even like cvtps2dq
+                // The floats whose absolute value is 2^23 or more are
+                // integers already.
+                static float round(float v) {
+                    const float magic = 8388608.0f;
+                    if (v >= 0) return (v < magic) ? (v + magic) - magic : v;
+                    return (v > -magic) ? (v - magic) + magic : v;
+                }
+        };
+
+        /*
+         *  PCM samples -> normalized floats
+         *  bit_depth is one of 8, 16, 24 and 32. This returns false for the
+         *  others.
+         *  Usage:
+         *
+         *      std::vector<float> buffer(numof_samples * e.channels);
+         *      to_float(wav.data(), buffer.size(), e.bit_depth, &buffer[0]);
+         * */
+        inline bool
+        to_float(   const char* src, std::size_t numof_values,
+                    unsigned int bit_depth, float* dst) {
+            switch (bit_depth) {
+                case 8:     pcm_converter<1>::to_float(src, dst, numof_values);
+                            return true;
+                case 16:    pcm_converter<2>::to_float(src, dst, numof_values);
+                            return true;
+                case 24:    pcm_converter<3>::to_float(src, dst, numof_values);
+                            return true;
+                case 32:    pcm_converter<4>::to_float(src, dst, numof_values);
+                            return true;
+            }
+            DBGLOG("unsupported bit depth: " << bit_depth);
+            return false;
+        }
+
+        // normalized floats -> PCM samples
+        inline bool
+        from_float( const float* src, std::size_t numof_values,
+                    unsigned int bit_depth, char* dst,
+                    const float* noise = 0) {
+            switch (bit_depth) {
+                case 8:     pcm_converter<1>::from_float(
+                                    src, noise, dst, numof_values);
+                            return true;
+                case 16:    pcm_converter<2>::from_float(
+                                    src, noise, dst, numof_values);
+                            return true;
+                case 24:    pcm_converter<3>::from_float(
+                                    src, noise, dst, numof_values);
+                            return true;
+                case 32:    pcm_converter<4>::from_float(
+                                    src, noise, dst, numof_values);
+                            return true;
+            }
+            DBGLOG("unsupported bit depth: " << bit_depth);
+            return false;
+        }
+
+        // normalized floats -> PCM samples with TPDF dither
+        inline bool
+        from_float( const float* src, std::size_t numof_values,
+                    unsigned int bit_depth, char* dst, tpdf_dither& dither) {
+            const std::size_t block_size = 256;
+            float noise[block_size];
+            const unsigned int byte = bit_depth / 8;
+            while (numof_values > 0) {
+                const std::size_t n = (numof_values < block_size)
+                    ? numof_values : block_size;
+                dither.generate(noise, noise + n);
+                if (!from_float(src, n, bit_depth, dst, noise)) return false;
+                src += n;
+                dst += n * byte;
+                numof_values -= n;
+            }
+            return true;
+        }
+    }
+}
+
+#endif // PCMCONV_HPP
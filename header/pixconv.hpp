@@ -0,0 +1,399 @@
+/*
+ * pixconv.hpp
+ *  functions to convert rows of 24bit Windows Bitmap pixels into other
+ *  pixel formats
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ *
+ * formats
+ *  BGR24       bgr_type, the format of 24bit Windows Bitmap
+ *  RGBA32      rgba_type, the alpha is given
+ *  gray8       the luma of ITU-R BT.601: (77 R + 150 G + 29 B + 128) / 256
+ *  planar      3 planes of floats in [0, 1]: value / 255
+ *
+ *  The SIMD kernels give the same results as the scalar codes.
+ * */
+
+#ifndef PIXCONV_HPP
+#define PIXCONV_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+#include "bmp.hpp"
+#include "simd.hpp"
+
+namespace format {
+    namespace windows_bitmap {
+        // a pixel of 32bit RGBA
+#pragma pack(push, 1)
+        struct rgba_type {
+            uint8_t red;
+            uint8_t green;
+            uint8_t blue;
+            uint8_t alpha;
+        };
+#pragma pack(pop)
+
+        /*
+         *  SIMD kernels
+         *  They process the pixels as many as possible and return the number
+         *  of processed pixels. The rest is processed by scalar codes in
+         *  the functions below. Without SSSE3 they process nothing.
+         * */
+        struct pixel_kernel {
+#ifdef SIMD_SSSE3
+            static std::size_t
+            bgr_to_rgba(const char* src, char* dst, std::size_t n,
+                        uint8_t alpha) {
+                using namespace util::simd;
+                const __m128i mask = _mm_setr_epi8(
+                        2, 1, 0, -128, 5, 4, 3, -128,
+                        8, 7, 6, -128, 11, 10, 9, -128);
+                const __m128i a4 = _mm_set1_epi32(
+                        static_cast<int>(static_cast<uint32_t>(alpha) << 24));
+                std::size_t i = 0;
+#ifdef SIMD_AVX2
+                const __m256i mask8 = _mm256_broadcastsi128_si256(mask);
+                const __m256i a8 = _mm256_broadcastsi128_si256(a4);
+                // A load of 8 pixels reads 4 bytes beyond them.
+                for (; i + 10 <= n; i += 8) {
+                    __m256i v = _mm256_shuffle_epi8(load8(src + i * 3), mask8);
+                    store256(dst + i * 4, _mm256_or_si256(v, a8));
+                }
+#endif
+                for (; i + 16 <= n; i += 16) {
+                    __m128i v[4];
+                    load16(src + i * 3, v);
+                    for (unsigned int k = 0; k < 4; ++k) {
+                        store128(dst + i * 4 + k * 16, _mm_or_si128(
+                                    _mm_shuffle_epi8(v[k], mask), a4));
+                    }
+                }
+                return i;
+            }
+
+            static std::size_t
+            rgba_to_bgr(const char* src, char* dst, std::size_t n) {
+                using namespace util::simd;
+                const __m128i mask = _mm_setr_epi8(
+                        2, 1, 0, 6, 5, 4, 10, 9,
+                        8, 14, 13, 12, -128, -128, -128, -128);
+                std::size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    __m128i a = _mm_shuffle_epi8(load128(src + i * 4), mask);
+                    __m128i b = _mm_shuffle_epi8(
+                            load128(src + i * 4 + 16), mask);
+                    __m128i c = _mm_shuffle_epi8(
+                            load128(src + i * 4 + 32), mask);
+                    __m128i d = _mm_shuffle_epi8(
+                            load128(src + i * 4 + 48), mask);
+                    store128(dst + i * 3, _mm_or_si128(
+                                a, _mm_slli_si128(b, 12)));
+                    store128(dst + i * 3 + 16, _mm_or_si128(
+                                _mm_srli_si128(b, 4), _mm_slli_si128(c, 8)));
+                    store128(dst + i * 3 + 32, _mm_or_si128(
+                                _mm_srli_si128(c, 8), _mm_slli_si128(d, 4)));
+                }
+                return i;
+            }
+
+            static std::size_t
+            bgr_to_gray(const char* src, char* dst, std::size_t n) {
+                using namespace util::simd;
+                std::size_t i = 0;
+#ifdef SIMD_AVX2
+                const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+                // The last load reads 4 bytes beyond 32 pixels.
+                for (; i + 34 <= n; i += 32) {
+                    const char* p = src + i * 3;
+                    __m256i ab = _mm256_packs_epi32(
+                            luma8(load8(p)), luma8(load8(p + 24)));
+                    __m256i cd = _mm256_packs_epi32(
+                            luma8(load8(p + 48)), luma8(load8(p + 72)));
+                    store256(dst + i, _mm256_permutevar8x32_epi32(
+                                _mm256_packus_epi16(ab, cd), order));
+                }
+#endif
+                for (; i + 16 <= n; i += 16) {
+                    __m128i v[4];
+                    load16(src + i * 3, v);
+                    __m128i ab = _mm_packs_epi32(luma4(v[0]), luma4(v[1]));
+                    __m128i cd = _mm_packs_epi32(luma4(v[2]), luma4(v[3]));
+                    store128(dst + i, _mm_packus_epi16(ab, cd));
+                }
+                return i;
+            }
+
+            static std::size_t
+            bgr_to_planar(const char* src, float* red, float* green,
+                          float* blue, std::size_t n) {
+                using namespace util::simd;
+                std::size_t i = 0;
+                for (; i + 16 <= n; i += 16) {
+                    const __m128i a = load128(src + i * 3);
+                    const __m128i b = load128(src + i * 3 + 16);
+                    const __m128i c = load128(src + i * 3 + 32);
+                    const char z = -128;
+                    __m128i r = _mm_or_si128(_mm_or_si128(
+                        _mm_shuffle_epi8(a, _mm_setr_epi8(
+                                2, 5, 8, 11, 14, z, z, z,
+                                z, z, z, z, z, z, z, z)),
+                        _mm_shuffle_epi8(b, _mm_setr_epi8(
+                                z, z, z, z, z, 1, 4, 7,
+                                10, 13, z, z, z, z, z, z))),
+                        _mm_shuffle_epi8(c, _mm_setr_epi8(
+                                z, z, z, z, z, z, z, z,
+                                z, z, 0, 3, 6, 9, 12, 15)));
+                    __m128i g = _mm_or_si128(_mm_or_si128(
+                        _mm_shuffle_epi8(a, _mm_setr_epi8(
+                                1, 4, 7, 10, 13, z, z, z,
+                                z, z, z, z, z, z, z, z)),
+                        _mm_shuffle_epi8(b, _mm_setr_epi8(
+                                z, z, z, z, z, 0, 3, 6,
+                                9, 12, 15, z, z, z, z, z))),
+                        _mm_shuffle_epi8(c, _mm_setr_epi8(
+                                z, z, z, z, z, z, z, z,
+                                z, z, z, 2, 5, 8, 11, 14)));
+                    __m128i bl = _mm_or_si128(_mm_or_si128(
+                        _mm_shuffle_epi8(a, _mm_setr_epi8(
+                                0, 3, 6, 9, 12, 15, z, z,
+                                z, z, z, z, z, z, z, z)),
+                        _mm_shuffle_epi8(b, _mm_setr_epi8(
+                                z, z, z, z, z, z, 2, 5,
+                                8, 11, 14, z, z, z, z, z))),
+                        _mm_shuffle_epi8(c, _mm_setr_epi8(
+                                z, z, z, z, z, z, z, z,
+                                z, z, z, 1, 4, 7, 10, 13)));
+                    store16(red + i, r);
+                    store16(green + i, g);
+                    store16(blue + i, bl);
+                }
+                return i;
+            }
+
+            private:
+                // 16 pixels -> 4 vectors of 4 pixels in the lower 12 bytes
+                static void load16(const char* src, __m128i* v) {
+                    using namespace util::simd;
+                    const __m128i a = load128(src);
+                    const __m128i b = load128(src + 16);
+                    const __m128i c = load128(src + 32);
+                    v[0] = a;
+                    v[1] = _mm_alignr_epi8(b, a, 12);
+                    v[2] = _mm_alignr_epi8(c, b, 8);
+                    v[3] = _mm_srli_si128(c, 4);
+                }
+
+                // 4 pixels -> 4 lumas in 32 bits
+                static __m128i luma4(__m128i v) {
+                    const __m128i mask = _mm_setr_epi8(
+                            0, 1, 2, -128, 3, 4, 5, -128,
+                            6, 7, 8, -128, 9, 10, 11, -128);
+                    const __m128i weight = _mm_setr_epi16(
+                            29, 150, 77, 0, 29, 150, 77, 0);
+                    const __m128i zero = _mm_setzero_si128();
+                    v = _mm_shuffle_epi8(v, mask);
+                    __m128i lo = _mm_madd_epi16(
+                            _mm_unpacklo_epi8(v, zero), weight);
+                    __m128i hi = _mm_madd_epi16(
+                            _mm_unpackhi_epi8(v, zero), weight);
+                    return _mm_srli_epi32(_mm_add_epi32(
+                                _mm_hadd_epi32(lo, hi), _mm_set1_epi32(128)),
+                            8);
+                }
+
+                // 16 bytes -> 16 floats in [0, 1]
+                static void store16(float* dst, __m128i v) {
+                    const __m128 k = _mm_set1_ps(1.0f / 255.0f);
+#ifdef SIMD_AVX2
+                    const __m256 k8 = _mm256_set1_ps(1.0f / 255.0f);
+                    _mm256_storeu_ps(dst, _mm256_mul_ps(_mm256_cvtepi32_ps(
+                                    _mm256_cvtepu8_epi32(v)), k8));
+                    _mm256_storeu_ps(dst + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(
+                                    _mm256_cvtepu8_epi32(
+                                        _mm_srli_si128(v, 8))), k8));
+                    (void)k;
+#else
+                    const __m128i zero = _mm_setzero_si128();
+                    const __m128i lo = _mm_unpacklo_epi8(v, zero);
+                    const __m128i hi = _mm_unpackhi_epi8(v, zero);
+                    _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(
+                                    _mm_unpacklo_epi16(lo, zero)), k));
+                    _mm_storeu_ps(dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(
+                                    _mm_unpackhi_epi16(lo, zero)), k));
+                    _mm_storeu_ps(dst + 8, _mm_mul_ps(_mm_cvtepi32_ps(
+                                    _mm_unpacklo_epi16(hi, zero)), k));
+                    _mm_storeu_ps(dst + 12, _mm_mul_ps(_mm_cvtepi32_ps(
+                                    _mm_unpackhi_epi16(hi, zero)), k));
+#endif
+                }
+
+#ifdef SIMD_AVX2
+                // 8 pixels -> 4 pixels in the lower 12 bytes of each lane
+                // This reads 28 bytes.
+                static __m256i load8(const char* src) {
+                    using namespace util::simd;
+                    return _mm256_inserti128_si256(
+                            _mm256_castsi128_si256(load128(src)),
+                            load128(src + 12), 1);
+                }
+
+                // 8 pixels -> 8 lumas in 32 bits
+                static __m256i luma8(__m256i v) {
+                    const __m256i mask = _mm256_setr_epi8(
+                            0, 1, 2, -128, 3, 4, 5, -128,
+                            6, 7, 8, -128, 9, 10, 11, -128,
+                            0, 1, 2, -128, 3, 4, 5, -128,
+                            6, 7, 8, -128, 9, 10, 11, -128);
+                    const __m256i weight = _mm256_setr_epi16(
+                            29, 150, 77, 0, 29, 150, 77, 0,
+                            29, 150, 77, 0, 29, 150, 77, 0);
+                    const __m256i zero = _mm256_setzero_si256();
+                    v = _mm256_shuffle_epi8(v, mask);
+                    __m256i lo = _mm256_madd_epi16(
+                            _mm256_unpacklo_epi8(v, zero), weight);
+                    __m256i hi = _mm256_madd_epi16(
+                            _mm256_unpackhi_epi8(v, zero), weight);
+                    return _mm256_srli_epi32(_mm256_add_epi32(
+                                _mm256_hadd_epi32(lo, hi),
+                                _mm256_set1_epi32(128)), 8);
+                }
+#endif
+#else
+            static std::size_t
+            bgr_to_rgba(const char*, char*, std::size_t, uint8_t) {
+                return 0;
+            }
+            static std::size_t
+            rgba_to_bgr(const char*, char*, std::size_t) { return 0; }
+            static std::size_t
+            bgr_to_gray(const char*, char*, std::size_t) { return 0; }
+            static std::size_t
+            bgr_to_planar(const char*, float*, float*, float*, std::size_t) {
+                return 0;
+            }
+#endif // SIMD_SSSE3
+        };
+
+        // BGR24 -> RGBA32
+        inline void
+        bgr_to_rgba(const bgr_type* src, std::size_t numof_pixels,
+                    rgba_type* dst, uint8_t alpha = 0xff) {
+            std::size_t i = pixel_kernel::bgr_to_rgba(
+                    util::cast::constpointer_cast<const char*>(src),
+                    util::cast::pointer_cast<char*>(dst), numof_pixels, alpha);
+            for (; i < numof_pixels; ++i) {
+                dst[i].red = src[i].red;
+                dst[i].green = src[i].green;
+                dst[i].blue = src[i].blue;
+                dst[i].alpha = alpha;
+            }
+        }
+
+        // RGBA32 -> BGR24, the alpha is dropped
+        inline void
+        rgba_to_bgr(const rgba_type* src, std::size_t numof_pixels,
+                    bgr_type* dst) {
+            std::size_t i = pixel_kernel::rgba_to_bgr(
+                    util::cast::constpointer_cast<const char*>(src),
+                    util::cast::pointer_cast<char*>(dst), numof_pixels);
+            for (; i < numof_pixels; ++i) {
+                dst[i].blue = src[i].blue;
+                dst[i].green = src[i].green;
+                dst[i].red = src[i].red;
+            }
+        }
+
+        // BGR24 -> gray8
+        inline void
+        bgr_to_gray(const bgr_type* src, std::size_t numof_pixels,
+                    uint8_t* dst) {
+            std::size_t i = pixel_kernel::bgr_to_gray(
+                    util::cast::constpointer_cast<const char*>(src),
+                    util::cast::pointer_cast<char*>(dst), numof_pixels);
+            for (; i < numof_pixels; ++i) {
+                dst[i] = static_cast<uint8_t>(
+                        (77 * src[i].red + 150 * src[i].green
+                         + 29 * src[i].blue + 128) >> 8);
+            }
+        }
+
+        // BGR24 -> planar floats
+        inline void
+        bgr_to_planar(  const bgr_type* src, std::size_t numof_pixels,
+                        float* red, float* green, float* blue) {
+            std::size_t i = pixel_kernel::bgr_to_planar(
+                    util::cast::constpointer_cast<const char*>(src),
+                    red, green, blue, numof_pixels);
+            const float k = 1.0f / 255.0f;
+            for (; i < numof_pixels; ++i) {
+                red[i] = src[i].red * k;
+                green[i] = src[i].green * k;
+                blue[i] = src[i].blue * k;
+            }
+        }
+
+        /*
+         *  rows [first_row, last_row) of an image -> a packed buffer
+         *  The rows are numbered from the top (see image_view), and
+         *  the results of each row are stored contiguously, so dst (each
+         *  plane for to_planar) must have room for
+         *  width * (last_row - first_row) pixels.
+         *  Usage:
+         *
+         *      std::vector<uint8_t> gray(image.width() * image.height());
+         *      to_gray(image, &gray[0]);
+         *
+         *  Converting the ranges of rows on some threads is safe.
+         * */
+        inline void
+        to_rgba(const image_view& image, uint32_t first_row,
+                uint32_t last_row, rgba_type* dst, uint8_t alpha = 0xff) {
+            assert(first_row <= last_row && last_row <= image.height());
+            const uint32_t w = image.width();
+            for (uint32_t y = first_row; y < last_row; ++y, dst += w) {
+                bgr_to_rgba(image.row(y), w, dst, alpha);
+            }
+        }
+        inline void
+        to_rgba(const image_view& image, rgba_type* dst,
+                uint8_t alpha = 0xff) {
+            to_rgba(image, 0, image.height(), dst, alpha);
+        }
+
+        inline void
+        to_gray(const image_view& image, uint32_t first_row,
+                uint32_t last_row, uint8_t* dst) {
+            assert(first_row <= last_row && last_row <= image.height());
+            const uint32_t w = image.width();
+            for (uint32_t y = first_row; y < last_row; ++y, dst += w) {
+                bgr_to_gray(image.row(y), w, dst);
+            }
+        }
+        inline void to_gray(const image_view& image, uint8_t* dst) {
+            to_gray(image, 0, image.height(), dst);
+        }
+
+        inline void
+        to_planar(  const image_view& image, uint32_t first_row,
+                    uint32_t last_row,
+                    float* red, float* green, float* blue) {
+            assert(first_row <= last_row && last_row <= image.height());
+            const uint32_t w = image.width();
+            for (uint32_t y = first_row; y < last_row;
+                    ++y, red += w, green += w, blue += w) {
+                bgr_to_planar(image.row(y), w, red, green, blue);
+            }
+        }
+        inline void
+        to_planar(  const image_view& image,
+                    float* red, float* green, float* blue) {
+            to_planar(image, 0, image.height(), red, green, blue);
+        }
+    }
+}
+
+#endif // PIXCONV_HPP
@@ -0,0 +1,300 @@
+/*
+ * rawfile.hpp
+ *  classes to read / write files at specified positions without streams
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ *
+ *  DIRECT mode bypasses the page cache of the OS (O_DIRECT or
+ *  FILE_FLAG_NO_BUFFERING). Then the positions, the sizes and the addresses
+ *  of buffers must be multiples of raw_file::direct_alignment, so use
+ *  aligned_buffer. DIRECT is ignored where O_DIRECT isn't defined.
+ * */
+
+#ifndef RAWFILE_HPP
+#define RAWFILE_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#   ifndef NOMINMAX
+#       define NOMINMAX     // keep std::min(2) and std::max(2) usable
+#   endif
+#   include <malloc.h>      // for _aligned_malloc(2)
+#   include <windows.h>     // for CreateFile(7), ReadFile(5), WriteFile(5)
+#else
+#   include <cerrno>
+#   include <fcntl.h>       // for open(3), O_DIRECT
+#   include <sys/stat.h>    // for fstat(2)
+#   include <unistd.h>      // for pread(4), pwrite(4), ftruncate(2)
+#endif
+
+#include "dlogger.hpp"
+
+namespace util {
+    namespace file {
+        /*
+         *  A buffer that is aligned to the boundary.
+         *  This object is not copyable.
+         * */
+        class aligned_buffer {
+            private:
+                char* head;
+                std::size_t length;
+
+            public:
+                // constructor
+                aligned_buffer(std::size_t size, std::size_t alignment)
+                    : head(0), length(size) {
+#ifdef _MSC_VER
+                    head = static_cast<char*>(_aligned_malloc(size, alignment));
+#else
+                    void* p;
+                    if (posix_memalign(&p, alignment, size) == 0) {
+                        head = static_cast<char*>(p);
+                    }
+#endif
+                    if (head == 0) length = 0;
+                }
+
+                // destructor
+                ~aligned_buffer(void) {
+#ifdef _MSC_VER
+                    _aligned_free(head);
+#else
+                    std::free(head);
+#endif
+                }
+
+                // getters
+                char* data(void) { return head; }
+                const char* data(void) const { return head; }
+                std::size_t size(void) const { return length; }
+
+            private:
+                // not copyable
+                aligned_buffer(const aligned_buffer&);
+                aligned_buffer& operator=(const aligned_buffer&);
+        };
+
+        /*
+         *  A file that is read / written at specified positions.
+         *  Usage:
+         *
+         *      util::file::raw_file file("foo.bin", raw_file::READ);
+         *      char buffer[16];
+         *      if (!file.read(0, buffer, sizeof(buffer))) return 1;
+         *
+         *  read(3) and write(3) transfer all bytes or fail. This object is
+         *  not copyable.
+         * */
+        class raw_file {
+            public:
+                // modes to open, combine them by operator|
+                enum mode_type {
+                    READ    = 1,
+                    // to create, and to truncate if exists
+                    WRITE   = 2,
+                    DIRECT  = 4
+                };
+
+                static const std::size_t direct_alignment = 4096;
+
+#ifdef _MSC_VER
+                typedef HANDLE  native_handle_type;
+#else
+                typedef int     native_handle_type;
+#endif
+
+            private:
+#ifdef _MSC_VER
+                HANDLE handle;
+#else
+                int fd;
+#endif
+
+            public:
+                // constructor
+                raw_file(void) { reset(); }
+                raw_file(const char* path, int mode) {
+                    reset();
+                    open(path, mode);
+                }
+
+                // destructor
+                ~raw_file(void) { close(); }
+
+                // open and close
+                bool open(const char* path, int mode) {
+                    close();
+
+#ifdef _MSC_VER
+                    DWORD access = 0;
+                    if (mode & READ) access |= GENERIC_READ;
+                    if (mode & WRITE) access |= GENERIC_WRITE;
+                    handle = CreateFileA(path, access, FILE_SHARE_READ, NULL,
+                            (mode & WRITE) ? CREATE_ALWAYS : OPEN_EXISTING,
+                            (mode & DIRECT) ? FILE_FLAG_NO_BUFFERING
+                                            : FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+#else
+                    int flags = ((mode & READ) && (mode & WRITE)) ? O_RDWR
+                              : (mode & WRITE)                    ? O_WRONLY
+                              :                                     O_RDONLY;
+                    if (mode & WRITE) flags |= O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+                    if (mode & DIRECT) flags |= O_DIRECT;
+#endif
+                    fd = ::open(path, flags, 0666);
+#endif
+
+                    if (!is_open()) {
+                        DBGLOG("Can't open the file: " << path);
+                        return false;
+                    }
+                    return true;
+                }
+
+                void close(void) {
+                    if (!is_open()) return;
+#ifdef _MSC_VER
+                    CloseHandle(handle);
+#else
+                    ::close(fd);
+#endif
+                    reset();
+                }
+
+                bool is_open(void) const {
+#ifdef _MSC_VER
+                    return handle != INVALID_HANDLE_VALUE;
+#else
+                    return fd >= 0;
+#endif
+                }
+
+                // the handle or the descriptor for the APIs of the OS
+                native_handle_type native_handle(void) const {
+#ifdef _MSC_VER
+                    return handle;
+#else
+                    return fd;
+#endif
+                }
+
+                // I/O
+                bool read(uint64_t offset, char* dst, std::size_t n) {
+                    while (n > 0) {
+#ifdef _MSC_VER
+                        OVERLAPPED position = overlapped(offset);
+                        DWORD done;
+                        if (!ReadFile(handle, dst, chunk(n), &done, &position)
+                                || done == 0) {
+                            DBGLOG("Can't read the file at " << offset);
+                            return false;
+                        }
+#else
+                        ssize_t done = pread(fd, dst, n,
+                                static_cast<off_t>(offset));
+                        if (done < 0 && errno == EINTR) continue;
+                        if (done <= 0) {
+                            DBGLOG("Can't read the file at " << offset);
+                            return false;
+                        }
+#endif
+                        dst += done;
+                        offset += done;
+                        n -= done;
+                    }
+                    return true;
+                }
+
+                bool write(uint64_t offset, const char* src, std::size_t n) {
+                    while (n > 0) {
+#ifdef _MSC_VER
+                        OVERLAPPED position = overlapped(offset);
+                        DWORD done;
+                        if (!WriteFile(handle, src, chunk(n), &done, &position)
+                                || done == 0) {
+                            DBGLOG("Can't write the file at " << offset);
+                            return false;
+                        }
+#else
+                        ssize_t done = pwrite(fd, src, n,
+                                static_cast<off_t>(offset));
+                        if (done < 0 && errno == EINTR) continue;
+                        if (done <= 0) {
+                            DBGLOG("Can't write the file at " << offset);
+                            return false;
+                        }
+#endif
+                        src += done;
+                        offset += done;
+                        n -= done;
+                    }
+                    return true;
+                }
+
+                // change the size of the file
+                bool truncate(uint64_t size) {
+#ifdef _MSC_VER
+                    LARGE_INTEGER position;
+                    position.QuadPart = static_cast<LONGLONG>(size);
+                    if (!SetFilePointerEx(handle, position, NULL, FILE_BEGIN)
+                            || !SetEndOfFile(handle)) {
+#else
+                    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+#endif
+                        DBGLOG("Can't change the size of the file: " << size);
+                        return false;
+                    }
+                    return true;
+                }
+
+                // the size of the file
+                uint64_t size(void) const {
+#ifdef _MSC_VER
+                    LARGE_INTEGER file_size;
+                    if (!GetFileSizeEx(handle, &file_size)) return 0;
+                    return static_cast<uint64_t>(file_size.QuadPart);
+#else
+                    struct stat st;
+                    if (fstat(fd, &st) != 0) return 0;
+                    return static_cast<uint64_t>(st.st_size);
+#endif
+                }
+
+            private:
+                void reset(void) {
+#ifdef _MSC_VER
+                    handle = INVALID_HANDLE_VALUE;
+#else
+                    fd = -1;
+#endif
+                }
+
+#ifdef _MSC_VER
+                static OVERLAPPED overlapped(uint64_t offset) {
+                    OVERLAPPED o = OVERLAPPED();
+                    o.Offset = static_cast<DWORD>(offset);
+                    o.OffsetHigh = static_cast<DWORD>(offset >> 32);
+                    return o;
+                }
+
+                // ReadFile(5) and WriteFile(5) take 32 bits sizes
+                static DWORD chunk(std::size_t n) {
+                    const std::size_t limit = 0x40000000;
+                    return static_cast<DWORD>(n < limit ? n : limit);
+                }
+#endif
+
+                // not copyable
+                raw_file(const raw_file&);
+                raw_file& operator=(const raw_file&);
+        };
+    }
+}
+
+#endif // RAWFILE_HPP
@@ -0,0 +1,283 @@
+/*
+ * resample.hpp
+ *  a streaming polyphase sample-rate converter for planar float samples
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ *
+ * method
+ *  The ratio of the rates is reduced to L / M (44100 -> 48000 is 160 / 147).
+ *  The input is upsampled by L, filtered by a Kaiser-windowed sinc lowpass
+ *  and downsampled by M. Only the taps that meet the non-zero samples are
+ *  evaluated: the filter is split into L phases of "taps" coefficients and
+ *  each output sample is a dot product of a phase and the recent input.
+ *  The table has L * taps coefficients, so the rates that have a large L
+ *  (e.g. 44100 -> 44101) take much memory.
+ * */
+
+#ifndef RESAMPLE_HPP
+#define RESAMPLE_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include "dlogger.hpp"
+#include "gcd.hpp"
+#include "simd.hpp"
+
+namespace format {
+    namespace riff_wav {
+        // the dot product of 2 vectors of floats
+        inline float dot_product(const float* a, const float* b,
+                                 std::size_t n) {
+            std::size_t i = 0;
+            float sum = 0;
+#if defined(SIMD_AVX2)
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            for (; i + 16 <= n; i += 16) {
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(
+                            _mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(
+                            _mm256_loadu_ps(a + i + 8),
+                            _mm256_loadu_ps(b + i + 8)));
+            }
+            acc0 = _mm256_add_ps(acc0, acc1);
+            __m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc0),
+                                    _mm256_extractf128_ps(acc0, 1));
+#elif defined(SIMD_SSE2)
+            __m128 acc = _mm_setzero_ps();
+#endif
+#ifdef SIMD_SSE2
+            for (; i + 4 <= n; i += 4) {
+                acc = _mm_add_ps(acc, _mm_mul_ps(
+                            _mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            }
+            acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+            acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+            sum = _mm_cvtss_f32(acc);
+#endif
+            for (; i < n; ++i) sum += a[i] * b[i];
+            return sum;
+        }
+
+        /*
+         *  A streaming sample-rate converter for planar float samples.
+         *  Usage:
+         *
+         *      resampler r(44100, 48000, 2);
+         *      std::vector<float> out[2];  // resize(1) to r.max_output(n)
+         *      float* planes[] = { &out[0][0], &out[1][0] };
+         *      while (...) {
+         *          std::size_t m = r.process(input, n, planes);
+         *          ...
+         *      }
+         *      std::size_t m = r.flush(planes);    // the rest
+         *
+         *  process(3) consumes all input samples and returns the number of
+         *  output samples, that is at most max_output(1). The delay of the
+         *  filter is compensated: the first output sample is at the time of
+         *  the first input sample, and the total number of output samples
+         *  is ceil(numof_input * output_rate / input_rate) after flush(1).
+         *
+         *  quality trades the quality for the speed:
+         *      FAST    16 taps per phase, 0.85 Nyquist, about 60 dB stopband
+         *      MEDIUM  32 taps, 0.91 Nyquist, about 80 dB stopband
+         *              (default)
+         *      BEST    64 taps, 0.95 Nyquist, about 100 dB stopband
+         * */
+        class resampler {
+            public:
+                enum quality_type {
+                    FAST,
+                    MEDIUM,
+                    BEST
+                };
+
+            private:
+                uint32_t input_rate;
+                uint32_t output_rate;
+                unsigned int channels;
+                // the ratio L / M
+                uint32_t up, down;
+                std::size_t taps;
+                // up phases of taps coefficients in reverse order
+                std::vector<float> table;
+                // the input of each channel, starts with the history
+                std::vector< std::vector<float> > buffers;
+                // the position of the next output sample: the newest input
+                // in buffers and the phase
+                std::size_t index;
+                uint32_t phase;
+                // to make the total number of outputs exact
+                uint64_t numof_input;
+                uint64_t numof_output;
+
+            public:
+                // constructor
+                resampler(  uint32_t input_rate, uint32_t output_rate,
+                            unsigned int channels,
+                            quality_type quality = MEDIUM)
+                    : input_rate(input_rate), output_rate(output_rate),
+                      channels(channels), buffers(channels) {
+                    assert(input_rate > 0 && output_rate > 0);
+                    const uint32_t g = util::math::calc_gcd(
+                            input_rate, output_rate);
+                    up = output_rate / g;
+                    down = input_rate / g;
+
+                    double rolloff, beta;
+                    switch (quality) {
+                        case FAST:  taps = 16; rolloff = 0.85; beta = 6.0;
+                                    break;
+                        case BEST:  taps = 64; rolloff = 0.95; beta = 10.0;
+                                    break;
+                        default:    taps = 32; rolloff = 0.91; beta = 8.0;
+                                    break;
+                    }
+                    make_table(rolloff, beta);
+                    reset();
+                }
+
+                // This discards all inputs and restarts.
+                void reset(void) {
+                    // a half of taps of silence before the first input
+                    for (unsigned int ch = 0; ch < channels; ++ch) {
+                        buffers[ch].assign(taps / 2, 0);
+                    }
+                    // the first output is centered at the first input
+                    index = taps - 1;
+                    phase = up - 1;
+                    numof_input = 0;
+                    numof_output = 0;
+                }
+
+                // the number of output samples for numof_samples input
+                // samples at most
+                std::size_t max_output(std::size_t numof_samples) const {
+                    return static_cast<std::size_t>(
+                            (static_cast<uint64_t>(numof_samples + taps)
+                                * up) / down + 1);
+                }
+
+                // This consumes input[ch][0, numof_samples) and writes
+                // output samples to output[ch].
+                std::size_t process(const float* const* input,
+                                    std::size_t numof_samples,
+                                    float* const* output) {
+                    for (unsigned int ch = 0; ch < channels; ++ch) {
+                        buffers[ch].insert(buffers[ch].end(),
+                                input[ch], input[ch] + numof_samples);
+                    }
+                    numof_input += numof_samples;
+                    return produce(output, expected_output());
+                }
+
+                // This writes the rest of output samples that are delayed
+                // by the filter. Call reset(0) to reuse this object.
+                std::size_t flush(float* const* output) {
+                    for (unsigned int ch = 0; ch < channels; ++ch) {
+                        buffers[ch].insert(buffers[ch].end(), taps, 0);
+                    }
+                    return produce(output, expected_output());
+                }
+
+                // getters
+                uint32_t input_sampling_rate(void) const { return input_rate; }
+                uint32_t output_sampling_rate(void) const {
+                    return output_rate;
+                }
+                std::size_t numof_taps(void) const { return taps; }
+                // the number of input samples that are needed after the
+                // time of an output sample
+                std::size_t latency(void) const { return taps / 2; }
+
+            private:
+                // ceil(numof_input * up / down)
+                uint64_t expected_output(void) const {
+                    return (numof_input * up + down - 1) / down;
+                }
+
+                std::size_t produce(float* const* output, uint64_t limit) {
+                    if (channels == 0) return 0;
+                    const std::size_t available = buffers[0].size();
+                    std::size_t produced = 0;
+                    while (index < available && numof_output < limit) {
+                        const float* coefficients = &table[phase * taps];
+                        const std::size_t first = index + 1 - taps;
+                        for (unsigned int ch = 0; ch < channels; ++ch) {
+                            output[ch][produced] = dot_product(
+                                    coefficients, &buffers[ch][first], taps);
+                        }
+                        ++produced;
+                        ++numof_output;
+
+                        phase += down;
+                        index += phase / up;
+                        phase %= up;
+                    }
+
+                    // keep the history that the next output needs
+                    const std::size_t consumed = std::min(
+                            index + 1 - taps, available);
+                    for (unsigned int ch = 0; ch < channels; ++ch) {
+                        buffers[ch].erase(buffers[ch].begin(),
+                                buffers[ch].begin() + consumed);
+                    }
+                    index -= consumed;
+                    return produced;
+                }
+
+                // the zeroth order modified Bessel function of the first
+                // kind
+                static double bessel_i0(double x) {
+                    double sum = 1, term = 1;
+                    for (unsigned int k = 1; k < 50; ++k) {
+                        term *= (x / (2 * k)) * (x / (2 * k));
+                        sum += term;
+                        if (term < sum * 1e-12) break;
+                    }
+                    return sum;
+                }
+
+                void make_table(double rolloff, double beta) {
+                    const double pi = 3.14159265358979323846;
+                    // The filter has length - 1 taps in fact, then the
+                    // center is on a sample of the upsampled input.
+                    const std::size_t length = taps * up;
+                    const double center = (length - 2) / 2.0;
+                    // the cutoff in cycles per upsampled sample
+                    const double cutoff =
+                        0.5 * rolloff / (up > down ? up : down);
+                    const double normalizer = bessel_i0(beta);
+
+                    table.resize(length);
+                    for (std::size_t m = 0; m < length; ++m) {
+                        const double t = m - center;
+                        const double x = 2 * cutoff * t;
+                        const double sinc = (t == 0)
+                            ? 1 : std::sin(pi * x) / (pi * x);
+                        const double r = t / (center + 1);
+                        const double window = (r * r < 1)
+                            ? bessel_i0(beta * std::sqrt(1 - r * r))
+                                / normalizer
+                            : 0;
+                        // gain up for the zeros stuffed by upsampling
+                        const double h = 2 * cutoff * sinc * window * up;
+
+                        // phase p has h[k * up + p] at taps - 1 - k
+                        const std::size_t p = m % up;
+                        const std::size_t k = m / up;
+                        table[p * taps + (taps - 1 - k)] =
+                            static_cast<float>(h);
+                    }
+                }
+        };
+    }
+}
+
+#endif // RESAMPLE_HPP
@@ -0,0 +1,99 @@
+/*
+ * simd.hpp
+ *  macros to detect SIMD instruction sets that are available at compile time
+ *
+ *  The macros SIMD_SSE2, SIMD_SSSE3 and SIMD_AVX2 are defined when the
+ *  compiler targets these instruction sets, and the headers of intrinsics
+ *  are included.
+ *
+ *      > g++ -Wall --pedantic -O2 -mavx2 main.cpp
+ *      > cl /EHsc /W4 /O2 /arch:AVX2 main.cpp
+ *
+ *  In order to disable all of them and use scalar codes only, define the
+ *  symbol NO_SIMD:
+ *
+ *      > g++ -Wall --pedantic -DNO_SIMD main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#ifndef NO_SIMD
+
+// SSE2 is always available on x64
+#if     defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define SIMD_SSE2
+#   include <emmintrin.h>
+#endif
+
+// Visual C++ has no macro for SSSE3, it's implied by AVX
+#if defined(__SSSE3__) || (defined(_MSC_VER) && defined(__AVX__))
+#   define SIMD_SSSE3
+#   include <tmmintrin.h>
+#endif
+
+#ifdef __AVX2__
+#   define SIMD_AVX2
+#   include <immintrin.h>
+#endif
+
+#endif // NO_SIMD
+
+#ifdef SIMD_SSE2
+#ifdef _MSC_VER
+#   include <intrin.h>      // for _BitScanForward(2)
+#endif
+
+#include "cast.hpp"
+
+namespace util {
+    namespace simd {
+        // the index of the lowest set bit of a mask from movemask, that
+        // must not be 0
+        inline unsigned int lowest_bit(unsigned int mask) {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return index;
+#else
+            return __builtin_ctz(mask);
+#endif
+        }
+
+        // the number of set bits
+        inline unsigned int count_bits(unsigned int mask) {
+#ifdef _MSC_VER
+            mask = mask - ((mask >> 1) & 0x55555555);
+            mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+            return (((mask + (mask >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+#else
+            return __builtin_popcount(mask);
+#endif
+        }
+
+        // unaligned loads and stores
+        inline __m128i load128(const void* p) {
+            return _mm_loadu_si128(
+                    util::cast::constpointer_cast<const __m128i*>(p));
+        }
+        inline void store128(void* p, __m128i v) {
+            _mm_storeu_si128(util::cast::pointer_cast<__m128i*>(p), v);
+        }
+#ifdef SIMD_AVX2
+        inline __m256i load256(const void* p) {
+            return _mm256_loadu_si256(
+                    util::cast::constpointer_cast<const __m256i*>(p));
+        }
+        inline void store256(void* p, __m256i v) {
+            _mm256_storeu_si256(util::cast::pointer_cast<__m256i*>(p), v);
+        }
+#endif
+    }
+}
+#endif // SIMD_SSE2
+
+#endif // SIMD_HPP
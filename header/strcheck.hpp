@@ -2,6 +2,16 @@
  * strcheck.hpp
  *  The class to check if strings are integer, decimal, or real number
  *
+ *  classify() finds all of the properties in a pass, and is_integer(),
+ *  is_decimal() and is_real() are the shorthands of it. The runs of digits
+ *  are scanned with SSE2 or AVX2 when the digits of the locale are '0' to
+ *  '9' in char, see string.hpp.
+ *
+ *      util::string::check checker;
+ *      util::string::check::numeral_type numeral =
+ *          checker.classify("-1.5e3");
+ *      // numeral.negative and numeral.exponent are true
+ *
  *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
  *  see LICENSE for redistributing, modifying, and so on.
  * */
@@ -9,10 +19,14 @@
 #ifndef STRCHECK_HPP
 #define STRCHECK_HPP
 
+#include <cstddef>
 #include <cstring>
+#include <limits>
 #include <locale>
 #include <string>
 
+#include "string.hpp"
+
 namespace util {
     namespace string {
         template<typename Char, typename CharTraits = std::char_traits<Char> >
@@ -23,36 +37,146 @@ namespace util {
                 typedef std::ctype<char_type>           ctype_type;
                 typedef std::numpunct<char_type>        numpunct_type;
 
+                /*
+                 *  The properties of a string. The forms are exclusive:
+                 *
+                 *      integer     [sign] digits
+                 *      decimal     [sign] digits point [digits]
+                 *      exponent    (integer or decimal) (e|E) [sign] digits
+                 *
+                 *  and none of them is true for the other strings, including
+                 *  an empty one.
+                 * */
+                struct numeral_type {
+                    bool sign;          // begins with a sign
+                    bool negative;      // begins with the negative sign
+                    bool integer;
+                    bool decimal;
+                    bool exponent;
+                    // an integer may not fit in long
+                    bool overflow;
+                    // the number of digits of the integer part without
+                    // leading zeros, and the one of the fraction part
+                    std::size_t integer_digits;
+                    std::size_t fraction_digits;
+                };
+
             private:
                 std::locale loc;
+                const ctype_type* facet;
+                char_type point;
+                char_type plus;
+                char_type minus;
+                char_type zero;
+                char_type nine;
+                char_type lower_e;
+                char_type upper_e;
+                bool ascii_digits;
 
             public:
                 // constructor
-                explicit basic_check(void) : loc(std::locale()) {}
-                explicit basic_check(const std::locale& loc) : loc(loc) {}
+                explicit basic_check(void) : loc(std::locale()) { init(); }
+                explicit basic_check(const std::locale& loc) : loc(loc) {
+                    init();
+                }
 
             private:
-                const ctype_type& ctype(void) const {
-                    static const ctype_type& ctype =
-                        std::use_facet<ctype_type>(loc);
-                    return ctype;
+                void init(void) {
+                    facet = &std::use_facet<ctype_type>(loc);
+                    point = std::use_facet<numpunct_type>(loc).decimal_point();
+                    plus = facet->widen('+');
+                    minus = facet->widen('-');
+                    zero = facet->widen('0');
+                    nine = facet->widen('9');
+                    lower_e = facet->widen('e');
+                    upper_e = facet->widen('E');
+                    ascii_digits = are_ascii_digits();
                 }
 
-                char_type decimal_point(void) const {
-                    static const char_type decimal_point =
-                        std::use_facet<numpunct_type>(loc).decimal_point();
-                    return decimal_point;
+                // whether the digits are just [zero, nine], that is checked
+                // for char only
+                bool are_ascii_digits(void) const {
+                    if (sizeof(char_type) != 1) return false;
+                    for (int i = 0; i < 256; ++i) {
+                        const char_type c = static_cast<char_type>(i);
+                        const bool in_range = !(c < zero || nine < c);
+                        if (facet->is(ctype_type::digit, c) != in_range) {
+                            return false;
+                        }
+                    }
+                    return true;
                 }
 
-                char_type positive_sign(void) const {
-                    return ctype().widen('+');
+                const char_type*
+                skip_digits(const char_type* first,
+                            const char_type* last) const {
+                    if (ascii_digits) {
+                        return util::string::find_first_not_in(
+                                first, last, zero, nine);
+                    }
+                    return facet->scan_not(ctype_type::digit, first, last);
                 }
 
-                char_type negative_sign(void) const {
-                    return ctype().widen('-');
+                const char_type*
+                skip_sign(  const char_type* first,
+                            const char_type* last) const {
+                    return (first != last
+                            && (*first == plus || *first == minus))
+                        ? first + 1 : first;
                 }
 
             public:
+                numeral_type classify(  const char_type* const first,
+                                        const char_type* const last) const {
+                    numeral_type numeral = numeral_type();
+
+                    const char_type* const integer = skip_sign(first, last);
+                    numeral.sign = (integer != first);
+                    numeral.negative = numeral.sign && *first == minus;
+
+                    const char_type* p = skip_digits(integer, last);
+                    if (p == integer) return numeral;
+                    const char_type* significant = integer;
+                    while (significant != p && *significant == zero) {
+                        ++significant;
+                    }
+                    numeral.integer_digits = p - significant;
+                    if (p == last) {
+                        numeral.integer = true;
+                        numeral.overflow = numeral.integer_digits
+                            > static_cast<std::size_t>(
+                                    std::numeric_limits<long>::digits10);
+                        return numeral;
+                    }
+
+                    if (*p == point) {
+                        const char_type* const fraction = p + 1;
+                        p = skip_digits(fraction, last);
+                        numeral.fraction_digits = p - fraction;
+                        if (p == last) {
+                            numeral.decimal = true;
+                            return numeral;
+                        }
+                    }
+
+                    if (*p == lower_e || *p == upper_e) {
+                        const char_type* const exponent =
+                            skip_sign(p + 1, last);
+                        p = skip_digits(exponent, last);
+                        numeral.exponent = (p != exponent && p == last);
+                    }
+                    return numeral;
+                }
+
+                numeral_type classify(const char_type* const str) const {
+                    return classify(str, str + CharTraits::length(str));
+                }
+
+                numeral_type classify(const string_type& str) const {
+                    const char_type* const first = str.data();
+                    return classify(first, first + str.size());
+                }
+
                 bool is_positive(const char_type* const str) const {
                     return !is_negative(str);
                 }
@@ -62,7 +186,7 @@ namespace util {
                 }
 
                 bool is_negative(const char_type* const str) const {
-                    return str[0] == negative_sign();
+                    return str[0] == minus;
                 }
 
                 bool is_negative(const string_type& str) const {
@@ -70,48 +194,29 @@ namespace util {
                 }
 
                 bool is_integer(const char_type* const str) const {
-                    const char_type* const first =
-                        (  (str[0] == positive_sign())
-                         | (str[0] == negative_sign())) ? str + 1 : str;
-                    const char_type* const last =
-                        first + CharTraits::length(first);
-                    const char_type* const found =
-                        ctype().scan_not(ctype_type::digit, first, last);
-
-                    return found == last;
+                    return classify(str).integer;
                 }
 
                 bool is_integer(const string_type& str) const {
-                    return is_integer(str.c_str());
+                    return classify(str).integer;
                 }
 
                 bool is_decimal(const char_type* const str) const {
-                    const char_type* const first =
-                        (  (str[0] == positive_sign())
-                         | (str[0] == negative_sign())) ? str + 1 : str;
-
-                    const char_type* const point =
-                        CharTraits::find(   first,
-                                            CharTraits::length(first),
-                                            decimal_point());
-
-                    if (point == 0 || point == first) return false;
-
-                    const char_type* integer =
-                        ctype().scan_not(ctype_type::digit, first, point);
-                    return ((integer == point) & is_integer(point + 1));
+                    return classify(str).decimal;
                 }
 
                 bool is_decimal(const string_type& str) const {
-                    return is_decimal(str.c_str());
+                    return classify(str).decimal;
                 }
 
                 bool is_real(const char_type* const str) const {
-                    return (is_integer(str) | is_decimal(str));
+                    const numeral_type numeral = classify(str);
+                    return numeral.integer | numeral.decimal;
                 }
 
                 bool is_real(const string_type& str) const {
-                    return is_real(str.c_str());
+                    const numeral_type numeral = classify(str);
+                    return numeral.integer | numeral.decimal;
                 }
         };
 
@@ -121,4 +226,3 @@ namespace util {
 }
 
 #endif // STRCHECK_HPP
-
@@ -0,0 +1,302 @@
+/*
+ * strinfer.hpp
+ *  The class to infer the type of a column of strings
+ *
+ *  This uses thread.hpp, so link the thread library with GCC:
+ *
+ *      > g++ -Wall --pedantic -pthread main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#ifndef STRINFER_HPP
+#define STRINFER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <locale>
+#include <string>
+#include <vector>
+
+#include "strcheck.hpp"
+#include "string.hpp"
+#include "thread.hpp"
+
+namespace util {
+    namespace string {
+        /*
+         *  A class to classify many strings by basic_check at once.
+         *  Usage:
+         *
+         *      std::vector<std::string> fields;
+         *      std::vector<unsigned char> bits;
+         *      util::string::inferrer infer;
+         *      switch (infer.infer(fields.begin(), fields.end(), bits)) {
+         *          case util::string::inferrer::LONG_COLUMN: ...
+         *      }
+         *
+         *  infer(3) classifies the strings of a random access range, that
+         *  are convertible to basic_string_ref, and infer(4) classifies the
+         *  fields of a buffer that are separated by delimiter. A delimiter
+         *  at the end of the buffer doesn't begin an empty field, and a CR
+         *  before the delimiter LF is dropped, so lines can be classified
+         *  as they are.
+         *
+         *  bits[i] is the bits of the i-th string, and the return value is
+         *  the narrowest type that all of the strings can be converted to
+         *  except empty ones: long, double or a string. EMPTY_COLUMN means
+         *  that all of them are empty or there is nothing.
+         *
+         *  The range is split into chunks of block_elements strings or
+         *  block_bytes characters at least, and they are classified on
+         *  numof_threads threads. 0 means
+         *  util::thread::hardware_concurrency(). Each string is classified
+         *  by basic_check::classify(2), so SIMD is used within a string for
+         *  the runs of digits and for the delimiters of infer(4), and the
+         *  strings are not packed into a vector together.
+         * */
+        template<typename Char, typename CharTraits = std::char_traits<Char> >
+        class basic_inferrer {
+            public:
+                typedef Char                            char_type;
+                typedef basic_check<char_type, CharTraits>  check_type;
+                typedef basic_string_ref<char_type>     string_ref_type;
+
+                // the bits of a string
+                enum bit_type {
+                    EMPTY       = 1,
+                    INTEGER     = 2,
+                    DECIMAL     = 4,
+                    EXPONENT    = 8,
+                    NEGATIVE    = 16,
+                    // an integer that may not fit in long
+                    BIG_INTEGER = 32
+                };
+
+                // from the narrowest
+                enum type_type {
+                    EMPTY_COLUMN,
+                    LONG_COLUMN,
+                    DOUBLE_COLUMN,
+                    STRING_COLUMN
+                };
+
+                static const std::size_t block_elements = 1 << 14;
+                static const std::size_t block_bytes = 1 << 18;
+
+            private:
+                // a part of the strings for infer(3)
+                struct span_chunk {
+                    std::size_t first;
+                    std::size_t last;
+                    type_type type;
+                };
+
+                // a part of the buffer for infer(4), and its results
+                struct buffer_chunk {
+                    const char_type* first;
+                    const char_type* last;
+                    std::vector<unsigned char> bits;
+                    type_type type;
+                };
+
+                // thread bodies
+                template<typename Iterator>
+                    struct span_task {
+                        basic_inferrer* self;
+                        Iterator first;
+                        unsigned char* bits;
+
+                        span_task(  basic_inferrer* self, Iterator first,
+                                    unsigned char* bits)
+                            : self(self), first(first), bits(bits) {}
+                        void operator()(void) {
+                            self->classify_span(first, bits);
+                        }
+                    };
+
+                struct buffer_task {
+                    basic_inferrer* self;
+                    char_type delimiter;
+
+                    buffer_task(basic_inferrer* self, char_type delimiter)
+                        : self(self), delimiter(delimiter) {}
+                    void operator()(void) { self->classify_buffer(delimiter); }
+                };
+
+                check_type checker;
+                util::thread::chunk_pool pool;
+
+                std::vector<span_chunk> spans;
+                std::vector<buffer_chunk> buffers;
+
+            public:
+                // constructor
+                explicit basic_inferrer(const std::locale& loc = std::locale(),
+                                        unsigned int numof_threads = 0)
+                    : checker(loc), pool(numof_threads) {}
+
+                // the type of a string of bits
+                static type_type type(unsigned char bits) {
+                    if (bits & EMPTY) return EMPTY_COLUMN;
+                    if ((bits & (INTEGER | BIG_INTEGER)) == INTEGER) {
+                        return LONG_COLUMN;
+                    }
+                    if (bits & (INTEGER | DECIMAL | EXPONENT)) {
+                        return DOUBLE_COLUMN;
+                    }
+                    return STRING_COLUMN;
+                }
+
+                unsigned char classify( const char_type* first,
+                                        const char_type* last) const {
+                    if (first == last) return EMPTY;
+                    const typename check_type::numeral_type numeral =
+                        checker.classify(first, last);
+                    unsigned char bits = 0;
+                    if (numeral.integer) {
+                        bits |= numeral.overflow ? (INTEGER | BIG_INTEGER)
+                                                 : INTEGER;
+                    }
+                    if (numeral.decimal) bits |= DECIMAL;
+                    if (numeral.exponent) bits |= EXPONENT;
+                    if (bits != 0 && numeral.negative) bits |= NEGATIVE;
+                    return bits;
+                }
+
+                template<typename Iterator>
+                    type_type infer(Iterator first, Iterator last,
+                                    std::vector<unsigned char>& bits) {
+                        const std::size_t n = last - first;
+                        bits.resize(n);
+                        if (n == 0) return EMPTY_COLUMN;
+
+                        const std::size_t numof_chunks = std::max<std::size_t>(
+                                std::min<std::size_t>(n / block_elements,
+                                    pool.concurrency() * 4),
+                                1);
+                        spans.resize(numof_chunks);
+                        for (std::size_t i = 0; i < numof_chunks; ++i) {
+                            span_chunk& c = spans[i];
+                            c.first = n / numof_chunks * i;
+                            c.last = (i + 1 < numof_chunks)
+                                ? n / numof_chunks * (i + 1) : n;
+                            c.type = EMPTY_COLUMN;
+                        }
+                        pool.run(numof_chunks,
+                                span_task<Iterator>(this, first, &bits[0]));
+                        return merge(spans);
+                    }
+
+                type_type infer(const char_type* first, const char_type* last,
+                                char_type delimiter,
+                                std::vector<unsigned char>& bits) {
+                    bits.clear();
+                    if (first == last) return EMPTY_COLUMN;
+
+                    // the chunks of the same size at first, and then after
+                    // the next delimiters
+                    const std::size_t size = last - first;
+                    const std::size_t numof_chunks = std::max<std::size_t>(
+                            std::min<std::size_t>(size / block_bytes,
+                                pool.concurrency() * 4),
+                            1);
+                    buffers.resize(numof_chunks);
+                    const char_type* head = first;
+                    for (std::size_t i = 0; i < numof_chunks; ++i) {
+                        buffer_chunk& c = buffers[i];
+                        const char_type* tail = last;
+                        if (i + 1 < numof_chunks) {
+                            tail = first + size / numof_chunks * (i + 1);
+                            if (tail < head) tail = head;
+                            tail = util::string::find(
+                                    tail, last, &delimiter, 1);
+                            if (tail != last) ++tail;
+                        }
+                        c.first = head;
+                        c.last = tail;
+                        c.type = EMPTY_COLUMN;
+                        head = tail;
+                    }
+                    pool.run(numof_chunks, buffer_task(this, delimiter));
+
+                    std::size_t n = 0;
+                    for (std::size_t i = 0; i < numof_chunks; ++i) {
+                        n += buffers[i].bits.size();
+                    }
+                    bits.reserve(n);
+                    for (std::size_t i = 0; i < numof_chunks; ++i) {
+                        const std::vector<unsigned char>& part =
+                            buffers[i].bits;
+                        bits.insert(bits.end(), part.begin(), part.end());
+                        std::vector<unsigned char>().swap(buffers[i].bits);
+                    }
+                    return merge(buffers);
+                }
+
+            private:
+                // the widest type of the chunks
+                template<typename Chunk>
+                    static type_type merge(const std::vector<Chunk>& chunks) {
+                        type_type result = EMPTY_COLUMN;
+                        for (std::size_t i = 0; i < chunks.size(); ++i) {
+                            result = std::max(result, chunks[i].type);
+                        }
+                        return result;
+                    }
+
+                template<typename Iterator>
+                    void classify_span(Iterator first, unsigned char* bits) {
+                        std::size_t i;
+                        while (pool.take(i)) {
+                            span_chunk& c = spans[i];
+                            type_type result = EMPTY_COLUMN;
+                            for (std::size_t k = c.first; k < c.last; ++k) {
+                                const string_ref_type str(first[k]);
+                                const char_type* const head = str.data();
+                                bits[k] = classify(head, head + str.size());
+                                result = std::max(result, type(bits[k]));
+                            }
+                            c.type = result;
+                        }
+                    }
+
+                void classify_buffer(char_type delimiter) {
+                    const char_type lf = char_type('\n');
+                    const char_type cr = char_type('\r');
+                    std::size_t i;
+                    while (pool.take(i)) {
+                        buffer_chunk& c = buffers[i];
+                        c.bits.clear();
+                        type_type result = EMPTY_COLUMN;
+                        const char_type* p = c.first;
+                        while (p != c.last) {
+                            const char_type* const found = util::string::find(
+                                    p, c.last, &delimiter, 1);
+                            const char_type* end = found;
+                            if (delimiter == lf && end != p
+                                    && *(end - 1) == cr) {
+                                --end;
+                            }
+                            const unsigned char bits = classify(p, end);
+                            c.bits.push_back(bits);
+                            result = std::max(result, type(bits));
+                            p = (found == c.last) ? found : found + 1;
+                        }
+                        c.type = result;
+                    }
+                }
+
+            private:
+                // not copyable
+                basic_inferrer(const basic_inferrer&);
+                basic_inferrer& operator=(const basic_inferrer&);
+        };
+
+        typedef basic_inferrer<char>    inferrer;
+        typedef basic_inferrer<wchar_t> winferrer;
+    }
+}
+
+#endif // STRINFER_HPP
@@ -2,6 +2,9 @@
  * string.hpp
  *  utility functions for std::string
  *
+ *  find(4), find_first_of(5), find_first_not_in(4) and count compare 16 or
+ *  32 characters at once with SSE2 or AVX2 for char, see simd.hpp.
+ *
  *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
  *  see LICENSE for redistributing, modifying, and so on.
  * */
@@ -9,26 +12,370 @@
 #ifndef STRING_HPP
 #define STRING_HPP
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
 #include <string>
 
+#if __cplusplus >= 201703L
+#   include <string_view>
+#endif
+
+#include "simd.hpp"
+
 namespace util {
     namespace string {
+        /*
+         *  A reference to a range of characters that are owned by others.
+         *  This is std::basic_string_view with C++17, and a class that has
+         *  the subset of it otherwise: data(), size(), empty(), begin(),
+         *  end() and operator[].
+         *
+         *      std::string line("1,2,3");
+         *      util::string::string_ref field(line.data(), 1);
+         *      std::string copy(field.data(), field.size());
+         * */
+#if __cplusplus >= 201703L
+        template<typename Char>
+            using basic_string_ref = std::basic_string_view<Char>;
+#else
+        template<typename Char>
+            class basic_string_ref {
+                public:
+                    typedef Char                char_type;
+                    typedef const char_type*    const_iterator;
+                    typedef const_iterator      iterator;
+                    typedef std::size_t         size_type;
+
+                private:
+                    const char_type* head;
+                    size_type length;
+
+                public:
+                    // constructor
+                    basic_string_ref(void) : head(0), length(0) {}
+                    basic_string_ref(const char_type* head, size_type length)
+                        : head(head), length(length) {}
+                    basic_string_ref(const char_type* str)
+                        : head(str),
+                          length(std::char_traits<char_type>::length(str)) {}
+                    basic_string_ref(const std::basic_string<char_type>& str)
+                        : head(str.data()), length(str.size()) {}
+
+                    // getters
+                    const char_type* data(void) const { return head; }
+                    size_type size(void) const { return length; }
+                    bool empty(void) const { return length == 0; }
+                    const_iterator begin(void) const { return head; }
+                    const_iterator end(void) const { return head + length; }
+                    const char_type& operator[](size_type i) const {
+                        return head[i];
+                    }
+            };
+
+        template<typename Char>
+            inline std::basic_ostream<Char>&
+            operator <<(std::basic_ostream<Char>& out,
+                        const basic_string_ref<Char>& str) {
+                return out.write(str.data(), str.size());
+            }
+#endif
+
+        // for convenience
+        typedef basic_string_ref<char>      string_ref;
+        typedef basic_string_ref<wchar_t>   wstring_ref;
+
+        // kernels for find(4) and count
+        template<typename Char>
+            struct find_kernel {
+                // the first occurrence of the n characters target
+                static const Char* find(const Char* first, const Char* last,
+                                        const Char* target, std::size_t n) {
+                    return std::search(first, last, target, target + n);
+                }
+                // the occurrences of c
+                static std::size_t count(   const Char* first,
+                                            const Char* last, Char c) {
+                    return std::count(first, last, c);
+                }
+                // the first of a, b or c
+                static const Char* find_first_of(
+                        const Char* first, const Char* last,
+                        Char a, Char b, Char c) {
+                    for (; first != last; ++first) {
+                        if (*first == a || *first == b || *first == c) break;
+                    }
+                    return first;
+                }
+                // the first out of [low, high]
+                static const Char* find_first_not_in(
+                        const Char* first, const Char* last,
+                        Char low, Char high) {
+                    for (; first != last; ++first) {
+                        if (*first < low || high < *first) break;
+                    }
+                    return first;
+                }
+            };
+
+#ifdef SIMD_SSE2
+        /*
+         *  A single character is compared to 16 or 32 characters, and the
+         *  mask of the matches gives the position. A longer target is
+         *  found by the candidates that both of the first and the last
+         *  character match, and the rest of them is compared with
+         *  std::memcmp(3).
+         * */
+        template<>
+            struct find_kernel<char> {
+                static const char* find(const char* first, const char* last,
+                                        const char* target, std::size_t n) {
+                    if (static_cast<std::size_t>(last - first) < n) {
+                        return last;
+                    }
+                    // the heads of the candidates are in [first, end)
+                    const char* const end = last - n + 1;
+                    const char* p = first;
+                    if (n == 1) {
+                        const char c = *target;
+#ifdef SIMD_AVX2
+                        const __m256i c32 = _mm256_set1_epi8(c);
+                        for (; end - p >= 32; p += 32) {
+                            const unsigned int mask = _mm256_movemask_epi8(
+                                    _mm256_cmpeq_epi8(
+                                        util::simd::load256(p), c32));
+                            if (mask) {
+                                return p + util::simd::lowest_bit(mask);
+                            }
+                        }
+#endif
+                        const __m128i c16 = _mm_set1_epi8(c);
+                        for (; end - p >= 16; p += 16) {
+                            const unsigned int mask = _mm_movemask_epi8(
+                                    _mm_cmpeq_epi8(
+                                        util::simd::load128(p), c16));
+                            if (mask) {
+                                return p + util::simd::lowest_bit(mask);
+                            }
+                        }
+                        for (; p < end; ++p) if (*p == c) return p;
+                        return last;
+                    }
+
+                    const char* const rest = target + 1;
+                    const std::size_t rest_size = n - 2;
+#ifdef SIMD_AVX2
+                    const __m256i head32 = _mm256_set1_epi8(target[0]);
+                    const __m256i tail32 = _mm256_set1_epi8(target[n - 1]);
+                    for (; end - p >= 32; p += 32) {
+                        unsigned int mask = _mm256_movemask_epi8(
+                                _mm256_and_si256(
+                                    _mm256_cmpeq_epi8(
+                                        util::simd::load256(p), head32),
+                                    _mm256_cmpeq_epi8(
+                                        util::simd::load256(p + n - 1),
+                                        tail32)));
+                        while (mask) {
+                            const char* const candidate =
+                                p + util::simd::lowest_bit(mask);
+                            if (std::memcmp(candidate + 1, rest, rest_size)
+                                    == 0) {
+                                return candidate;
+                            }
+                            mask &= mask - 1;
+                        }
+                    }
+#endif
+                    const __m128i head16 = _mm_set1_epi8(target[0]);
+                    const __m128i tail16 = _mm_set1_epi8(target[n - 1]);
+                    for (; end - p >= 16; p += 16) {
+                        unsigned int mask = _mm_movemask_epi8(
+                                _mm_and_si128(
+                                    _mm_cmpeq_epi8(
+                                        util::simd::load128(p), head16),
+                                    _mm_cmpeq_epi8(
+                                        util::simd::load128(p + n - 1),
+                                        tail16)));
+                        while (mask) {
+                            const char* const candidate =
+                                p + util::simd::lowest_bit(mask);
+                            if (std::memcmp(candidate + 1, rest, rest_size)
+                                    == 0) {
+                                return candidate;
+                            }
+                            mask &= mask - 1;
+                        }
+                    }
+                    return std::search(p, last, target, target + n);
+                }
+
+                static std::size_t count(   const char* first,
+                                            const char* last, char c) {
+                    std::size_t count = 0;
+                    const char* p = first;
+#ifdef SIMD_AVX2
+                    const __m256i c32 = _mm256_set1_epi8(c);
+                    for (; last - p >= 32; p += 32) {
+                        count += util::simd::count_bits(_mm256_movemask_epi8(
+                                    _mm256_cmpeq_epi8(
+                                        util::simd::load256(p), c32)));
+                    }
+#endif
+                    const __m128i c16 = _mm_set1_epi8(c);
+                    for (; last - p >= 16; p += 16) {
+                        count += util::simd::count_bits(_mm_movemask_epi8(
+                                    _mm_cmpeq_epi8(
+                                        util::simd::load128(p), c16)));
+                    }
+                    return count + std::count(p, last, c);
+                }
+
+                static const char* find_first_of(
+                        const char* first, const char* last,
+                        char a, char b, char c) {
+                    const char* p = first;
+#ifdef SIMD_AVX2
+                    const __m256i a32 = _mm256_set1_epi8(a);
+                    const __m256i b32 = _mm256_set1_epi8(b);
+                    const __m256i c32 = _mm256_set1_epi8(c);
+                    for (; last - p >= 32; p += 32) {
+                        const __m256i v = util::simd::load256(p);
+                        const unsigned int mask = _mm256_movemask_epi8(
+                                _mm256_or_si256(
+                                    _mm256_or_si256(
+                                        _mm256_cmpeq_epi8(v, a32),
+                                        _mm256_cmpeq_epi8(v, b32)),
+                                    _mm256_cmpeq_epi8(v, c32)));
+                        if (mask) return p + util::simd::lowest_bit(mask);
+                    }
+#endif
+                    const __m128i a16 = _mm_set1_epi8(a);
+                    const __m128i b16 = _mm_set1_epi8(b);
+                    const __m128i c16 = _mm_set1_epi8(c);
+                    for (; last - p >= 16; p += 16) {
+                        const __m128i v = util::simd::load128(p);
+                        const unsigned int mask = _mm_movemask_epi8(
+                                _mm_or_si128(
+                                    _mm_or_si128(
+                                        _mm_cmpeq_epi8(v, a16),
+                                        _mm_cmpeq_epi8(v, b16)),
+                                    _mm_cmpeq_epi8(v, c16)));
+                        if (mask) return p + util::simd::lowest_bit(mask);
+                    }
+                    for (; p != last; ++p) {
+                        if (*p == a || *p == b || *p == c) break;
+                    }
+                    return p;
+                }
+
+                // x is in [low, high] if the unsigned x - low equals
+                // min(x - low, high - low)
+                static const char* find_first_not_in(
+                        const char* first, const char* last,
+                        char low, char high) {
+                    const char* p = first;
+#ifdef SIMD_AVX2
+                    const __m256i low32 = _mm256_set1_epi8(low);
+                    const __m256i range32 = _mm256_set1_epi8(
+                            static_cast<char>(high - low));
+                    for (; last - p >= 32; p += 32) {
+                        const __m256i offset = _mm256_sub_epi8(
+                                util::simd::load256(p), low32);
+                        const unsigned int mask = ~static_cast<unsigned int>(
+                                _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                                    _mm256_min_epu8(offset, range32),
+                                    offset)));
+                        if (mask) return p + util::simd::lowest_bit(mask);
+                    }
+#endif
+                    const __m128i low16 = _mm_set1_epi8(low);
+                    const __m128i range16 = _mm_set1_epi8(
+                            static_cast<char>(high - low));
+                    for (; last - p >= 16; p += 16) {
+                        const __m128i offset = _mm_sub_epi8(
+                                util::simd::load128(p), low16);
+                        const unsigned int mask = ~_mm_movemask_epi8(
+                                _mm_cmpeq_epi8(
+                                    _mm_min_epu8(offset, range16),
+                                    offset)) & 0xffff;
+                        if (mask) return p + util::simd::lowest_bit(mask);
+                    }
+                    for (; p != last; ++p) {
+                        if (*p < low || high < *p) break;
+                    }
+                    return p;
+                }
+            };
+#endif // SIMD_SSE2
+
+        /*
+         *  The first occurrence of the n characters target in [first, last),
+         *  or last if not found. An empty target is never found, so this
+         *  can be used to split a range by target.
+         *
+         *      const char* found = util::string::find(
+         *              line.data(), line.data() + line.size(), "::", 2);
+         * */
+        template<typename Char>
+            inline const Char*
+            find(   const Char* first, const Char* last,
+                    const Char* target, std::size_t n) {
+                if (n == 0) return last;
+                return find_kernel<Char>::find(first, last, target, n);
+            }
+
+        // The first of the characters a, b or c in [first, last), or last.
+        // Pass one of them twice to find two.
+        template<typename Char>
+            inline const Char*
+            find_first_of(  const Char* first, const Char* last,
+                            Char a, Char b, Char c) {
+                return find_kernel<Char>::find_first_of(first, last, a, b, c);
+            }
+
+        // The first character that is out of [low, high] in [first, last),
+        // or last. This is a run of digits with '0' and '9'. low and high
+        // of char must have the same sign.
+        template<typename Char>
+            inline const Char*
+            find_first_not_in(  const Char* first, const Char* last,
+                                Char low, Char high) {
+                return find_kernel<Char>::find_first_not_in(
+                        first, last, low, high);
+            }
+
         // count
+        // The occurrences don't overlap: "aa" is found once in "aaa", just
+        // as split(3) of typeconv.hpp cuts the string.
+        template<typename Char>
+            std::size_t
+            count(  const Char* first, const Char* last,
+                    const Char* target, std::size_t n) {
+                if (n == 0) return 0;
+                if (n == 1) {
+                    return find_kernel<Char>::count(first, last, *target);
+                }
+
+                std::size_t count = 0;
+                for (;;) {
+                    first = find_kernel<Char>::find(first, last, target, n);
+                    if (first == last) return count;
+                    ++count;
+                    first += n;
+                }
+            }
+
         template<typename Char>
             unsigned int
             count(  const std::basic_string<Char>& str,
                     const Char* const target) {
-                unsigned int count = 0;
-                typename std::basic_string<Char>::size_type found =
-                    str.find(target);
-                while (found != std::basic_string<Char>::npos) {
-                    ++count;
-                    found = str.find(target, found + 1);
-                }
-                return count;
+                const Char* const first = str.data();
+                return static_cast<unsigned int>(count(
+                            first, first + str.size(), target,
+                            std::char_traits<Char>::length(target)));
             }
     }
 }
 
 #endif // STRING_HPP
-
@@ -0,0 +1,292 @@
+/*
+ * thread.hpp
+ *  minimal classes for threads: thread, mutex, scoped_lock, condition and
+ *  chunk_pool
+ *
+ *  These wrap POSIX threads, or Win32 threads for Visual C++. Link the
+ *  thread library with GCC:
+ *
+ *      > g++ -Wall --pedantic -pthread main.cpp
+ *      > cl /EHsc /W4 main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#ifndef THREAD_HPP
+#define THREAD_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#ifdef _MSC_VER
+#   ifndef NOMINMAX
+#       define NOMINMAX     // keep std::min(2) and std::max(2) usable
+#   endif
+#   include <process.h>     // for _beginthreadex(6)
+#   include <windows.h>     // for CRITICAL_SECTION, CONDITION_VARIABLE
+#else
+#   include <pthread.h>
+#   include <unistd.h>      // for sysconf(1)
+#endif
+
+namespace util {
+    namespace thread {
+        // a number of processors, or 1 if unknown
+        inline unsigned int hardware_concurrency(void) {
+#ifdef _MSC_VER
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return info.dwNumberOfProcessors > 0
+                ? static_cast<unsigned int>(info.dwNumberOfProcessors) : 1;
+#else
+            long n = sysconf(_SC_NPROCESSORS_ONLN);
+            return n > 0 ? static_cast<unsigned int>(n) : 1;
+#endif
+        }
+
+        /*
+         *  A mutex that is not recursive.
+         *  Use scoped_lock rather than lock(0) and unlock(0).
+         * */
+        class mutex {
+            friend class condition;
+
+            private:
+#ifdef _MSC_VER
+                CRITICAL_SECTION handle;
+#else
+                pthread_mutex_t handle;
+#endif
+
+            public:
+#ifdef _MSC_VER
+                mutex(void) { InitializeCriticalSection(&handle); }
+                ~mutex(void) { DeleteCriticalSection(&handle); }
+                void lock(void) { EnterCriticalSection(&handle); }
+                void unlock(void) { LeaveCriticalSection(&handle); }
+#else
+                mutex(void) { pthread_mutex_init(&handle, 0); }
+                ~mutex(void) { pthread_mutex_destroy(&handle); }
+                void lock(void) { pthread_mutex_lock(&handle); }
+                void unlock(void) { pthread_mutex_unlock(&handle); }
+#endif
+
+            private:
+                // not copyable
+                mutex(const mutex&);
+                mutex& operator=(const mutex&);
+        };
+
+        // lock a mutex while the object lives
+        class scoped_lock {
+            private:
+                mutex& m;
+
+            public:
+                explicit scoped_lock(mutex& m) : m(m) { m.lock(); }
+                ~scoped_lock(void) { m.unlock(); }
+
+            private:
+                // not copyable
+                scoped_lock(const scoped_lock&);
+                scoped_lock& operator=(const scoped_lock&);
+        };
+
+        /*
+         *  A condition variable.
+         *  wait(1) can wake up spuriously, so call it in a loop:
+         *
+         *      util::thread::scoped_lock lock(m);
+         *      while (!ready) cond.wait(m);
+         * */
+        class condition {
+            private:
+#ifdef _MSC_VER
+                CONDITION_VARIABLE handle;
+#else
+                pthread_cond_t handle;
+#endif
+
+            public:
+#ifdef _MSC_VER
+                condition(void) { InitializeConditionVariable(&handle); }
+                void wait(mutex& m) {
+                    SleepConditionVariableCS(&handle, &m.handle, INFINITE);
+                }
+                void notify_one(void) { WakeConditionVariable(&handle); }
+                void notify_all(void) { WakeAllConditionVariable(&handle); }
+#else
+                condition(void) { pthread_cond_init(&handle, 0); }
+                ~condition(void) { pthread_cond_destroy(&handle); }
+                void wait(mutex& m) { pthread_cond_wait(&handle, &m.handle); }
+                void notify_one(void) { pthread_cond_signal(&handle); }
+                void notify_all(void) { pthread_cond_broadcast(&handle); }
+#endif
+
+            private:
+                // not copyable
+                condition(const condition&);
+                condition& operator=(const condition&);
+        };
+
+        /*
+         *  A thread that calls a copy of the function object.
+         *  Usage:
+         *
+         *      struct task { void operator()(void) { ... } };
+         *      util::thread::thread t((task()));
+         *      t.join();
+         *
+         *  The destructor joins the thread if it's not joined yet. This
+         *  object is not copyable, so hold them by pointers in containers.
+         * */
+        class thread {
+            private:
+                // type erasure of function objects
+                struct runnable_base {
+                    virtual ~runnable_base(void) {}
+                    virtual void run(void) = 0;
+                };
+                template<typename Function>
+                struct runnable : public runnable_base {
+                    Function f;
+                    explicit runnable(const Function& f) : f(f) {}
+                    void run(void) { f(); }
+                };
+
+                runnable_base* body;
+                bool running;
+#ifdef _MSC_VER
+                HANDLE handle;
+
+                static unsigned int __stdcall entry(void* p) {
+                    static_cast<runnable_base*>(p)->run();
+                    return 0;
+                }
+#else
+                pthread_t handle;
+
+                static void* entry(void* p) {
+                    static_cast<runnable_base*>(p)->run();
+                    return 0;
+                }
+#endif
+
+            public:
+                // constructor
+                template<typename Function>
+                explicit thread(const Function& f)
+                    : body(new runnable<Function>(f)), running(false) {
+#ifdef _MSC_VER
+                    handle = reinterpret_cast<HANDLE>(_beginthreadex(
+                                0, 0, &thread::entry, body, 0, 0));
+                    running = (handle != 0);
+#else
+                    running = (pthread_create(
+                                &handle, 0, &thread::entry, body) == 0);
+#endif
+                }
+
+                // destructor
+                ~thread(void) {
+                    join();
+                    delete body;
+                }
+
+                // This returns false if the thread couldn't be started or
+                // has been joined.
+                bool joinable(void) const { return running; }
+
+                void join(void) {
+                    if (!running) return;
+#ifdef _MSC_VER
+                    WaitForSingleObject(handle, INFINITE);
+                    CloseHandle(handle);
+#else
+                    pthread_join(handle, 0);
+#endif
+                    running = false;
+                }
+
+            private:
+                // not copyable
+                thread(const thread&);
+                thread& operator=(const thread&);
+        };
+
+        /*
+         *  A pool that runs a task on the threads and the calling thread,
+         *  and hands out the indices of the chunks of a work to them.
+         *  Usage:
+         *
+         *      struct task {
+         *          util::thread::chunk_pool* pool;
+         *          void operator()(void) {
+         *              std::size_t i;
+         *              while (pool->take(i)) { ... the chunk i ... }
+         *          }
+         *      };
+         *      util::thread::chunk_pool pool(numof_threads);
+         *      task t = { &pool };
+         *      pool.run(numof_chunks, t);
+         *
+         *  run(2) calls task on concurrency() threads at most including the
+         *  calling one, and returns after all of them finish. numof_threads
+         *  0 means hardware_concurrency().
+         * */
+        class chunk_pool {
+            private:
+                unsigned int numof_threads;
+                std::size_t numof_chunks;
+                std::size_t next_chunk;
+                mutex m;
+
+            public:
+                // constructor
+                explicit chunk_pool(unsigned int numof_threads = 0)
+                    : numof_threads(numof_threads != 0
+                            ? numof_threads : hardware_concurrency()),
+                      numof_chunks(0), next_chunk(0) {}
+
+                // getters
+                unsigned int concurrency(void) const { return numof_threads; }
+
+                template<typename Task>
+                    void run(std::size_t n, Task task) {
+                        {
+                            scoped_lock lock(m);
+                            numof_chunks = n;
+                            next_chunk = 0;
+                        }
+                        const std::size_t numof_workers =
+                            std::min<std::size_t>(numof_threads, n);
+                        std::vector<thread*> threads;
+                        for (std::size_t i = 1; i < numof_workers; ++i) {
+                            threads.push_back(new thread(task));
+                        }
+                        task();
+                        // join all threads
+                        for (std::size_t i = 0; i < threads.size(); ++i) {
+                            delete threads[i];
+                        }
+                    }
+
+                // This takes the next chunk, or returns false at the end.
+                bool take(std::size_t& i) {
+                    scoped_lock lock(m);
+                    if (next_chunk == numof_chunks) return false;
+                    i = next_chunk++;
+                    return true;
+                }
+
+            private:
+                // not copyable
+                chunk_pool(const chunk_pool&);
+                chunk_pool& operator=(const chunk_pool&);
+        };
+    }
+}
+
+#endif // THREAD_HPP
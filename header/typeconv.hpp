@@ -4,11 +4,30 @@
  *
  *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
  *  see LICENSE for redistributing, modifying, and so on.
+ *
+ * fast path
+ *  The arithmetic types (short, int, long, their unsigned types, float,
+ *  double and long double) bypass the stream while the flags are default
+ *  except floatfield, and the locale is classic. The results are same as
+ *  the stream: the integers are formatted and parsed by hand, the floating
+ *  point numbers are formatted by sprintf(3) with the precision and
+ *  floatfield of the stream, and double is parsed by strtod(3) after the
+ *  stream grammar is checked. Anything else, including overflows and
+ *  errors, goes through the stream, so the fail bits are also same. Only
+ *  the buffer of the stream isn't updated by the fast path.
  * */
 
 #ifndef TYPECONV_HPP
 #define TYPECONV_HPP
 
+#include <algorithm>
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <locale>
 #include <sstream>
 #include <string>
@@ -38,6 +57,7 @@ namespace util {
                     // for convenience
                     typedef Char                            char_type;
                     typedef std::basic_string<char_type>    string_type;
+                    typedef basic_string_ref<char_type>     string_ref_type;
 
                 public:
                     // constructor
@@ -51,6 +71,12 @@ namespace util {
                     // inference always works.
                     template<typename T>
                         string_type strfrom(const T& src) {
+                            string_type dst;
+                            if (is_default() && append(dst, src)) {
+                                this->clear();
+                                return dst;
+                            }
+
                             this->clear();
                             this->str(Traits::null());
 
@@ -62,28 +88,29 @@ namespace util {
                     // This must be specified T
                     template<typename T>
                         T strto(const string_type& src) {
-                            this->clear();
-
-                            this->str(src);
                             T dst;
-                            *this >> dst;
+                            extract(src, dst);
                             return dst;
                         }
 
+                    // a range of characters -> specified type
+                    // This returns false unless the whole of src is
+                    // converted, and dst is unspecified then.
+                    template<typename T>
+                        bool strto(const string_ref_type& src, T& dst) {
+                            const char_type* const first = src.data();
+                            extract(first, first + src.size(), dst,
+                                    is_default());
+                            return !this->fail() && this->eof();
+                        }
+
                     // some elements of any type -> std::basic_string
                     template<typename InputIterator>
                         string_type join(
                                 InputIterator first, InputIterator last,
                                 const string_type& delimiter = Traits::space()) {
-                            if (first == last)
-                                return string_type(Traits::null());
-
-                            this->clear();
-                            this->str(Traits::null());
-
-                            *this << *first++;
-                            while (first != last) *this << delimiter << *first++;
-                            return this->str();
+                            string_type dst;
+                            return join_into(first, last, dst, delimiter);
                         }
 
                     // std::basic_string -> some elements of any type
@@ -117,24 +144,445 @@ namespace util {
                             return result;
                         }
 
+                    /*
+                     *  std::basic_string -> the fields as references to
+                     *  src, in a single pass without any allocations
+                     *  except growing result. result is cleared, so reuse
+                     *  it for the next record.
+                     *
+                     *      std::vector<util::string::string_ref> fields;
+                     *      conv.split_view(line, fields, ",");
+                     * */
+                    std::vector<string_ref_type>&
+                    split_view( const string_ref_type& src,
+                                std::vector<string_ref_type>& result,
+                                const char_type* const delimiter) {
+                        result.clear();
+                        tokenize(src, delimiter, view_pusher(result));
+                        return result;
+                    }
+
+                    // for other types
+                    // The fields are parsed in place on the fast path.
+                    template<typename Value>
+                    std::vector<Value>&
+                    split_view( const string_ref_type& src,
+                                std::vector<Value>& result,
+                                const char_type* const delimiter) {
+                        result.clear();
+                        tokenize(src, delimiter,
+                                value_pusher<Value>(*this, result,
+                                    is_default()));
+                        return result;
+                    }
+
+                    /*
+                     *  some elements of any type -> dst
+                     *  This appends to dst, so clear it and reuse the
+                     *  capacity for the next record.
+                     * */
+                    template<typename InputIterator>
+                    string_type&
+                    join_into(  InputIterator first, InputIterator last,
+                                string_type& dst,
+                                const string_ref_type& delimiter
+                                    = Traits::space()) {
+                        const bool fast = is_default();
+                        for (bool head = true; first != last;
+                                ++first, head = false) {
+                            if (!head) {
+                                dst.append(delimiter.data(), delimiter.size());
+                            }
+                            if (!fast || !append(dst, *first)) {
+                                this->clear();
+                                this->str(Traits::null());
+                                *this << *first;
+                                dst += this->str();
+                            }
+                        }
+                        this->clear();
+                        return dst;
+                    }
+
                 protected:
+                    // callbacks for tokenize
+                    struct view_pusher {
+                        std::vector<string_ref_type>* result;
+                        explicit view_pusher(
+                                std::vector<string_ref_type>& result)
+                            : result(&result) {}
+                        void operator()(const char_type* first,
+                                        const char_type* last) const {
+                            result->push_back(
+                                    string_ref_type(first, last - first));
+                        }
+                    };
+                    template<typename Value>
+                    struct value_pusher {
+                        basic_typeconverter* converter;
+                        std::vector<Value>* result;
+                        bool fast;
+                        value_pusher(   basic_typeconverter& converter,
+                                        std::vector<Value>& result,
+                                        bool fast)
+                            : converter(&converter), result(&result),
+                              fast(fast) {}
+                        void operator()(const char_type* first,
+                                        const char_type* last) const {
+                            result->push_back(Value());
+                            converter->extract(first, last, result->back(),
+                                    fast);
+                        }
+                    };
+
+                    // This calls f(first, last) for each field.
+                    template<typename Function>
+                    static void
+                    tokenize(   const string_ref_type& src,
+                                const char_type* const delimiter,
+                                Function f) {
+                        const char_type* first = src.data();
+                        const char_type* const last = first + src.size();
+                        const std::size_t n =
+                            std::char_traits<char_type>::length(delimiter);
+                        if (n == 0) {
+                            f(first, last);
+                            return;
+                        }
+                        for (;;) {
+                            const char_type* found = util::string::find(
+                                    first, last, delimiter, n);
+                            f(first, found);
+                            if (found == last) return;
+                            first = found + n;
+                        }
+                    }
+
                     // common procedure for split
+                    // This skips the whole of a delimiter, and an empty
+                    // one gives a single field as count(2) finds nothing.
                     template<typename OutputIterator>
                     void search_push(const string_type& src,
                                 const char_type* const delimiter,
                                 const unsigned int n,
                                 OutputIterator first) {
-                        typename string_type::size_type head = 0;
-                        typename string_type::size_type tail;
+                        const std::size_t length =
+                            std::char_traits<char_type>::length(delimiter);
+                        const char_type* head = src.data();
+                        const char_type* const last = head + src.size();
+                        const bool fast = is_default();
                         for (unsigned int i = 0; i < n + 1; ++i) {
-                            tail = src.find(delimiter, head);
+                            const char_type* const tail = util::string::find(
+                                    head, last, delimiter, length);
+
+                            extract(head, tail, *first++, fast);
+
+                            if (tail == last) break;
+                            head = tail + length;
+                        }
+                    }
 
+                    // the stream or the fast path
+                    template<typename T>
+                    void extract(const string_type& src, T& dst) {
+                        const char_type* const first = src.data();
+                        if (!is_default()
+                                || !extract_fast(first, first + src.size(),
+                                    dst)) {
                             this->clear();
-                            this->str(src.substr(head, tail - head));
-                            *this >> *first++;
+                            this->str(src);
+                            *this >> dst;
+                        }
+                    }
+                    // fast is is_default(0) that the caller checked
+                    template<typename T>
+                    void extract(   const char_type* first,
+                                    const char_type* last, T& dst,
+                                    bool fast) {
+                        if (!fast || !extract_fast(first, last, dst)) {
+                            this->clear();
+                            this->str(string_type(first, last));
+                            *this >> dst;
+                        }
+                    }
+                    template<typename T>
+                    bool extract_fast(  const char_type* first,
+                                        const char_type* last, T& dst) {
+                        const char_type* end;
+                        if (!parse(first, last, end, dst)) return false;
+                        this->clear(end == last ? std::ios_base::eofbit
+                                                : std::ios_base::goodbit);
+                        return true;
+                    }
+
+                private:
+                    // whether the fast path gives the same result as the
+                    // stream
+                    bool is_default(void) const {
+                        return (this->flags() & ~std::ios_base::floatfield)
+                                == (std::ios_base::skipws | std::ios_base::dec)
+                            && this->width() == 0
+                            && this->getloc() == std::locale::classic();
+                    }
+
+                    // formatting
+                    // The types that have no overloads go through the
+                    // stream.
+                    template<typename T>
+                    static bool append(string_type&, const T&) {
+                        return false;
+                    }
+                    static bool append(string_type& dst, short src) {
+                        return append_signed<long>(dst, src);
+                    }
+                    static bool append(string_type& dst, unsigned short src) {
+                        return append_unsigned<unsigned long>(dst, src, false);
+                    }
+                    static bool append(string_type& dst, int src) {
+                        return append_signed<long>(dst, src);
+                    }
+                    static bool append(string_type& dst, unsigned int src) {
+                        return append_unsigned<unsigned long>(dst, src, false);
+                    }
+                    static bool append(string_type& dst, long src) {
+                        return append_signed<long>(dst, src);
+                    }
+                    static bool append(string_type& dst, unsigned long src) {
+                        return append_unsigned<unsigned long>(dst, src, false);
+                    }
+                    bool append(string_type& dst, float src) const {
+                        return append_floating(dst, src, "");
+                    }
+                    bool append(string_type& dst, double src) const {
+                        return append_floating(dst, src, "");
+                    }
+                    bool append(string_type& dst, long double src) const {
+                        return append_floating(dst, src, "L");
+                    }
+                    static bool
+                    append(string_type& dst, const string_ref_type& src) {
+                        dst.append(src.data(), src.size());
+                        return true;
+                    }
+
+                    template<typename Signed>
+                    static bool append_signed(string_type& dst, Signed src) {
+                        typedef unsigned long unsigned_type;
+                        return src < 0
+                            ? append_unsigned(dst,
+                                    0 - static_cast<unsigned_type>(src), true)
+                            : append_unsigned(dst,
+                                    static_cast<unsigned_type>(src), false);
+                    }
+
+                    template<typename Unsigned>
+                    static bool
+                    append_unsigned(string_type& dst, Unsigned src,
+                                    bool negative) {
+                        // the digits and the sign
+                        char_type buffer[
+                            std::numeric_limits<Unsigned>::digits10 + 2];
+                        char_type* const end =
+                            buffer + sizeof(buffer) / sizeof(buffer[0]);
+                        char_type* p = end;
+                        do {
+                            *--p = static_cast<char_type>('0' + src % 10);
+                            src /= 10;
+                        } while (src != 0);
+                        if (negative) *--p = static_cast<char_type>('-');
+                        dst.append(p, end);
+                        return true;
+                    }
+
+                    // sprintf(3) with the precision and floatfield
+                    template<typename Floating>
+                    bool append_floating(   string_type& dst, Floating src,
+                                            const char* length) const {
+                        const std::ios_base::fmtflags floatfield =
+                            this->flags() & std::ios_base::floatfield;
+                        const std::streamsize precision =
+                            this->precision() < 0 ? 6 : this->precision();
+                        const char* conversion =
+                              floatfield == std::ios_base::fixed        ? "f"
+                            : floatfield == std::ios_base::scientific   ? "e"
+                            : floatfield == 0                           ? "g"
+                            :                                             0;
+                        // The buffer is enough for 20 digits of the
+                        // integer part, the precision and an exponent.
+                        if (conversion == 0 || precision > 64
+                                || (*conversion == 'f'
+                                    && !(std::fabs(static_cast<long double>(
+                                                src)) < 1e20L))) {
+                            return false;
+                        }
+
+                        char format[8] = "%.*";
+                        std::strcat(format, length);
+                        std::strcat(format, conversion);
+                        char buffer[128];
+                        const int n = std::sprintf(buffer, format,
+                                static_cast<int>(precision), src);
+                        if (n <= 0) return false;
+
+                        // The C locale may be changed by setlocale(2).
+                        const char point = *std::localeconv()->decimal_point;
+                        for (int i = 0; i < n; ++i) {
+                            dst += static_cast<char_type>(
+                                    buffer[i] == point ? '.' : buffer[i]);
+                        }
+                        return true;
+                    }
+
+                    // parsing
+                    // end is the position after the number.
+                    template<typename T>
+                    static bool parse(  const char_type*, const char_type*,
+                                        const char_type*&, T&) {
+                        return false;
+                    }
+                    static bool parse(  const char_type* first,
+                                        const char_type* last,
+                                        const char_type*& end, short& dst) {
+                        return parse_integer(first, last, end, dst);
+                    }
+                    static bool parse(  const char_type* first,
+                                        const char_type* last,
+                                        const char_type*& end,
+                                        unsigned short& dst) {
+                        return parse_integer(first, last, end, dst);
+                    }
+                    static bool parse(  const char_type* first,
+                                        const char_type* last,
+                                        const char_type*& end, int& dst) {
+                        return parse_integer(first, last, end, dst);
+                    }
+                    static bool parse(  const char_type* first,
+                                        const char_type* last,
+                                        const char_type*& end,
+                                        unsigned int& dst) {
+                        return parse_integer(first, last, end, dst);
+                    }
+                    static bool parse(  const char_type* first,
+                                        const char_type* last,
+                                        const char_type*& end, long& dst) {
+                        return parse_integer(first, last, end, dst);
+                    }
+                    static bool parse(  const char_type* first,
+                                        const char_type* last,
+                                        const char_type*& end,
+                                        unsigned long& dst) {
+                        return parse_integer(first, last, end, dst);
+                    }
+                    static bool parse(  const char_type* first,
+                                        const char_type* last,
+                                        const char_type*& end, double& dst) {
+                        return parse_double(first, last, end, dst);
+                    }
+
+                    static bool is_space(char_type c) {
+                        return c == ' ' || (c >= '\t' && c <= '\r');
+                    }
+                    static bool is_digit(char_type c) {
+                        return c >= '0' && c <= '9';
+                    }
+
+                    // the leading spaces and the sign
+                    static const char_type*
+                    skip_sign(  const char_type* first, const char_type* last,
+                                bool& negative) {
+                        while (first != last && is_space(*first)) ++first;
+                        negative = false;
+                        if (first != last && (*first == '-' || *first == '+')) {
+                            negative = (*first == '-');
+                            ++first;
+                        }
+                        return first;
+                    }
+
+                    // The overflows and "-" for unsigned types are left to
+                    // the stream.
+                    template<typename Integer>
+                    static bool
+                    parse_integer(  const char_type* first,
+                                    const char_type* last,
+                                    const char_type*& end, Integer& dst) {
+                        typedef unsigned long unsigned_type;
+                        typedef std::numeric_limits<Integer> limits;
+
+                        bool negative;
+                        const char_type* p = skip_sign(first, last, negative);
+                        if (negative && !limits::is_signed) return false;
+                        const unsigned_type limit = negative
+                            ? 0 - static_cast<unsigned_type>(limits::min())
+                            : static_cast<unsigned_type>(limits::max());
+
+                        const char_type* const digits = p;
+                        unsigned_type value = 0;
+                        for (; p != last && is_digit(*p); ++p) {
+                            const unsigned_type digit = *p - '0';
+                            if (value > (limit - digit) / 10) return false;
+                            value = value * 10 + digit;
+                        }
+                        if (p == digits) return false;
+
+                        dst = negative
+                            ? static_cast<Integer>(
+                                    -static_cast<long>(value - 1) - 1)
+                            : static_cast<Integer>(value);
+                        end = p;
+                        return true;
+                    }
+
+                    // The grammar is [-+]?[0-9]*(\.[0-9]*)?([eE][-+]?[0-9]+)?
+                    // with a digit at least.
+                    static bool
+                    parse_double(   const char_type* first,
+                                    const char_type* last,
+                                    const char_type*& end, double& dst) {
+                        bool negative;
+                        const char_type* p = skip_sign(first, last, negative);
+                        const char_type* const number =
+                            (p != first && (p[-1] == '-' || p[-1] == '+'))
+                            ? p - 1 : p;
+
+                        std::size_t numof_digits = 0;
+                        for (; p != last && is_digit(*p); ++p) {
+                            ++numof_digits;
+                        }
+                        if (p != last && *p == '.') {
+                            for (++p; p != last && is_digit(*p); ++p) {
+                                ++numof_digits;
+                            }
+                        }
+                        if (numof_digits == 0) return false;
+                        if (p != last && (*p == 'e' || *p == 'E')) {
+                            ++p;
+                            if (p != last && (*p == '-' || *p == '+')) ++p;
+                            // The stream fails with "1e".
+                            if (p == last || !is_digit(*p)) return false;
+                            while (p != last && is_digit(*p)) ++p;
+                        }
+
+                        // a copy with the decimal point of the C locale
+                        char buffer[64];
+                        const std::size_t n = p - number;
+                        if (n >= sizeof(buffer)) return false;
+                        const char point = *std::localeconv()->decimal_point;
+                        for (std::size_t i = 0; i < n; ++i) {
+                            buffer[i] = (number[i] == '.')
+                                ? point : static_cast<char>(number[i]);
+                        }
+                        buffer[n] = '\0';
 
-                            head = tail + 1;
+                        errno = 0;
+                        char* parsed;
+                        const double value = std::strtod(buffer, &parsed);
+                        if (errno == ERANGE || parsed != buffer + n) {
+                            return false;
                         }
+                        dst = value;
+                        end = p;
+                        return true;
                     }
             };
 
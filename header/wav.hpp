@@ -9,19 +9,29 @@
  *  RIFF WAV specifications
  *      http://msdn.microsoft.com/en-us/library/ms713231.aspx
  *      http://www-mmsp.ece.mcgill.ca/Documents/AudioFormats/WAVE/WAVE.html
+ *  RF64 (EBU Tech 3306) and BW64 (ITU-R BS.2088) for files over 4 GiB
+ *      https://tech.ebu.ch/docs/tech/tech3306v1_1.pdf
  * */
 
 #ifndef WAV_HPP
 #define WAV_HPP
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <istream>
 #include <ostream>
+#include <vector>
 #include <stdint.h>
 
 #include "cast.hpp"
 #include "dlogger.hpp"
+#include "mmap.hpp"
+#include "pcmconv.hpp"
+#include "rawfile.hpp"
+#include "simd.hpp"
 
 namespace format {
     namespace riff_wav {
@@ -41,7 +51,7 @@ namespace format {
         struct elements_type {
             uint16_t channels;
             uint16_t bit_depth;
-            uint32_t numof_samples;
+            uint64_t numof_samples;
             uint32_t sampling_rate;
         };
 
@@ -78,6 +88,9 @@ namespace format {
          *      +-------+-------+-------+-------+---------------+---------------+
          * 0x20 |blk sz |bit dep|'d' 'a' 't' 'a'|   data size   | samples ...
          *      +-------+-------+---------------+---------------+
+         *
+         *  This is the canonical layout only. Use chunk_index to read files
+         *  that have other chunks (LIST, fact, ...).
          * */
         struct header_type {
             // member variables
@@ -174,7 +187,9 @@ namespace format {
                 data_subchunk_type(void) {}
                 explicit data_subchunk_type(const elements_type& p)
                     : id(data_id),
-                      size(p.numof_samples * p.channels * (p.bit_depth / 8))
+                      size(static_cast<uint32_t>(
+                                  p.numof_samples * p.channels
+                                  * (p.bit_depth / 8)))
                 {}
 
                 // utility function
@@ -204,7 +219,9 @@ namespace format {
             header_type(void) {}
             explicit header_type(const elements_type& p)
                 : id(riff_id),
-                  size(p.numof_samples * p.channels * (p.bit_depth / 8) + size_offset),
+                  size(static_cast<uint32_t>(
+                              p.numof_samples * p.channels * (p.bit_depth / 8)
+                              + size_offset)),
                   format_kind(wave_kind),
                   fmt_subchunk(p),
                   data_subchunk(p)
@@ -241,10 +258,12 @@ namespace format {
                 typename std::basic_istream<Char>::streampos current =
                     in.tellg();
                 in.seekg(0, std::ios::end);
-                uint32_t file_size = static_cast<uint32_t>(in.tellg());
+                uint64_t file_size = static_cast<uint64_t>(
+                        static_cast<std::streamoff>(in.tellg()));
                 in.seekg(current, std::ios::beg);
-                uint32_t supposed_size =
-                    data_subchunk.size + sizeof(header_type);
+                uint64_t supposed_size =
+                    static_cast<uint64_t>(data_subchunk.size)
+                    + sizeof(header_type);
 
                 if (file_size != supposed_size) {
                     DBGLOG("There is a difference between the wav file size"
@@ -262,10 +281,12 @@ namespace format {
                 typename std::basic_ostream<Char>::streampos current =
                     out.tellp();
                 out.seekp(0, std::ios::end);
-                uint32_t file_size = static_cast<uint32_t>(out.tellp());
+                uint64_t file_size = static_cast<uint64_t>(
+                        static_cast<std::streamoff>(out.tellp()));
                 out.seekp(current, std::ios::beg);
-                uint32_t supposed_size =
-                    data_subchunk.size + sizeof(header_type);
+                uint64_t supposed_size =
+                    static_cast<uint64_t>(data_subchunk.size)
+                    + sizeof(header_type);
 
                 if (file_size != supposed_size) {
                     DBGLOG("There is a difference between the wav file size"
@@ -280,12 +301,13 @@ namespace format {
 
             // getter
             // expect NRVO
-            elements_type elements(void) {
+            elements_type elements(void) const {
                 const fmt_subchunk_type::data_type& d = fmt_subchunk.data;
                 elements_type e = {
                     d.channels,
                     d.bit_depth,
-                    (data_subchunk.size * 8) / (d.channels * d.bit_depth),
+                    static_cast<uint64_t>(data_subchunk.size) * 8
+                        / (d.channels * d.bit_depth),
                     d.sampling_rate
                 };
                 return e;
@@ -322,6 +344,442 @@ namespace format {
             return out;
         }
 
+        /*
+         *  A chunk in RIFF WAV file.
+         *  offset is the position of the payload from the head of the file,
+         *  so the chunk header (id and size) is placed at (offset - 8).
+         *
+         *  Any chunks whose size is odd are followed by a pad byte, which is
+         *  not included in size.
+         *
+         *  size has 64 bits for RF64. Actual sizes of large chunks are
+         *  written in ds64 chunk, and the headers of the chunks have
+         *  0xffffffff.
+         * */
+        struct chunk_type {
+            uint32_t id;
+            uint64_t size;
+            uint64_t offset;
+
+            // constants
+            static const uint32_t header_size =
+                  sizeof(uint32_t)      // id
+                + sizeof(uint32_t);     // size
+            static const uint32_t size_in_ds64 = 0xffffffff;
+            static const uint32_t fmt_id =
+                quartet2uint<'f', 'm', 't', ' '>::value;
+            static const uint32_t data_id =
+                quartet2uint<'d', 'a', 't', 'a'>::value;
+            static const uint32_t ds64_id =
+                quartet2uint<'d', 's', '6', '4'>::value;
+            static const uint32_t fact_id =
+                quartet2uint<'f', 'a', 'c', 't'>::value;
+            static const uint32_t list_id =
+                quartet2uint<'L', 'I', 'S', 'T'>::value;
+            static const uint32_t bext_id =
+                quartet2uint<'b', 'e', 'x', 't'>::value;
+            static const uint32_t junk_id =
+                quartet2uint<'J', 'U', 'N', 'K'>::value;
+
+            // the position of the next chunk
+            uint64_t next(void) const { return offset + size + (size & 1); }
+        };
+
+        /*
+         *  The payload of ds64 chunk in RF64 / BW64 file.
+         *  This is the first chunk in RF64 chunk, and has 64 bits sizes.
+         *
+         *      id          "RF64" or "BW64"
+         *      size        0xffffffff
+         *      format-kind "WAVE"
+         *      ds64 chunk  riff size, data size, sample count, table length,
+         *                  table of (id, size) for other large chunks
+         *      fmt chunk, data chunk (size 0xffffffff), ...
+         * */
+#pragma pack(push, 4)
+        struct ds64_type {
+            uint64_t riff_size;
+            uint64_t data_size;
+            uint64_t sample_count;
+            uint32_t table_length;
+
+            struct entry_type {
+                uint32_t id;
+                uint64_t size;
+            };
+
+            // constants
+            static const uint32_t rf64_id =
+                quartet2uint<'R', 'F', '6', '4'>::value;
+            static const uint32_t bw64_id =
+                quartet2uint<'B', 'W', '6', '4'>::value;
+        };
+#pragma pack(pop)
+
+        /*
+         *  An index of all chunks in RIFF WAV file.
+         *  This walks chunks forward only once, reads the header of each
+         *  chunk and the payload of fmt (and ds64) chunk only, and skips the
+         *  others. So any chunks (LIST, fact, bext, JUNK, ...) can be placed
+         *  before or after data chunk. RF64 and BW64 files are also
+         *  accepted.
+         *
+         *  Usage with a stream:
+         *
+         *      std::ifstream in("foo.wav", std::ios::binary);
+         *      format::riff_wav::chunk_index index;
+         *      if (!index.read(in)) return 1;
+         *      // Now "in" points the payload of data chunk.
+         *      std::istream_iterator<basic_sample<2, 2> > itr(in);
+         *
+         *  Usage with util::file::raw_file:
+         *
+         *      util::file::raw_file file("foo.wav", raw_file::READ);
+         *      index.read(file);
+         *
+         *  Usage with memory (e.g. util::file::mapping):
+         *
+         *      index.read(mapping.data(), mapping.size());
+         *      const char* samples = mapping.data() + index.data().offset;
+         *
+         *  header() returns the canonical 44 bytes header that has same
+         *  elements as the file. The sizes in it are clipped to 32 bits for
+         *  RF64 files, so use elements() and data() for them.
+         * */
+        class chunk_index {
+            public:
+                typedef std::vector<chunk_type>         chunks_type;
+                typedef chunks_type::const_iterator     const_iterator;
+                typedef chunks_type::size_type          size_type;
+
+            private:
+                chunks_type chunks;
+                header_type canonical;
+                elements_type properties;
+                const chunk_type* data_chunk;
+                bool extended;
+
+                // sources of bytes for walk()
+                struct memory_source {
+                    const char* head;
+                    uint64_t length;
+
+                    memory_source(const char* head, uint64_t length)
+                        : head(head), length(length) {}
+                    uint64_t size(void) const { return length; }
+                    bool read(uint64_t offset, char* dst, std::size_t n) {
+                        if (offset > length || n > length - offset) {
+                            return false;
+                        }
+                        std::copy(head + offset, head + offset + n, dst);
+                        return true;
+                    }
+                };
+
+                template<typename Char>
+                struct stream_source {
+                    std::basic_istream<Char>* in;
+                    uint64_t length;
+
+                    explicit stream_source(std::basic_istream<Char>& in)
+                        : in(&in) {
+                        in.seekg(0, std::ios::end);
+                        typename std::basic_istream<Char>::pos_type end =
+                            in.tellg();
+                        length = (end < 0) ? 0 : static_cast<uint64_t>(
+                                static_cast<std::streamoff>(end));
+                        in.seekg(0, std::ios::beg);
+                    }
+                    uint64_t size(void) const { return length; }
+                    bool read(uint64_t offset, char* dst, std::size_t n) {
+                        in->seekg(static_cast<std::streamoff>(offset),
+                                std::ios::beg);
+                        in->read(dst, n);
+                        return in->good();
+                    }
+                };
+
+            public:
+                // constructor
+                chunk_index(void) : data_chunk(0), extended(false) {}
+                chunk_index(const chunk_index& rhs)
+                    : chunks(rhs.chunks), canonical(rhs.canonical),
+                      properties(rhs.properties), data_chunk(0),
+                      extended(rhs.extended) {
+                    if (rhs.data_chunk != 0) {
+                        data_chunk = find(chunk_type::data_id);
+                    }
+                }
+                chunk_index& operator=(const chunk_index& rhs) {
+                    chunks = rhs.chunks;
+                    canonical = rhs.canonical;
+                    properties = rhs.properties;
+                    extended = rhs.extended;
+                    data_chunk = (rhs.data_chunk != 0)
+                        ? find(chunk_type::data_id) : 0;
+                    return *this;
+                }
+
+                // build the index
+                bool read(const char* head, std::size_t size) {
+                    memory_source source(head, size);
+                    return walk(source);
+                }
+
+                // from a file through positional reads
+                bool read(util::file::raw_file& file) { return walk(file); }
+
+                // from any source that has "uint64_t size()" and
+                // "bool read(uint64_t offset, char* dst, std::size_t n)"
+                template<typename Source>
+                bool read_from(Source& source) { return walk(source); }
+
+                // The stream is left at the payload of data chunk if this
+                // succeeds.
+                template<typename Char>
+                bool read(std::basic_istream<Char>& in) {
+                    stream_source<Char> source(in);
+                    if (!walk(source)) return false;
+                    in.clear();
+                    in.seekg(static_cast<std::streamoff>(data_chunk->offset),
+                            std::ios::beg);
+                    return in.good();
+                }
+
+                // utility function
+                bool validate(void) const { return data_chunk != 0; }
+
+                // getters
+                const header_type& header(void) const { return canonical; }
+                elements_type elements(void) const { return properties; }
+                const chunk_type& data(void) const {
+                    assert(data_chunk != 0);
+                    return *data_chunk;
+                }
+                // true for RF64 and BW64
+                bool is_64bit(void) const { return extended; }
+
+                // The first chunk that has the id. NULL if not found.
+                const chunk_type* find(uint32_t id) const {
+                    for (const_iterator itr = chunks.begin();
+                            itr != chunks.end(); ++itr) {
+                        if (itr->id == id) return &*itr;
+                    }
+                    return 0;
+                }
+
+                const_iterator begin(void) const { return chunks.begin(); }
+                const_iterator end(void) const { return chunks.end(); }
+                size_type size(void) const { return chunks.size(); }
+
+            private:
+                template<typename Source>
+                bool walk(Source& source) {
+                    chunks.clear();
+                    data_chunk = 0;
+                    extended = false;
+
+                    // RIFF chunk
+                    const uint32_t riff_header_size =
+                        chunk_type::header_size + sizeof(uint32_t);
+                    uint32_t riff[3];
+                    if (source.size() < riff_header_size
+                            || !source.read(0,
+                                util::cast::pointer_cast<char*>(riff),
+                                riff_header_size)) {
+                        DBGLOG("The file is smaller than RIFF chunk header: "
+                                << source.size());
+                        return false;
+                    }
+                    extended = (   riff[0] == ds64_type::rf64_id
+                                || riff[0] == ds64_type::bw64_id);
+                    if (riff[0] != header_type::riff_id && !extended) {
+                        DBGLOG("Not RIFF: "
+                                << std::hex << "0x" << riff[0] << " != "
+                                << "0x" << header_type::riff_id << std::dec);
+                        return false;
+                    }
+                    if (riff[2] != header_type::wave_kind) {
+                        DBGLOG("Not WAV: "
+                                << std::hex << "0x" << riff[2] << " != "
+                                << "0x" << header_type::wave_kind
+                                << std::dec);
+                        return false;
+                    }
+
+                    // ds64 chunk
+                    uint64_t position = riff_header_size;
+                    uint64_t riff_size = riff[1];
+                    ds64_type ds64;
+                    std::vector<ds64_type::entry_type> table;
+                    if (extended) {
+                        uint32_t h[2];
+                        if (    source.size() < position
+                                    + chunk_type::header_size + sizeof(ds64)
+                             || !source.read(position,
+                                    util::cast::pointer_cast<char*>(h),
+                                    chunk_type::header_size)
+                             || h[0] != chunk_type::ds64_id
+                             || h[1] < sizeof(ds64)
+                             || !source.read(
+                                    position + chunk_type::header_size,
+                                    util::cast::pointer_cast<char*>(&ds64),
+                                    sizeof(ds64))) {
+                            DBGLOG("RF64 file doesn't have ds64 chunk");
+                            return false;
+                        }
+                        const uint64_t table_size = ds64.table_length
+                            * static_cast<uint64_t>(
+                                sizeof(ds64_type::entry_type));
+                        if (h[1] < sizeof(ds64) + table_size) {
+                            DBGLOG("The table of ds64 chunk is larger than"
+                                    " the chunk: " << ds64.table_length);
+                            return false;
+                        }
+                        if (position + chunk_type::header_size + sizeof(ds64)
+                                + table_size > source.size()) {
+                            DBGLOG("The table of ds64 chunk exceeds the file"
+                                    " size: " << ds64.table_length);
+                            return false;
+                        }
+                        if (ds64.table_length > 0) {
+                            table.resize(ds64.table_length);
+                            if (!source.read(position
+                                        + chunk_type::header_size
+                                        + sizeof(ds64),
+                                        util::cast::pointer_cast<char*>(
+                                            &table[0]),
+                                        static_cast<std::size_t>(
+                                            table_size))) {
+                                DBGLOG("Can't read the table of ds64 chunk");
+                                return false;
+                            }
+                        }
+                        riff_size = ds64.riff_size;
+                    }
+
+                    // The sizes from ds64 chunk are 64 bits, so compare them
+                    // without adding not to wrap.
+                    if (riff_size > source.size() - chunk_type::header_size) {
+                        DBGLOG("Data size of the RIFF chunk exceeds the file"
+                                " size: " << riff_size << " > "
+                                << source.size());
+                        return false;
+                    }
+                    const uint64_t riff_end =
+                        riff_size + chunk_type::header_size;
+
+                    // subchunks
+                    header_type::fmt_subchunk_type::data_type format;
+                    bool has_format = false;
+                    while (position + chunk_type::header_size <= riff_end) {
+                        uint32_t h[2];
+                        if (!source.read(position,
+                                    util::cast::pointer_cast<char*>(h),
+                                    chunk_type::header_size)) {
+                            DBGLOG("Can't read the chunk header at "
+                                    << position);
+                            return false;
+                        }
+
+                        chunk_type chunk;
+                        chunk.id = h[0];
+                        chunk.size = h[1];
+                        chunk.offset = position + chunk_type::header_size;
+                        if (extended && h[1] == chunk_type::size_in_ds64) {
+                            if (!large_size(chunk, ds64, table)) return false;
+                        }
+                        // The pad byte of the last chunk is often omitted.
+                        if (chunk.size > riff_end - chunk.offset) {
+                            DBGLOG("The chunk exceeds the RIFF chunk: "
+                                    << std::hex << "0x" << chunk.id
+                                    << std::dec << " at " << position);
+                            return false;
+                        }
+
+                        if (chunk.id == chunk_type::fmt_id && !has_format) {
+                            if (chunk.size < sizeof(format)) {
+                                DBGLOG("fmt chunk is too small: "
+                                        << chunk.size << " < "
+                                        << sizeof(format));
+                                return false;
+                            }
+                            if (!source.read(chunk.offset,
+                                        util::cast::pointer_cast<char*>(
+                                            &format),
+                                        sizeof(format))) {
+                                DBGLOG("Can't read fmt chunk");
+                                return false;
+                            }
+                            if (!format.validate()) return false;
+                            if (format.block_size == 0) {
+                                DBGLOG("The block size is zero");
+                                return false;
+                            }
+                            has_format = true;
+                        }
+
+                        chunks.push_back(chunk);
+                        // chunk.next() doesn't wrap as the chunk is in the
+                        // file, but the walk must go forward anyway.
+                        const uint64_t next = chunk.next();
+                        if (next <= position) {
+                            DBGLOG("The chunk doesn't go forward: "
+                                    << std::hex << "0x" << chunk.id
+                                    << std::dec << " at " << position);
+                            return false;
+                        }
+                        position = next;
+                    }
+
+                    if (!has_format) {
+                        DBGLOG("There is no fmt chunk");
+                        return false;
+                    }
+
+                    const chunk_type* found = find(chunk_type::data_id);
+                    if (found == 0) {
+                        DBGLOG("There is no data chunk");
+                        return false;
+                    }
+
+                    // elements and the canonical header
+                    properties.channels = format.channels;
+                    properties.bit_depth = format.bit_depth;
+                    properties.numof_samples = found->size / format.block_size;
+                    properties.sampling_rate = format.sampling_rate;
+
+                    const uint64_t clip = 0xffffffff - header_type::size_offset;
+                    canonical = header_type(properties);
+                    canonical.data_subchunk.size = static_cast<uint32_t>(
+                            std::min(found->size, clip));
+                    canonical.size = canonical.data_subchunk.size
+                        + header_type::size_offset;
+
+                    data_chunk = found;
+                    return true;
+                }
+
+                // the size of the chunk from ds64 chunk
+                static bool large_size(chunk_type& chunk, const ds64_type& ds64,
+                        const std::vector<ds64_type::entry_type>& table) {
+                    if (chunk.id == chunk_type::data_id) {
+                        chunk.size = ds64.data_size;
+                        return true;
+                    }
+                    for (std::vector<ds64_type::entry_type>::const_iterator
+                            itr = table.begin(); itr != table.end(); ++itr) {
+                        if (itr->id == chunk.id) {
+                            chunk.size = itr->size;
+                            return true;
+                        }
+                    }
+                    DBGLOG("The size of the chunk isn't in ds64 chunk: "
+                            << std::hex << "0x" << chunk.id << std::dec);
+                    return false;
+                }
+        };
+
         enum channel_type {
             // for mono
             MONO = 0,
@@ -379,11 +837,16 @@ namespace format {
                                 &data[ch * 2]));
                 }
                 // to get value of a channel in the form of uint32_t
+                // A sample has 3 bytes, so this can't read 4 bytes at once.
                 uint32_t value24(channel_type ch) const {
                     assert(static_cast<unsigned int>(ch) < Channels);
                     assert(Byte == 3);
-                    return *(util::cast::constpointer_cast<const uint32_t*>(
-                                &data[ch * 4])) & 0x00ffffff;
+                    const unsigned char* p =
+                        util::cast::constpointer_cast<const unsigned char*>(
+                                &data[ch * 3]);
+                    return    static_cast<uint32_t>(p[0])
+                           | (static_cast<uint32_t>(p[1]) << 8)
+                           | (static_cast<uint32_t>(p[2]) << 16);
                 }
                 // to get value of a channel in the form of uint32_t
                 uint32_t value32(channel_type ch) const {
@@ -407,6 +870,1145 @@ namespace format {
             o.write(util::cast::constpointer_cast<const char*>(&m), sizeof(m));
             return o;
         }
+
+        /*
+         *  Bulk conversions between interleaved samples and planar buffers.
+         *
+         *      interleaved: L0 R0 L1 R1 L2 R2 ...
+         *      planar:      L0 L1 L2 ...
+         *                   R0 R1 R2 ...
+         *
+         *  interleaver<Channels, Byte> has static functions that process the
+         *  samples [first, last):
+         *
+         *      split       interleaved samples -> planar buffers
+         *      merge       planar buffers -> interleaved samples
+         *      extract     interleaved samples -> a planar buffer of a channel
+         *
+         *  Stereo 8, 16 and 32 bit samples are processed by SSE2 / AVX2
+         *  kernels if available (see simd.hpp), the other 8, 16 and 32 bit
+         *  samples including 5.1 by SSE2 kernels that transpose the blocks
+         *  of frames, 24 bit samples by them with SSSE3, and mono by
+         *  std::memcpy(3). Scalar codes process the rest of them.
+         *  Use deinterleave(3), interleave(3), extract(4) and downmix(4)
+         *  below instead of calling these directly.
+         * */
+        template<const unsigned int Channels, const unsigned int Byte>
+        struct scalar_interleaver {
+            static const std::size_t frame_size = Channels * Byte;
+
+            static void split(  const char* src, char* const* planes,
+                                std::size_t first, std::size_t last) {
+                for (std::size_t i = first; i < last; ++i) {
+                    const char* frame = src + i * frame_size;
+                    for (unsigned int ch = 0; ch < Channels; ++ch) {
+                        std::memcpy(planes[ch] + i * Byte,
+                                frame + ch * Byte, Byte);
+                    }
+                }
+            }
+
+            static void merge(  const char* const* planes, char* dst,
+                                std::size_t first, std::size_t last) {
+                for (std::size_t i = first; i < last; ++i) {
+                    char* frame = dst + i * frame_size;
+                    for (unsigned int ch = 0; ch < Channels; ++ch) {
+                        std::memcpy(frame + ch * Byte,
+                                planes[ch] + i * Byte, Byte);
+                    }
+                }
+            }
+
+            static void extract(const char* src, unsigned int ch, char* dst,
+                                std::size_t first, std::size_t last) {
+                for (std::size_t i = first; i < last; ++i) {
+                    std::memcpy(dst + i * Byte,
+                            src + i * frame_size + ch * Byte, Byte);
+                }
+            }
+        };
+
+        template<const unsigned int Byte>
+        struct mono_interleaver {
+            static void split(  const char* src, char* const* planes,
+                                std::size_t first, std::size_t last) {
+                std::memcpy(planes[0] + first * Byte, src + first * Byte,
+                        (last - first) * Byte);
+            }
+
+            static void merge(  const char* const* planes, char* dst,
+                                std::size_t first, std::size_t last) {
+                std::memcpy(dst + first * Byte, planes[0] + first * Byte,
+                        (last - first) * Byte);
+            }
+
+            static void extract(const char* src, unsigned int ch, char* dst,
+                                std::size_t first, std::size_t last) {
+                assert(ch == 0);
+                std::memcpy(dst + first * Byte, src + first * Byte,
+                        (last - first) * Byte);
+            }
+        };
+
+#ifdef SIMD_SSE2
+        /*
+         *  Operations on SIMD registers for stereo samples.
+         *      even(a, b)  the left samples of a and b
+         *      odd(a, b)   the right samples of a and b
+         *      low(l, r)   the first half of interleaved l and r
+         *      high(l, r)  the second half of interleaved l and r
+         * */
+        template<const unsigned int Byte> struct stereo_lanes;
+
+        template<> struct stereo_lanes<1> {
+            static __m128i even(__m128i a, __m128i b) {
+                const __m128i mask = _mm_set1_epi16(0x00ff);
+                return _mm_packus_epi16(
+                        _mm_and_si128(a, mask), _mm_and_si128(b, mask));
+            }
+            static __m128i odd(__m128i a, __m128i b) {
+                return _mm_packus_epi16(
+                        _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+            }
+            static __m128i low(__m128i l, __m128i r) {
+                return _mm_unpacklo_epi8(l, r);
+            }
+            static __m128i high(__m128i l, __m128i r) {
+                return _mm_unpackhi_epi8(l, r);
+            }
+#ifdef SIMD_AVX2
+            static __m256i even(__m256i a, __m256i b) {
+                const __m256i mask = _mm256_set1_epi16(0x00ff);
+                return _mm256_permute4x64_epi64(_mm256_packus_epi16(
+                            _mm256_and_si256(a, mask),
+                            _mm256_and_si256(b, mask)), 0xd8);
+            }
+            static __m256i odd(__m256i a, __m256i b) {
+                return _mm256_permute4x64_epi64(_mm256_packus_epi16(
+                            _mm256_srli_epi16(a, 8),
+                            _mm256_srli_epi16(b, 8)), 0xd8);
+            }
+            static __m256i low(__m256i l, __m256i r) {
+                return _mm256_unpacklo_epi8(l, r);
+            }
+            static __m256i high(__m256i l, __m256i r) {
+                return _mm256_unpackhi_epi8(l, r);
+            }
+#endif
+        };
+
+        template<> struct stereo_lanes<2> {
+            // The samples are sign-extended to 32 bits, so packing with
+            // signed saturation never changes them.
+            static __m128i even(__m128i a, __m128i b) {
+                return _mm_packs_epi32(
+                        _mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+                        _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+            }
+            static __m128i odd(__m128i a, __m128i b) {
+                return _mm_packs_epi32(
+                        _mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+            }
+            static __m128i low(__m128i l, __m128i r) {
+                return _mm_unpacklo_epi16(l, r);
+            }
+            static __m128i high(__m128i l, __m128i r) {
+                return _mm_unpackhi_epi16(l, r);
+            }
+#ifdef SIMD_AVX2
+            static __m256i even(__m256i a, __m256i b) {
+                return _mm256_permute4x64_epi64(_mm256_packs_epi32(
+                            _mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16),
+                            _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16)),
+                        0xd8);
+            }
+            static __m256i odd(__m256i a, __m256i b) {
+                return _mm256_permute4x64_epi64(_mm256_packs_epi32(
+                            _mm256_srai_epi32(a, 16),
+                            _mm256_srai_epi32(b, 16)), 0xd8);
+            }
+            static __m256i low(__m256i l, __m256i r) {
+                return _mm256_unpacklo_epi16(l, r);
+            }
+            static __m256i high(__m256i l, __m256i r) {
+                return _mm256_unpackhi_epi16(l, r);
+            }
+#endif
+        };
+
+        template<> struct stereo_lanes<4> {
+            static __m128i even(__m128i a, __m128i b) {
+                return _mm_castps_si128(_mm_shuffle_ps(
+                            _mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                            _MM_SHUFFLE(2, 0, 2, 0)));
+            }
+            static __m128i odd(__m128i a, __m128i b) {
+                return _mm_castps_si128(_mm_shuffle_ps(
+                            _mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                            _MM_SHUFFLE(3, 1, 3, 1)));
+            }
+            static __m128i low(__m128i l, __m128i r) {
+                return _mm_unpacklo_epi32(l, r);
+            }
+            static __m128i high(__m128i l, __m128i r) {
+                return _mm_unpackhi_epi32(l, r);
+            }
+#ifdef SIMD_AVX2
+            static __m256i even(__m256i a, __m256i b) {
+                return _mm256_permute4x64_epi64(_mm256_castps_si256(
+                            _mm256_shuffle_ps(
+                                _mm256_castsi256_ps(a),
+                                _mm256_castsi256_ps(b),
+                                _MM_SHUFFLE(2, 0, 2, 0))), 0xd8);
+            }
+            static __m256i odd(__m256i a, __m256i b) {
+                return _mm256_permute4x64_epi64(_mm256_castps_si256(
+                            _mm256_shuffle_ps(
+                                _mm256_castsi256_ps(a),
+                                _mm256_castsi256_ps(b),
+                                _MM_SHUFFLE(3, 1, 3, 1))), 0xd8);
+            }
+            static __m256i low(__m256i l, __m256i r) {
+                return _mm256_unpacklo_epi32(l, r);
+            }
+            static __m256i high(__m256i l, __m256i r) {
+                return _mm256_unpackhi_epi32(l, r);
+            }
+#endif
+        };
+
+        template<const unsigned int Byte>
+        struct stereo_interleaver {
+            typedef stereo_lanes<Byte>              lanes;
+            typedef scalar_interleaver<2, Byte>     scalar;
+
+            static const std::size_t frame_size = 2 * Byte;
+            // a number of frames in a register
+            static const std::size_t frames128 = 16 / frame_size;
+#ifdef SIMD_AVX2
+            static const std::size_t frames256 = 32 / frame_size;
+#endif
+
+            static void split(  const char* src, char* const* planes,
+                                std::size_t first, std::size_t last) {
+                using namespace util::simd;
+                std::size_t i = first;
+#ifdef SIMD_AVX2
+                for (; i + 2 * frames256 <= last; i += 2 * frames256) {
+                    const char* s = src + i * frame_size;
+                    __m256i a = load256(s);
+                    __m256i b = load256(s + 32);
+                    store256(planes[0] + i * Byte, lanes::even(a, b));
+                    store256(planes[1] + i * Byte, lanes::odd(a, b));
+                }
+#endif
+                for (; i + 2 * frames128 <= last; i += 2 * frames128) {
+                    const char* s = src + i * frame_size;
+                    __m128i a = load128(s);
+                    __m128i b = load128(s + 16);
+                    store128(planes[0] + i * Byte, lanes::even(a, b));
+                    store128(planes[1] + i * Byte, lanes::odd(a, b));
+                }
+                scalar::split(src, planes, i, last);
+            }
+
+            static void merge(  const char* const* planes, char* dst,
+                                std::size_t first, std::size_t last) {
+                using namespace util::simd;
+                std::size_t i = first;
+#ifdef SIMD_AVX2
+                for (; i + 2 * frames256 <= last; i += 2 * frames256) {
+                    __m256i l = load256(planes[0] + i * Byte);
+                    __m256i r = load256(planes[1] + i * Byte);
+                    __m256i lo = lanes::low(l, r);
+                    __m256i hi = lanes::high(l, r);
+                    char* d = dst + i * frame_size;
+                    store256(d,      _mm256_permute2x128_si256(lo, hi, 0x20));
+                    store256(d + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+                }
+#endif
+                for (; i + 2 * frames128 <= last; i += 2 * frames128) {
+                    __m128i l = load128(planes[0] + i * Byte);
+                    __m128i r = load128(planes[1] + i * Byte);
+                    char* d = dst + i * frame_size;
+                    store128(d,      lanes::low(l, r));
+                    store128(d + 16, lanes::high(l, r));
+                }
+                scalar::merge(planes, dst, i, last);
+            }
+
+            static void extract(const char* src, unsigned int ch, char* dst,
+                                std::size_t first, std::size_t last) {
+                assert(ch < 2);
+                using namespace util::simd;
+                std::size_t i = first;
+#ifdef SIMD_AVX2
+                for (; i + 2 * frames256 <= last; i += 2 * frames256) {
+                    const char* s = src + i * frame_size;
+                    __m256i a = load256(s);
+                    __m256i b = load256(s + 32);
+                    store256(dst + i * Byte,
+                            ch == 0 ? lanes::even(a, b) : lanes::odd(a, b));
+                }
+#endif
+                for (; i + 2 * frames128 <= last; i += 2 * frames128) {
+                    const char* s = src + i * frame_size;
+                    __m128i a = load128(s);
+                    __m128i b = load128(s + 16);
+                    store128(dst + i * Byte,
+                            ch == 0 ? lanes::even(a, b) : lanes::odd(a, b));
+                }
+                scalar::extract(src, ch, dst, i, last);
+            }
+        };
+
+        /*
+         *  Operations on SIMD registers that have a sample in each lane.
+         *      width           the bytes of a lane
+         *      load(p)         the samples at p into the lanes
+         *      store(p, v)     the lanes to the samples at p
+         *      low(a, b)       the first half of interleaved lanes of a and b
+         *      high(a, b)      the second half of interleaved lanes of a and b
+         *  load(1) and store(2) access 16 bytes even if the samples are less.
+         * */
+        template<const unsigned int Byte> struct sample_lanes;
+
+        template<> struct sample_lanes<1> {
+            static const unsigned int width = 1;
+            static __m128i load(const char* p) {
+                return util::simd::load128(p);
+            }
+            static void store(char* p, __m128i v) {
+                util::simd::store128(p, v);
+            }
+            static __m128i low(__m128i a, __m128i b) {
+                return _mm_unpacklo_epi8(a, b);
+            }
+            static __m128i high(__m128i a, __m128i b) {
+                return _mm_unpackhi_epi8(a, b);
+            }
+        };
+
+        template<> struct sample_lanes<2> {
+            static const unsigned int width = 2;
+            static __m128i load(const char* p) {
+                return util::simd::load128(p);
+            }
+            static void store(char* p, __m128i v) {
+                util::simd::store128(p, v);
+            }
+            static __m128i low(__m128i a, __m128i b) {
+                return _mm_unpacklo_epi16(a, b);
+            }
+            static __m128i high(__m128i a, __m128i b) {
+                return _mm_unpackhi_epi16(a, b);
+            }
+        };
+
+        template<> struct sample_lanes<4> {
+            static const unsigned int width = 4;
+            static __m128i load(const char* p) {
+                return util::simd::load128(p);
+            }
+            static void store(char* p, __m128i v) {
+                util::simd::store128(p, v);
+            }
+            static __m128i low(__m128i a, __m128i b) {
+                return _mm_unpacklo_epi32(a, b);
+            }
+            static __m128i high(__m128i a, __m128i b) {
+                return _mm_unpackhi_epi32(a, b);
+            }
+        };
+
+#ifdef SIMD_SSSE3
+        // 24 bit samples are in 32 bit lanes, whose highest bytes are zero.
+        template<> struct sample_lanes<3> {
+            static const unsigned int width = 4;
+            static __m128i load(const char* p) {
+                const __m128i widen = _mm_setr_epi8(
+                        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+                return _mm_shuffle_epi8(util::simd::load128(p), widen);
+            }
+            static void store(char* p, __m128i v) {
+                const __m128i narrow = _mm_setr_epi8(
+                        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+                util::simd::store128(p, _mm_shuffle_epi8(v, narrow));
+            }
+            static __m128i low(__m128i a, __m128i b) {
+                return _mm_unpacklo_epi32(a, b);
+            }
+            static __m128i high(__m128i a, __m128i b) {
+                return _mm_unpackhi_epi32(a, b);
+            }
+        };
+#endif // SIMD_SSSE3
+
+        // f(0), f(1), ..., f(N - 1), that are unrolled by the template
+        template<   const unsigned int N, const unsigned int K = 0,
+                    const bool End = (K == N)>
+        struct unroll {
+            template<typename F>
+                static void apply(F& f) {
+                    f(K);
+                    unroll<N, K + 1>::apply(f);
+                }
+        };
+
+        template<const unsigned int N, const unsigned int K>
+        struct unroll<N, K, true> {
+            template<typename F> static void apply(F&) {}
+        };
+
+        template<const unsigned int Rows>
+        struct register_rows {
+            __m128i v[Rows];
+        };
+
+        /*
+         *  The perfect shuffle of Rows registers rotates the bits of the
+         *  indices of the row and the lane by 1, so log2(Rows) times of it
+         *  transpose them. The loops are unrolled by the templates to keep
+         *  the rows in the registers.
+         * */
+        template<typename Lanes, const unsigned int Rows>
+        struct perfect_shuffle {
+            const register_rows<Rows>* source;
+            register_rows<Rows>* result;
+            void operator()(unsigned int k) {
+                result->v[2 * k] =
+                    Lanes::low(source->v[k], source->v[k + Rows / 2]);
+                result->v[2 * k + 1] =
+                    Lanes::high(source->v[k], source->v[k + Rows / 2]);
+            }
+        };
+
+        template<   typename Lanes, const unsigned int Rows,
+                    const unsigned int N = Rows>
+        struct transposer {
+            static void apply(register_rows<Rows>& rows) {
+                const register_rows<Rows> source = rows;
+                perfect_shuffle<Lanes, Rows> shuffle = { &source, &rows };
+                unroll<Rows / 2>::apply(shuffle);
+                transposer<Lanes, Rows, N / 2>::apply(rows);
+            }
+        };
+
+        template<typename Lanes, const unsigned int Rows>
+        struct transposer<Lanes, Rows, 1> {
+            static void apply(register_rows<Rows>&) {}
+        };
+
+        /*
+         *  N-channel samples are processed in blocks of numof_lanes frames.
+         *  A frame is loaded into numof_parts registers of numof_lanes
+         *  channels, and the registers of a part of the frames are
+         *  transposed into the registers of the channels, or vice versa.
+         *  The loads and the stores of 16 bytes may reach the next frames,
+         *  that are stored later, and the last block that reaches the end
+         *  is processed by the scalar codes.
+         * */
+        template<const unsigned int Channels, const unsigned int Byte>
+        struct transpose_interleaver {
+            typedef sample_lanes<Byte>                  lanes;
+            typedef scalar_interleaver<Channels, Byte>  scalar;
+
+            static const std::size_t frame_size = Channels * Byte;
+            static const unsigned int numof_lanes = 16 / lanes::width;
+            static const unsigned int numof_parts =
+                (Channels + numof_lanes - 1) / numof_lanes;
+            // the bytes of a part
+            static const std::size_t part_size = numof_lanes * Byte;
+            // the bytes that the block accesses from the head
+            static const std::size_t reach = (numof_lanes - 1) * frame_size
+                + (numof_parts - 1) * part_size + 16;
+            // the frames that the block needs till last
+            static const std::size_t reach_frames =
+                (reach + frame_size - 1) / frame_size;
+            static const std::size_t store_frames = (16 + Byte - 1) / Byte;
+            static const std::size_t numof_frames =
+                (reach_frames > store_frames) ? reach_frames : store_frames;
+
+            typedef register_rows<numof_lanes>                  rows_type;
+            typedef transposer<lanes, numof_lanes>              transposer_type;
+
+            static void split(  const char* src, char* const* planes,
+                                std::size_t first, std::size_t last) {
+                std::size_t i = first;
+                for (std::size_t k = blocks(first, last); k > 0;
+                        --k, i += numof_lanes) {
+                    part_splitter splitter = {
+                        src + i * frame_size, planes, i * Byte
+                    };
+                    unroll<numof_parts>::apply(splitter);
+                }
+                scalar::split(src, planes, i, last);
+            }
+
+            static void merge(  const char* const* planes, char* dst,
+                                std::size_t first, std::size_t last) {
+                std::size_t i = first;
+                for (std::size_t k = blocks(first, last); k > 0;
+                        --k, i += numof_lanes) {
+                    register_rows<numof_parts * numof_lanes> rows;
+                    part_merger merger = { planes, i * Byte, &rows };
+                    unroll<numof_parts>::apply(merger);
+                    // in the order of the addresses, so that the bytes
+                    // over a part are stored again by the next one
+                    frame_storer storer = { dst + i * frame_size, &rows };
+                    unroll<numof_lanes * numof_parts>::apply(storer);
+                }
+                scalar::merge(planes, dst, i, last);
+            }
+
+            static void extract(const char* src, unsigned int ch, char* dst,
+                                std::size_t first, std::size_t last) {
+                assert(ch < Channels);
+                const char* const part = src + ch / numof_lanes * part_size;
+                std::size_t i = first;
+                for (std::size_t k = blocks(first, last); k > 0;
+                        --k, i += numof_lanes) {
+                    rows_type rows;
+                    frame_loader load = { part + i * frame_size, &rows };
+                    unroll<numof_lanes>::apply(load);
+                    transposer_type::apply(rows);
+                    __m128i row;
+                    row_picker pick = { &rows, ch % numof_lanes, &row };
+                    unroll<numof_lanes>::apply(pick);
+                    lanes::store(dst + i * Byte, row);
+                }
+                scalar::extract(src, ch, dst, i, last);
+            }
+
+            private:
+                // the number of the blocks from first that don't reach last
+                static std::size_t blocks(std::size_t first, std::size_t last) {
+                    return (first < last && last - first >= numof_frames)
+                        ? (last - first - numof_frames) / numof_lanes + 1 : 0;
+                }
+
+                // the row of the lane -> result, that is chosen by the
+                // constant indices to keep the rows in the registers
+                struct row_picker {
+                    const rows_type* rows;
+                    unsigned int lane;
+                    __m128i* result;
+                    void operator()(unsigned int k) {
+                        if (k == lane) *result = rows->v[k];
+                    }
+                };
+
+                // the part of the frames -> the rows
+                struct frame_loader {
+                    const char* src;
+                    rows_type* rows;
+                    void operator()(unsigned int f) {
+                        rows->v[f] = lanes::load(src + f * frame_size);
+                    }
+                };
+
+                // the rows -> the planes of the part p
+                struct plane_storer {
+                    char* const* planes;
+                    std::size_t offset;
+                    unsigned int p;
+                    const rows_type* rows;
+                    void operator()(unsigned int k) {
+                        const unsigned int ch = p * numof_lanes + k;
+                        if (ch < Channels) {
+                            lanes::store(planes[ch] + offset, rows->v[k]);
+                        }
+                    }
+                };
+
+                struct part_splitter {
+                    const char* src;
+                    char* const* planes;
+                    std::size_t offset;
+                    void operator()(unsigned int p) {
+                        rows_type rows;
+                        frame_loader load = { src + p * part_size, &rows };
+                        unroll<numof_lanes>::apply(load);
+                        transposer_type::apply(rows);
+                        plane_storer store = { planes, offset, p, &rows };
+                        unroll<numof_lanes>::apply(store);
+                    }
+                };
+
+                // the planes of the part p -> the rows of the frames
+                struct part_merger {
+                    const char* const* planes;
+                    std::size_t offset;
+                    register_rows<numof_parts * numof_lanes>* result;
+                    void operator()(unsigned int p) {
+                        rows_type rows;
+                        plane_loader load = { planes, offset, p, &rows };
+                        unroll<numof_lanes>::apply(load);
+                        transposer_type::apply(rows);
+                        part_mover move = { &rows, p, result };
+                        unroll<numof_lanes>::apply(move);
+                    }
+                };
+
+                // the rows of the part p -> the rows of the frames
+                struct part_mover {
+                    const rows_type* rows;
+                    unsigned int p;
+                    register_rows<numof_parts * numof_lanes>* result;
+                    void operator()(unsigned int f) {
+                        result->v[f * numof_parts + p] = rows->v[f];
+                    }
+                };
+
+                struct plane_loader {
+                    const char* const* planes;
+                    std::size_t offset;
+                    unsigned int p;
+                    rows_type* rows;
+                    void operator()(unsigned int k) {
+                        const unsigned int ch = p * numof_lanes + k;
+                        rows->v[k] = (ch < Channels)
+                            ? lanes::load(planes[ch] + offset)
+                            : _mm_setzero_si128();
+                    }
+                };
+
+                // the rows of the frames -> the frames
+                struct frame_storer {
+                    char* dst;
+                    const register_rows<numof_parts * numof_lanes>* rows;
+                    void operator()(unsigned int r) {
+                        lanes::store(dst + r / numof_parts * frame_size
+                                    + r % numof_parts * part_size,
+                                rows->v[r]);
+                    }
+                };
+        };
+
+        template<const unsigned int Channels, const unsigned int Byte>
+        struct interleaver : public transpose_interleaver<Channels, Byte> {};
+#ifndef SIMD_SSSE3
+        template<const unsigned int Channels>
+        struct interleaver<Channels, 3>
+            : public scalar_interleaver<Channels, 3> {};
+        template<> struct interleaver<1, 3> : public mono_interleaver<3> {};
+#endif
+#else
+        template<const unsigned int Channels, const unsigned int Byte>
+        struct interleaver : public scalar_interleaver<Channels, Byte> {};
+#endif // SIMD_SSE2
+
+        template<const unsigned int Byte>
+        struct interleaver<1, Byte> : public mono_interleaver<Byte> {};
+#ifdef SIMD_SSE2
+        template<> struct interleaver<2, 1> : public stereo_interleaver<1> {};
+        template<> struct interleaver<2, 2> : public stereo_interleaver<2> {};
+        template<> struct interleaver<2, 4> : public stereo_interleaver<4> {};
+#endif // SIMD_SSE2
+
+        /*
+         *  interleaved samples -> planar buffers
+         *  planes[ch] must have room for (last - first) * Byte bytes.
+         *  Usage:
+         *
+         *      std::vector<int16_t> left(n), right(n);
+         *      char* planes[] = {
+         *          util::cast::pointer_cast<char*>(&left[0]),
+         *          util::cast::pointer_cast<char*>(&right[0])
+         *      };
+         *      deinterleave(samples.begin(), samples.end(), planes);
+         * */
+        template<const unsigned int Channels, const unsigned int Byte>
+        inline void
+        deinterleave(   const basic_sample<Channels, Byte>* first,
+                        const basic_sample<Channels, Byte>* last,
+                        char* const* planes) {
+            interleaver<Channels, Byte>::split(
+                    util::cast::constpointer_cast<const char*>(first),
+                    planes, 0, last - first);
+        }
+
+        // planar buffers -> interleaved samples
+        // This returns the end of the result like std::copy(3).
+        template<const unsigned int Channels, const unsigned int Byte>
+        inline basic_sample<Channels, Byte>*
+        interleave( const char* const* planes, std::size_t numof_samples,
+                    basic_sample<Channels, Byte>* result) {
+            interleaver<Channels, Byte>::merge(planes,
+                    util::cast::pointer_cast<char*>(result),
+                    0, numof_samples);
+            return result + numof_samples;
+        }
+
+        // interleaved samples -> a planar buffer of the channel
+        // This returns the end of the result like std::copy(3).
+        template<const unsigned int Channels, const unsigned int Byte>
+        inline char*
+        extract(const basic_sample<Channels, Byte>* first,
+                const basic_sample<Channels, Byte>* last,
+                channel_type ch, char* result) {
+            assert(static_cast<unsigned int>(ch) < Channels);
+            interleaver<Channels, Byte>::extract(
+                    util::cast::constpointer_cast<const char*>(first),
+                    ch, result, 0, last - first);
+            return result + (last - first) * Byte;
+        }
+
+        // dst[i] += gain * src[i]
+        inline void
+        add_scaled(const float* src, float gain, float* dst, std::size_t n) {
+            std::size_t i = 0;
+#ifdef SIMD_AVX2
+            const __m256 g8 = _mm256_set1_ps(gain);
+            for (; i + 8 <= n; i += 8) {
+                _mm256_storeu_ps(dst + i, _mm256_add_ps(
+                            _mm256_loadu_ps(dst + i),
+                            _mm256_mul_ps(g8, _mm256_loadu_ps(src + i))));
+            }
+#endif
+#ifdef SIMD_SSE2
+            const __m128 g4 = _mm_set1_ps(gain);
+            for (; i + 4 <= n; i += 4) {
+                _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+                            _mm_mul_ps(g4, _mm_loadu_ps(src + i))));
+            }
+#endif
+            for (; i < n; ++i) dst[i] += gain * src[i];
+        }
+
+        /*
+         *  interleaved samples -> interleaved samples of other channels
+         *  The output channel o is the sum of gains[o * Channels + ch] *
+         *  the channel ch, that is rounded and clipped to the format like
+         *  from_float(4) of pcmconv.hpp. This returns the end of the result
+         *  like std::copy(3).
+         *  Usage (5.1 -> stereo by ITU-R BS.775, without LFE):
+         *
+         *      const float gains[] = {
+         *          1, 0, 0.7071f, 0, 0.7071f, 0,
+         *          0, 1, 0.7071f, 0, 0, 0.7071f
+         *      };
+         *      std::vector<basic_sample<2, 2> > stereo(last - first);
+         *      downmix(first, last, gains, &stereo[0]);
+         *
+         *  The samples are deinterleaved, converted to floats, mixed and
+         *  interleaved again in blocks of block_frames, by the kernels of
+         *  interleaver and pcm_converter.
+         * */
+        template<   const unsigned int Channels, const unsigned int Outputs,
+                    const unsigned int Byte>
+        inline basic_sample<Outputs, Byte>*
+        downmix(const basic_sample<Channels, Byte>* first,
+                const basic_sample<Channels, Byte>* last,
+                const float* gains,
+                basic_sample<Outputs, Byte>* result) {
+            const std::size_t block_frames = 1024;
+            std::vector<char> buffer(
+                    (Channels + Outputs) * block_frames * Byte);
+            std::vector<float> values(
+                    (Channels + Outputs) * block_frames);
+            char* inputs[Channels];
+            float* input_values[Channels];
+            for (unsigned int ch = 0; ch < Channels; ++ch) {
+                inputs[ch] = &buffer[ch * block_frames * Byte];
+                input_values[ch] = &values[ch * block_frames];
+            }
+            char* outputs[Outputs];
+            float* output_values[Outputs];
+            for (unsigned int o = 0; o < Outputs; ++o) {
+                outputs[o] = &buffer[(Channels + o) * block_frames * Byte];
+                output_values[o] = &values[(Channels + o) * block_frames];
+            }
+
+            while (first != last) {
+                const std::size_t n = std::min<std::size_t>(
+                        last - first, block_frames);
+                interleaver<Channels, Byte>::split(
+                        util::cast::constpointer_cast<const char*>(first),
+                        inputs, 0, n);
+                for (unsigned int ch = 0; ch < Channels; ++ch) {
+                    pcm_converter<Byte>::to_float(
+                            inputs[ch], input_values[ch], n);
+                }
+                for (unsigned int o = 0; o < Outputs; ++o) {
+                    std::fill(output_values[o], output_values[o] + n, 0.0f);
+                    for (unsigned int ch = 0; ch < Channels; ++ch) {
+                        const float gain = gains[o * Channels + ch];
+                        if (gain != 0) {
+                            add_scaled(input_values[ch], gain,
+                                    output_values[o], n);
+                        }
+                    }
+                    pcm_converter<Byte>::from_float(
+                            output_values[o], 0, outputs[o], n);
+                }
+                interleaver<Outputs, Byte>::merge(outputs,
+                        util::cast::pointer_cast<char*>(result), 0, n);
+                first += n;
+                result += n;
+            }
+            return result;
+        }
+
+        /*
+         *  A random-access range of samples that are placed on contiguous
+         *  memory, e.g. the data subchunk of a mapped file.
+         *  This doesn't own the memory.
+         * */
+        template<const unsigned int Channels, const unsigned int Byte>
+        class basic_sample_range {
+            public:
+                typedef basic_sample<Channels, Byte>    value_type;
+                typedef const value_type&               const_reference;
+                typedef const value_type*               const_iterator;
+                typedef const_iterator                  iterator;
+                typedef std::size_t                     size_type;
+
+            private:
+                const value_type* first;
+                const value_type* last;
+
+            public:
+                // constructor
+                basic_sample_range(void) : first(0), last(0) {}
+                basic_sample_range(const char* head, size_type numof_samples)
+                    : first(util::cast::constpointer_cast<const value_type*>(
+                                head)),
+                      last(first + numof_samples) {
+                    // basic_sample has no members except samples
+                    assert(sizeof(value_type) == Channels * Byte);
+                }
+
+                // getters
+                const_iterator begin(void) const { return first; }
+                const_iterator end(void) const { return last; }
+                size_type size(void) const { return last - first; }
+                bool empty(void) const { return first == last; }
+                const_reference operator[](size_type n) const {
+                    assert(n < size());
+                    return first[n];
+                }
+        };
+
+        /*
+         *  A class to read RIFF WAV file through the memory mapping.
+         *  The chunks are indexed by chunk_index in place and samples are
+         *  accessed directly on the mapped memory without any copies.
+         *  Usage:
+         *
+         *      format::riff_wav::mapped_file wav("foo.wav");
+         *      if (!wav.validate()) return 1;
+         *      format::riff_wav::basic_sample_range<2, 2> samples =
+         *          wav.samples<2, 2>();
+         *      uint16_t left = samples[0].value16(format::riff_wav::LEFT);
+         *
+         *  Call validate() before any other getters.
+         * */
+        class mapped_file {
+            private:
+                util::file::mapping file;
+                chunk_index index;
+
+            public:
+                // constructor
+                mapped_file(void) {}
+                explicit mapped_file(const char* path) { open(path); }
+
+                // open and close
+                bool open(const char* path) {
+                    if (!file.open(path)) return false;
+                    index.read(file.data(), file.size());
+                    return true;
+                }
+                void close(void) {
+                    file.close();
+                    index = chunk_index();
+                }
+                bool is_open(void) const { return file.is_open(); }
+
+                // utility function
+                bool validate(void) const {
+                    if (!file.is_open()) {
+                        DBGLOG("The file is not opened");
+                        return false;
+                    }
+                    return index.validate();
+                }
+
+                // getters
+                const chunk_index& chunks(void) const { return index; }
+                const header_type& header(void) const {
+                    return index.header();
+                }
+                elements_type elements(void) const {
+                    return index.elements();
+                }
+
+                // the payload of the data subchunk
+                const char* data(void) const {
+                    return file.data() + index.data().offset;
+                }
+                std::size_t data_size(void) const {
+                    return static_cast<std::size_t>(index.data().size);
+                }
+
+                // Channels and Byte must match with the header.
+                template<const unsigned int Channels, const unsigned int Byte>
+                basic_sample_range<Channels, Byte> samples(void) const {
+                    assert(header().fmt_subchunk.data.channels == Channels);
+                    assert(header().fmt_subchunk.data.bit_depth == Byte * 8);
+                    return basic_sample_range<Channels, Byte>(
+                            data(), data_size() / (Channels * Byte));
+                }
+        };
+
+        /*
+         *  A class to write RIFF WAV file whose length is unknown.
+         *  The header is reserved at first, samples are appended through a
+         *  large buffer, and the sizes in the header are patched on close().
+         *  Usage:
+         *
+         *      format::riff_wav::writer out("foo.wav", elements);
+         *      while (...) out.write(samples, samples + n);
+         *      if (!out.close()) return 1;
+         *
+         *  numof_samples in the elements is ignored.
+         *
+         *  A JUNK chunk is reserved between RIFF chunk header and fmt chunk.
+         *  If the file gets larger than 4 GiB, it's promoted to RF64 on
+         *  close(): the JUNK chunk is replaced with ds64 chunk that has the
+         *  64 bits sizes.
+         *
+         *  If direct is true, the file is written bypassing the page cache
+         *  (see rawfile.hpp). Then the buffer size is rounded up to a
+         *  multiple of raw_file::direct_alignment.
+         * */
+        class writer {
+            public:
+                static const std::size_t default_buffer_size = 1 << 20;
+
+            private:
+                typedef util::file::raw_file    file_type;
+
+                file_type file;
+                util::file::aligned_buffer buffer;
+                // a copy of the first block of the file for direct mode
+                util::file::aligned_buffer first_block;
+                std::size_t used;
+                uint64_t written;
+                uint64_t payload;
+                elements_type format;
+                bool direct;
+                bool failed;
+
+                // the reserved header: RIFF, JUNK (ds64), fmt, data
+                struct reserved_header_type {
+                    uint32_t id;
+                    uint32_t size;
+                    uint32_t format_kind;
+                    uint32_t ds64_id;
+                    uint32_t ds64_size;
+                    ds64_type ds64;
+                    header_type::fmt_subchunk_type fmt_subchunk;
+                    header_type::data_subchunk_type data_subchunk;
+                };
+
+            public:
+                // constructor
+                explicit writer(std::size_t buffer_size = default_buffer_size)
+                    : buffer(aligned_size(buffer_size),
+                             file_type::direct_alignment),
+                      first_block(file_type::direct_alignment,
+                                  file_type::direct_alignment) {
+                    reset();
+                }
+                writer( const char* path, const elements_type& e,
+                        bool direct = false,
+                        std::size_t buffer_size = default_buffer_size)
+                    : buffer(aligned_size(buffer_size),
+                             file_type::direct_alignment),
+                      first_block(file_type::direct_alignment,
+                                  file_type::direct_alignment) {
+                    reset();
+                    open(path, e, direct);
+                }
+
+                // destructor
+                ~writer(void) { close(); }
+
+                // open and close
+                bool open(const char* path, const elements_type& e,
+                        bool direct = false) {
+                    close();
+
+                    if (buffer.data() == 0 || first_block.data() == 0) {
+                        DBGLOG("Can't allocate buffers");
+                        return false;
+                    }
+
+                    int mode = file_type::WRITE;
+                    if (direct) mode |= file_type::DIRECT;
+                    if (!file.open(path, mode)) return false;
+
+                    this->direct = direct;
+                    format = e;
+                    format.numof_samples = 0;
+
+                    // reserve the header
+                    reserved_header_type header = make_header();
+                    std::memcpy(buffer.data(), &header, sizeof(header));
+                    used = sizeof(header);
+                    return true;
+                }
+
+                // This writes the rest of the buffer and patches the header.
+                // This returns false if any errors have occurred since
+                // open().
+                bool close(void) {
+                    if (!file.is_open()) return false;
+
+                    // a pad byte for odd size
+                    if (payload & 1) append("\0", 1);
+
+                    const uint64_t file_size = written + used;
+                    const reserved_header_type header = make_header();
+                    if (written == 0) {
+                        // The header is still in the buffer.
+                        std::memcpy(buffer.data(), &header, sizeof(header));
+                        flush();
+                    }
+                    else {
+                        flush();
+                        if (direct) {
+                            std::memcpy(first_block.data(),
+                                    &header, sizeof(header));
+                            failed |= !file.write(0, first_block.data(),
+                                    first_block.size());
+                        }
+                        else {
+                            failed |= !file.write(0,
+                                    util::cast::constpointer_cast<
+                                        const char*>(&header),
+                                    sizeof(header));
+                        }
+                    }
+                    // remove padding of direct mode
+                    if (direct) failed |= !file.truncate(file_size);
+
+                    file.close();
+                    const bool succeeded = !failed;
+                    reset();
+                    return succeeded;
+                }
+
+                bool is_open(void) const { return file.is_open(); }
+
+                // append samples
+                // size should be a multiple of the block size of the format
+                bool write(const char* samples, std::size_t size) {
+                    if (!file.is_open() || failed) return false;
+                    append(samples, size);
+                    payload += size;
+                    return !failed;
+                }
+
+                template<const unsigned int Channels, const unsigned int Byte>
+                bool write( const basic_sample<Channels, Byte>* first,
+                            const basic_sample<Channels, Byte>* last) {
+                    assert(format.channels == Channels);
+                    assert(format.bit_depth == Byte * 8);
+                    return write(
+                            util::cast::constpointer_cast<const char*>(first),
+                            (last - first) * sizeof(*first));
+                }
+
+                // getters
+                uint64_t numof_samples(void) const {
+                    const unsigned int block_size =
+                        format.channels * (format.bit_depth / 8);
+                    return block_size == 0 ? 0 : payload / block_size;
+                }
+
+            private:
+                // the header for current payload
+                reserved_header_type make_header(void) const {
+                    reserved_header_type header;
+                    const header_type canonical(format);
+                    const uint64_t riff_size = sizeof(header)
+                        - chunk_type::header_size + payload + (payload & 1);
+                    const bool extended = riff_size > 0xffffffff;
+
+                    header.id = extended ? ds64_type::rf64_id
+                                         : header_type::riff_id;
+                    header.size = extended ? chunk_type::size_in_ds64
+                                           : static_cast<uint32_t>(riff_size);
+                    header.format_kind = header_type::wave_kind;
+                    header.ds64_id = extended ? chunk_type::ds64_id
+                                              : chunk_type::junk_id;
+                    header.ds64_size = sizeof(ds64_type);
+                    header.ds64.riff_size = extended ? riff_size : 0;
+                    header.ds64.data_size = extended ? payload : 0;
+                    header.ds64.sample_count = extended ? numof_samples() : 0;
+                    header.ds64.table_length = 0;
+                    header.fmt_subchunk = canonical.fmt_subchunk;
+                    header.data_subchunk = canonical.data_subchunk;
+                    header.data_subchunk.size = extended
+                        ? chunk_type::size_in_ds64
+                        : static_cast<uint32_t>(payload);
+                    return header;
+                }
+
+                static std::size_t aligned_size(std::size_t size) {
+                    const std::size_t a = file_type::direct_alignment;
+                    return (size < a) ? a : (size + a - 1) / a * a;
+                }
+
+                void reset(void) {
+                    used = 0;
+                    written = 0;
+                    payload = 0;
+                    direct = false;
+                    failed = false;
+                }
+
+                void append(const char* src, std::size_t size) {
+                    while (size > 0) {
+                        const std::size_t n =
+                            std::min(size, buffer.size() - used);
+                        std::memcpy(buffer.data() + used, src, n);
+                        used += n;
+                        src += n;
+                        size -= n;
+                        if (used == buffer.size()) flush();
+                    }
+                }
+
+                // write the buffer
+                // The size must be a multiple of the alignment in direct
+                // mode, so the last one is padded with zeros.
+                void flush(void) {
+                    if (used == 0) return;
+                    std::size_t size = used;
+                    if (direct) {
+                        size = aligned_size(used);
+                        std::fill(buffer.data() + used,
+                                buffer.data() + size, 0);
+                    }
+
+                    if (written == 0) {
+                        std::memcpy(first_block.data(), buffer.data(),
+                                std::min(size, first_block.size()));
+                    }
+
+                    failed |= !file.write(written, buffer.data(), size);
+                    written += used;
+                    used = 0;
+                }
+
+                // not copyable
+                writer(const writer&);
+                writer& operator=(const writer&);
+        };
     }
 }
 
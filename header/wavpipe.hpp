@@ -0,0 +1,379 @@
+/*
+ * wavpipe.hpp
+ *  a pipeline to process the samples of RIFF WAV file block by block on
+ *  multiple threads
+ *
+ *  This uses thread.hpp, so link the thread library with GCC:
+ *
+ *      > g++ -Wall --pedantic -pthread main.cpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#ifndef WAVPIPE_HPP
+#define WAVPIPE_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+#include "dlogger.hpp"
+#include "rawfile.hpp"
+#include "thread.hpp"
+#include "wav.hpp"
+
+namespace format {
+    namespace riff_wav {
+        // a part of the data payload that is passed to kernels
+        struct block_type {
+            // the sequence number from 0
+            uint64_t index;
+            // the position of the first sample in the payload
+            uint64_t first_sample;
+            // interleaved samples
+            const char* data;
+            std::size_t size;
+            std::size_t numof_samples;
+        };
+
+        /*
+         *  A pipeline: reader -> N workers -> ordered writer.
+         *  Usage:
+         *
+         *      struct gain {
+         *          void operator()(const block_type& block,
+         *                          std::vector<char>& output) { ... }
+         *      };
+         *      writer out("out.wav", elements);
+         *      pipeline<gain> p(gain(), 4);
+         *      if (!p.run("in.wav", out)) return 1;
+         *      if (!out.close()) return 1;
+         *
+         *  The data payload is split into blocks of block_samples samples
+         *  (the last one may be shorter). Each worker calls its own copy of
+         *  the kernel, so kernels need not be thread-safe, but they must
+         *  not depend on the order of blocks. The kernel puts the result in
+         *  output (resize(1) it; the capacity is reused), and the results
+         *  are written to out in the order of blocks. So the output is
+         *  identical for any numbers of threads.
+         *
+         *  numof_threads is the number of workers; 0 means
+         *  util::thread::hardware_concurrency(). If it's 1, the blocks are
+         *  processed serially in the calling thread. At most depth blocks
+         *  are in flight; 0 means 2 * numof_threads.
+         * */
+        template<typename Kernel>
+        class pipeline {
+            public:
+                typedef Kernel  kernel_type;
+
+                static const std::size_t default_block_samples = 1 << 16;
+
+            private:
+                struct job_type {
+                    block_type block;
+                    std::vector<char> input;
+                    std::vector<char> output;
+                };
+
+                typedef std::deque<job_type*>           queue_type;
+                typedef std::map<uint64_t, job_type*>   finished_type;
+
+                // thread bodies
+                struct reader_task {
+                    pipeline* p;
+                    explicit reader_task(pipeline* p) : p(p) {}
+                    void operator()(void) { p->read_blocks(); }
+                };
+                struct worker_task {
+                    pipeline* p;
+                    kernel_type kernel;
+                    worker_task(pipeline* p, const kernel_type& kernel)
+                        : p(p), kernel(kernel) {}
+                    void operator()(void) { p->process_blocks(kernel); }
+                };
+
+                kernel_type kernel;
+                unsigned int numof_threads;
+                std::size_t block_samples;
+                std::size_t depth;
+
+                // the state while run(2)
+                util::file::raw_file file;
+                uint64_t first, last;
+                unsigned int block_size;
+                std::vector<job_type> jobs;
+                queue_type free_jobs;
+                queue_type pending;
+                finished_type finished;
+                uint64_t numof_blocks;
+                bool reading_done;
+                bool failed;
+
+                util::thread::mutex m;
+                util::thread::condition job_freed;
+                util::thread::condition job_pending;
+                util::thread::condition job_finished;
+
+            public:
+                // constructor
+                explicit pipeline(
+                        const kernel_type& kernel,
+                        unsigned int numof_threads = 0,
+                        std::size_t block_samples = default_block_samples,
+                        std::size_t depth = 0)
+                    : kernel(kernel), numof_threads(numof_threads),
+                      block_samples(block_samples), depth(depth) {
+                    if (this->numof_threads == 0) {
+                        this->numof_threads =
+                            util::thread::hardware_concurrency();
+                    }
+                    if (this->block_samples == 0) {
+                        this->block_samples = default_block_samples;
+                    }
+                    if (this->depth == 0) {
+                        this->depth = 2 * this->numof_threads;
+                    }
+                }
+
+                // This processes the data payload of the file at path and
+                // writes the results to out. out must be opened by the
+                // caller and is not closed.
+                bool run(const char* path, writer& out) {
+                    if (!file.open(path, util::file::raw_file::READ)) {
+                        return false;
+                    }
+
+                    chunk_index index;
+                    if (!index.read(file) || !index.validate()) {
+                        DBGLOG("Invalid WAV file: " << path);
+                        file.close();
+                        return false;
+                    }
+
+                    const elements_type e = index.elements();
+                    block_size = e.channels * (e.bit_depth / 8);
+                    first = index.data().offset;
+                    last = first + index.data().size;
+
+                    const bool succeeded = (numof_threads <= 1)
+                        ? run_serially(out) : run_parallel(out);
+                    file.close();
+                    return succeeded;
+                }
+
+            private:
+                // the reference path
+                bool run_serially(writer& out) {
+                    job_type job;
+                    uint64_t index = 0;
+                    for (uint64_t offset = first; offset < last; ++index) {
+                        if (!read_block(job, index, offset)) return false;
+                        offset += job.block.size;
+
+                        kernel(job.block, job.output);
+                        if (!job.output.empty() && !out.write(
+                                    &job.output[0], job.output.size())) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+
+                bool run_parallel(writer& out) {
+                    jobs.assign(depth, job_type());
+                    free_jobs.clear();
+                    for (std::size_t i = 0; i < jobs.size(); ++i) {
+                        free_jobs.push_back(&jobs[i]);
+                    }
+                    pending.clear();
+                    finished.clear();
+                    numof_blocks = 0;
+                    reading_done = false;
+                    failed = false;
+
+                    std::vector<util::thread::thread*> threads;
+                    threads.push_back(
+                            new util::thread::thread(reader_task(this)));
+                    for (unsigned int i = 0; i < numof_threads; ++i) {
+                        threads.push_back(new util::thread::thread(
+                                    worker_task(this, kernel)));
+                    }
+                    for (std::size_t i = 0; i < threads.size(); ++i) {
+                        if (!threads[i]->joinable()) {
+                            DBGLOG("Can't start a thread");
+                            stop();
+                        }
+                    }
+
+                    write_blocks(out);
+
+                    // join all threads
+                    for (std::size_t i = 0; i < threads.size(); ++i) {
+                        delete threads[i];
+                    }
+                    jobs.clear();
+                    return !failed;
+                }
+
+                // This reuses the buffer of the job.
+                bool read_block(job_type& job, uint64_t index,
+                                uint64_t offset) {
+                    const uint64_t rest = last - offset;
+                    const std::size_t size = static_cast<std::size_t>(
+                            std::min<uint64_t>(
+                                rest,
+                                static_cast<uint64_t>(block_samples)
+                                    * block_size));
+                    job.input.resize(size);
+                    if (!file.read(offset, &job.input[0], size)) return false;
+
+                    job.block.index = index;
+                    job.block.first_sample = (offset - first) / block_size;
+                    job.block.data = &job.input[0];
+                    job.block.size = size;
+                    job.block.numof_samples = size / block_size;
+                    return true;
+                }
+
+                // stages
+                void read_blocks(void) {
+                    uint64_t index = 0;
+                    for (uint64_t offset = first; offset < last; ++index) {
+                        job_type* job;
+                        {
+                            util::thread::scoped_lock lock(m);
+                            while (free_jobs.empty() && !failed) {
+                                job_freed.wait(m);
+                            }
+                            if (failed) return;
+                            job = free_jobs.front();
+                            free_jobs.pop_front();
+                        }
+
+                        if (!read_block(*job, index, offset)) {
+                            stop();
+                            return;
+                        }
+                        offset += job->block.size;
+
+                        {
+                            util::thread::scoped_lock lock(m);
+                            pending.push_back(job);
+                        }
+                        job_pending.notify_one();
+                    }
+
+                    {
+                        util::thread::scoped_lock lock(m);
+                        numof_blocks = index;
+                        reading_done = true;
+                    }
+                    job_pending.notify_all();
+                    job_finished.notify_all();
+                }
+
+                void process_blocks(kernel_type& body) {
+                    for (;;) {
+                        job_type* job;
+                        {
+                            util::thread::scoped_lock lock(m);
+                            while (pending.empty()
+                                    && !reading_done && !failed) {
+                                job_pending.wait(m);
+                            }
+                            if (pending.empty() || failed) return;
+                            job = pending.front();
+                            pending.pop_front();
+                        }
+
+                        body(job->block, job->output);
+
+                        {
+                            util::thread::scoped_lock lock(m);
+                            finished[job->block.index] = job;
+                        }
+                        job_finished.notify_all();
+                    }
+                }
+
+                void write_blocks(writer& out) {
+                    for (uint64_t index = 0; ; ++index) {
+                        job_type* job;
+                        {
+                            util::thread::scoped_lock lock(m);
+                            typename finished_type::iterator found;
+                            while ((found = finished.find(index))
+                                        == finished.end()
+                                    && !(reading_done && index == numof_blocks)
+                                    && !failed) {
+                                job_finished.wait(m);
+                            }
+                            if (failed || found == finished.end()) return;
+                            job = found->second;
+                            finished.erase(found);
+                        }
+
+                        if (!job->output.empty() && !out.write(
+                                    &job->output[0], job->output.size())) {
+                            stop();
+                            return;
+                        }
+
+                        {
+                            util::thread::scoped_lock lock(m);
+                            free_jobs.push_back(job);
+                        }
+                        job_freed.notify_one();
+                    }
+                }
+
+                // This makes all stages quit.
+                void stop(void) {
+                    {
+                        util::thread::scoped_lock lock(m);
+                        failed = true;
+                    }
+                    job_freed.notify_all();
+                    job_pending.notify_all();
+                    job_finished.notify_all();
+                }
+
+                // not copyable
+                pipeline(const pipeline&);
+                pipeline& operator=(const pipeline&);
+        };
+
+        // the kernel to extract a channel
+        template<const unsigned int Channels, const unsigned int Byte>
+        class channel_extractor {
+            public:
+                typedef basic_sample<Channels, Byte>    sample_type;
+
+            private:
+                channel_type ch;
+
+            public:
+                // constructor
+                explicit channel_extractor(channel_type ch) : ch(ch) {}
+
+                void operator()(const block_type& block,
+                                std::vector<char>& output) {
+                    const sample_type* first =
+                        util::cast::constpointer_cast<const sample_type*>(
+                                block.data);
+                    output.resize(block.numof_samples * Byte);
+                    if (output.empty()) return;
+                    extract(first, first + block.numof_samples, ch,
+                            &output[0]);
+                }
+        };
+    }
+}
+
+#endif // WAVPIPE_HPP
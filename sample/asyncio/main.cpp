@@ -0,0 +1,103 @@
+/*
+ * main.cpp
+ *  sample codes for asyncio.hpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <cstring>
+#include <iostream>
+#include <stdint.h>
+
+#include "../../header/asyncio.hpp"
+#include "../../header/bmp.hpp"
+#include "../../header/cast.hpp"
+#include "../../header/rawfile.hpp"
+#include "../../header/wav.hpp"
+
+// This finds the payload of RIFF WAV or Windows Bitmap file and the unit
+// of it: a frame or a row.
+bool find_payload(  const char* path,
+                    uint64_t& first, uint64_t& last, std::size_t& unit) {
+    util::file::raw_file file(path, util::file::raw_file::READ);
+    if (!file.is_open()) return false;
+
+    format::riff_wav::chunk_index index;
+    if (index.read(file) && index.validate()) {
+        const format::riff_wav::elements_type e = index.elements();
+        first = index.data().offset;
+        last = first + index.data().size;
+        unit = e.channels * (e.bit_depth / 8);
+        return true;
+    }
+
+    format::windows_bitmap::header_type header;
+    if (file.size() >= sizeof(header)
+            && file.read(0,
+                util::cast::pointer_cast<char*>(&header), sizeof(header))
+            && header.validate() && header.info_header.validate()) {
+        first = header.offset;
+        last = header.file_bytes;
+        // rows are aligned to 4 bytes
+        unit = (header.info_header.width
+                * format::windows_bitmap::header_type::bytes_per_pixel + 3)
+            & ~3;
+        return true;
+    }
+
+    return false;
+}
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 2) {
+        std::cerr
+            << "Usage: " << argv[0] << " file.wav|file.bmp\n"
+            << std::endl;
+        return 1;
+    }
+
+    uint64_t first, last;
+    std::size_t unit;
+    if (!find_payload(argv[1], first, last, unit)) {
+        std::cerr
+            << "bad file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    // read frames / rows with 4 reads of 1 MiB in flight
+    util::file::async_reader reader(1 << 20, 4);
+    if (!reader.open(argv[1], first, last, unit)) {
+        std::cerr
+            << "can't read the file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    uint64_t numof_units = 0;
+    uint32_t sum = 0;
+    util::file::async_reader::buffer_type buffer;
+    while (reader.next(buffer)) {
+        numof_units += buffer.size / unit;
+        for (std::size_t i = 0; i < buffer.size; ++i) {
+            sum += static_cast<unsigned char>(buffer.data[i]);
+        }
+    }
+    if (reader.failed()) {
+        std::cerr
+            << "failed to read: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    std::cout
+        << "backend:    "
+        << (reader.backend() == util::file::async_reader::IO_URING
+                ? "io_uring" : "threads") << "\n"
+        << "units:      " << numof_units << "\n"
+        << "sum:        " << sum << "\n"
+        << std::endl;
+
+    return 0;
+}
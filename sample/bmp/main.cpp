@@ -8,6 +8,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <stdint.h>
 
 #include "../../header/bmp.hpp"
 #include "../../header/io.hpp"
@@ -56,6 +57,35 @@ int main(const int argc, const char* const argv[]) {
         << "valid bmp file: " << argv[1] << "\n"
         << std::endl;
 
+    // the average color through the memory mapping
+    format::windows_bitmap::image_view image(argv[1]);
+    if (!image.validate()) {
+        std::cerr
+            << "can't map the file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    uint64_t red = 0, green = 0, blue = 0;
+    for (uint32_t y = 0; y < image.height(); ++y) {
+        const format::windows_bitmap::bgr_type* row = image.row(y);
+        for (uint32_t x = 0; x < image.width(); ++x) {
+            red += row[x].red;
+            green += row[x].green;
+            blue += row[x].blue;
+        }
+    }
+    const uint64_t numof_pixels =
+        static_cast<uint64_t>(image.width()) * image.height();
+    if (numof_pixels > 0) {
+        std::cout
+            << "average color: "
+            << red / numof_pixels << ", "
+            << green / numof_pixels << ", "
+            << blue / numof_pixels << "\n"
+            << std::endl;
+    }
+
     return 0;
 }
 
@@ -0,0 +1,66 @@
+/*
+ * main.cpp
+ *  sample codes for bmpdecoder.hpp
+ *
+ *  This converts Windows Bitmap file of any formats into 24bit one.
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+
+#include "../../header/bmp.hpp"
+#include "../../header/bmpdecoder.hpp"
+#include "../../header/bmpwriter.hpp"
+#include "../../header/mmap.hpp"
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 3) {
+        std::cerr
+            << "Usage: " << argv[0] << " input.bmp output.bmp\n"
+            << std::endl;
+        return 1;
+    }
+
+    util::file::mapping file(argv[1]);
+    format::windows_bitmap::decoder bmp;
+    if (!file.is_open() || !bmp.read(file.data(), file.size())) {
+        std::cerr
+            << "bad bmp file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+    std::cout
+        << bmp.width() << "x" << bmp.height() << ", "
+        << bmp.bits_per_pixel() << " bits, compression "
+        << bmp.compression_kind() << std::endl;
+
+    // the top row first
+    std::vector<format::windows_bitmap::bgr_type> pixels(
+            static_cast<std::size_t>(bmp.width()) * bmp.height());
+    const std::ptrdiff_t stride =
+        bmp.width() * sizeof(format::windows_bitmap::bgr_type);
+    if (!bmp.decode(&pixels[0], stride)) {
+        std::cerr
+            << "failed to decode: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::windows_bitmap::elements_type e = {
+        static_cast<int32_t>(bmp.width()),
+        static_cast<int32_t>(bmp.height())
+    };
+    format::windows_bitmap::writer out;
+    if (!out.write(argv[2], e, &pixels[0], stride)) {
+        std::cerr
+            << "failed to write: " << argv[2] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * main.cpp
+ *  sample codes for bmpscale.hpp
+ *
+ *  This makes a thumbnail of 24bit Windows Bitmap file. With "stream", the
+ *  rows are scaled one by one.
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+
+#include "../../header/bmp.hpp"
+#include "../../header/bmpscale.hpp"
+#include "../../header/bmpwriter.hpp"
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 5) {
+        std::cerr
+            << "Usage: " << argv[0]
+            << " input.bmp output.bmp width height"
+               " [box|bilinear|lanczos3] [stream]\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::windows_bitmap::image_view image(argv[1]);
+    if (!image.validate()) {
+        std::cerr
+            << "bad bmp file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::windows_bitmap::elements_type e = {
+        std::atoi(argv[3]),
+        std::atoi(argv[4])
+    };
+    if (e.width <= 0 || e.height <= 0) {
+        std::cerr
+            << "bad size: " << argv[3] << "x" << argv[4] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::windows_bitmap::filter_type filter =
+        format::windows_bitmap::LANCZOS3;
+    if (argc > 5 && std::strcmp(argv[5], "box") == 0) {
+        filter = format::windows_bitmap::BOX;
+    }
+    else if (argc > 5 && std::strcmp(argv[5], "bilinear") == 0) {
+        filter = format::windows_bitmap::BILINEAR;
+    }
+    const bool stream = argc > 6 && std::strcmp(argv[6], "stream") == 0;
+
+    // the top row first
+    std::vector<format::windows_bitmap::bgr_type> pixels(
+            static_cast<std::size_t>(e.width) * e.height);
+    const std::ptrdiff_t stride =
+        e.width * sizeof(format::windows_bitmap::bgr_type);
+    if (stream) {
+        format::windows_bitmap::stream_scaler s(
+                image.width(), image.height(), e.width, e.height, filter);
+        format::windows_bitmap::bgr_type* row = &pixels[0];
+        for (uint32_t y = 0; y < image.height(); ++y) {
+            if (!s.push(image.row(y))) return 1;
+            while (s.ready()) {
+                s.pop(row);
+                row += e.width;
+            }
+        }
+    }
+    else {
+        format::windows_bitmap::scaler s(
+                image.width(), image.height(), e.width, e.height, filter);
+        s.scale(image, &pixels[0], stride);
+    }
+
+    format::windows_bitmap::writer out;
+    if (!out.write(argv[2], e, &pixels[0], stride)) {
+        std::cerr
+            << "failed to write: " << argv[2] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
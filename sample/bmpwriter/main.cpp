@@ -0,0 +1,61 @@
+/*
+ * main.cpp
+ *  sample codes for bmpwriter.hpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+
+#include "../../header/bmp.hpp"
+#include "../../header/bmpwriter.hpp"
+
+// write a gradient image
+int main(const int argc, const char* const argv[]) {
+    if (argc < 4) {
+        std::cerr
+            << "Usage: " << argv[0] << " output.bmp width height [threads]\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::windows_bitmap::elements_type e = {
+        std::atoi(argv[2]),
+        std::atoi(argv[3])
+    };
+    if (e.width <= 0 || e.height <= 0) {
+        std::cerr
+            << "bad size: " << argv[2] << "x" << argv[3] << "\n"
+            << std::endl;
+        return 1;
+    }
+    const unsigned int numof_threads = argc > 4 ? std::atoi(argv[4]) : 0;
+
+    // the top row first
+    std::vector<format::windows_bitmap::bgr_type> pixels(
+            static_cast<std::size_t>(e.width) * e.height);
+    for (int32_t y = 0; y < e.height; ++y) {
+        for (int32_t x = 0; x < e.width; ++x) {
+            format::windows_bitmap::bgr_type& p =
+                pixels[static_cast<std::size_t>(y) * e.width + x];
+            p.red = static_cast<uint8_t>(x * 255 / e.width);
+            p.green = static_cast<uint8_t>(y * 255 / e.height);
+            p.blue = 128;
+        }
+    }
+
+    format::windows_bitmap::writer out(numof_threads);
+    if (!out.write(argv[1], e, &pixels[0],
+                e.width * sizeof(format::windows_bitmap::bgr_type))) {
+        std::cerr
+            << "failed to write: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
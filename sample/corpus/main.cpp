@@ -0,0 +1,62 @@
+/*
+ * main.cpp
+ *  sample codes for corpus.hpp
+ *
+ *  This validates the headers of the Windows Bitmap and WAV files under the
+ *  directories, or in the list from the standard input with "-".
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../../header/corpus.hpp"
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 2) {
+        std::cerr
+            << "Usage: " << argv[0] << " [-v] [-j threads] directory|- ...\n"
+            << std::endl;
+        return 1;
+    }
+
+    bool verbose = false;
+    unsigned int numof_threads = 0;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        }
+        else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            numof_threads = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "-") == 0) {
+            format::corpus::read_list(std::cin, paths);
+        }
+        else if (!format::corpus::list_files(argv[i], paths)) {
+            std::cerr
+                << "can't list the directory: " << argv[i] << "\n"
+                << std::endl;
+            return 1;
+        }
+    }
+
+    const std::clock_t start = std::clock();
+    format::corpus::scanner s(numof_threads);
+    std::vector<format::corpus::result_type> results;
+    s.scan(paths, results);
+    const std::clock_t end = std::clock();
+
+    format::corpus::report(std::cout, results, verbose);
+    std::cerr
+        << static_cast<double>(end - start) / CLOCKS_PER_SEC
+        << " sec of CPU time" << std::endl;
+
+    return 0;
+}
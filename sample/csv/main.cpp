@@ -0,0 +1,59 @@
+/*
+ * main.cpp
+ *  sample codes for csv.hpp
+ *
+ *  This reads the first three columns of a CSV file that has a header, as
+ *  integers, strings and floating point numbers. Without the file, this
+ *  reads the sample data from a stream.
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../header/csv.hpp"
+
+int main(const int argc, const char* const argv[]) {
+    std::vector<long> ids;
+    std::vector<std::string> names;
+    std::vector<double> prices;
+
+    format::csv::reader in(format::csv::csv(true));
+    in.bind(0, ids).bind(1, names).bind(2, prices);
+
+    bool ok;
+    if (argc > 1) {
+        ok = in.read(argv[1]);
+    }
+    else {
+        std::istringstream sample(
+                "id,name,price\r\n"
+                "1,apple,1.25\r\n"
+                "2,\"banana, yellow\",0.5\r\n"
+                "3,\"the \"\"best\"\" cherry\",12\r\n"
+                "\r\n"
+                "4,\"two\r\nlines\",\r\n");
+        ok = in.read(sample);
+    }
+    if (!ok) {
+        std::cerr << "can't read the records" << std::endl;
+        return 1;
+    }
+
+    const std::vector<std::string>& header = in.names();
+    for (std::size_t i = 0; i < header.size(); ++i) {
+        std::cout << (i ? "\t" : "") << header[i];
+    }
+    std::cout << "\n";
+    for (std::size_t i = 0; i < in.records(); ++i) {
+        std::cout
+            << ids[i] << "\t" << names[i] << "\t" << prices[i] << "\n";
+    }
+    std::cout << in.records() << " records" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * main.cpp
+ *  sample codes for mmap.hpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <algorithm>
+#include <iostream>
+
+#include "../../header/mmap.hpp"
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 2) {
+        std::cerr
+            << "Usage: " << argv[0] << " file\n"
+            << std::endl;
+        return 1;
+    }
+
+    util::file::mapping file(argv[1]);
+    if (!file.is_open()) {
+        std::cerr
+            << "bad file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    // count lines like "wc -l" without reading the file through a stream
+    std::cout
+        << std::count(file.begin(), file.end(), '\n') << " "
+        << argv[1] << "\n"
+        << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * main.cpp
+ *  sample codes for pcmconv.hpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "../../header/io.hpp"
+#include "../../header/pcmconv.hpp"
+#include "../../header/wav.hpp"
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 2) {
+        std::cerr
+            << "Usage: " << argv[0] << " file.wav > output.wav\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::riff_wav::mapped_file win(argv[1]);
+    if (!win.validate()) {
+        std::cerr
+            << "bad wav file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    // halve the volume in float and write it back with dither
+    const format::riff_wav::elements_type elements = win.elements();
+    const std::size_t numof_values =
+        win.data_size() / (elements.bit_depth / 8);
+    std::vector<float> values(numof_values);
+    if (!format::riff_wav::to_float(win.data(), numof_values,
+                elements.bit_depth, &values[0])) {
+        std::cerr
+            << "unsupported bit depth: " << elements.bit_depth << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    std::transform(values.begin(), values.end(), values.begin(),
+            std::bind2nd(std::multiplies<float>(), 0.5f));
+
+    std::vector<char> samples(win.data_size());
+    format::riff_wav::tpdf_dither dither;
+    format::riff_wav::from_float(&values[0], numof_values,
+            elements.bit_depth, &samples[0], dither);
+
+    util::io::set_stdout_binary();
+    std::cout << win.header();
+    std::cout.write(&samples[0], samples.size());
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * main.cpp
+ *  sample codes for pixconv.hpp
+ *
+ *  This converts 24bit Windows Bitmap file into PGM (gray) file.
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+
+#include "../../header/bmp.hpp"
+#include "../../header/cast.hpp"
+#include "../../header/io.hpp"
+#include "../../header/pixconv.hpp"
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 2) {
+        std::cerr
+            << "Usage: " << argv[0] << " file.bmp > output.pgm\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::windows_bitmap::image_view image(argv[1]);
+    if (!image.validate()) {
+        std::cerr
+            << "bad bmp file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> gray(
+            static_cast<std::size_t>(image.width()) * image.height());
+    if (!gray.empty()) format::windows_bitmap::to_gray(image, &gray[0]);
+
+    util::io::set_stdout_binary();
+    std::cout
+        << "P5\n"
+        << image.width() << " " << image.height() << "\n"
+        << "255\n";
+    if (!gray.empty()) {
+        std::cout.write(
+                util::cast::constpointer_cast<const char*>(&gray[0]),
+                gray.size());
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * main.cpp
+ *  sample codes for rawfile.hpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <iostream>
+#include <stdint.h>
+
+#include "../../header/rawfile.hpp"
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 3) {
+        std::cerr
+            << "Usage: " << argv[0] << " source destination\n"
+            << std::endl;
+        return 1;
+    }
+
+    // copy a file block by block
+    util::file::raw_file src(argv[1], util::file::raw_file::READ);
+    util::file::raw_file dst(argv[2], util::file::raw_file::WRITE);
+    if (!src.is_open() || !dst.is_open()) {
+        std::cerr
+            << "bad file\n"
+            << std::endl;
+        return 1;
+    }
+
+    util::file::aligned_buffer buffer(1 << 20,
+            util::file::raw_file::direct_alignment);
+    const uint64_t size = src.size();
+    for (uint64_t offset = 0; offset < size; offset += buffer.size()) {
+        const std::size_t n = (size - offset < buffer.size())
+            ? static_cast<std::size_t>(size - offset) : buffer.size();
+        if (    !src.read(offset, buffer.data(), n)
+             || !dst.write(offset, buffer.data(), n)) {
+            std::cerr
+                << "failed at " << offset << "\n"
+                << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout
+        << size << " bytes copied\n"
+        << std::endl;
+
+    return 0;
+}
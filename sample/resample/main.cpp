@@ -0,0 +1,182 @@
+/*
+ * main.cpp
+ *  sample codes for resample.hpp
+ *
+ *  This converts the sampling rate of a WAV file and reports the throughput
+ *  as a benchmark.
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+#include "../../header/pcmconv.hpp"
+#include "../../header/resample.hpp"
+#include "../../header/wav.hpp"
+
+// interleaved floats <-> planar floats
+void split(const float* src, std::size_t n, unsigned int channels,
+           std::vector< std::vector<float> >& planes) {
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+        for (std::size_t i = 0; i < n; ++i) {
+            planes[ch][i] = src[i * channels + ch];
+        }
+    }
+}
+void merge(const std::vector< std::vector<float> >& planes, std::size_t n,
+           unsigned int channels, float* dst) {
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+        for (std::size_t i = 0; i < n; ++i) {
+            dst[i * channels + ch] = planes[ch][i];
+        }
+    }
+}
+
+// This converts the samples and writes them.
+class converter {
+    private:
+        format::riff_wav::resampler& r;
+        format::riff_wav::writer& out;
+        format::riff_wav::tpdf_dither dither;
+        const unsigned int channels;
+        const unsigned int bit_depth;
+        std::vector< std::vector<float> > planes;
+        std::vector<float*> pointers;
+        std::vector<float> values;
+        std::vector<char> samples;
+
+    public:
+        converter(  format::riff_wav::resampler& r,
+                    format::riff_wav::writer& out,
+                    const format::riff_wav::elements_type& e,
+                    std::size_t numof_input)
+            : r(r), out(out), channels(e.channels), bit_depth(e.bit_depth),
+              planes(e.channels, std::vector<float>(r.max_output(numof_input))),
+              pointers(e.channels),
+              values(r.max_output(numof_input) * e.channels),
+              samples(values.size() * (e.bit_depth / 8)) {
+            for (unsigned int ch = 0; ch < channels; ++ch) {
+                pointers[ch] = &planes[ch][0];
+            }
+        }
+
+        float* const* buffers(void) { return &pointers[0]; }
+
+        bool write(std::size_t n) {
+            merge(planes, n, channels, &values[0]);
+            format::riff_wav::from_float(&values[0], n * channels,
+                    bit_depth, &samples[0], dither);
+            return out.write(&samples[0], n * channels * (bit_depth / 8));
+        }
+};
+
+int main(const int argc, const char* const argv[]) {
+    if (argc < 4) {
+        std::cerr
+            << "Usage: " << argv[0]
+            << " in.wav out.wav rate [fast|medium|best]\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::riff_wav::resampler::quality_type quality =
+        format::riff_wav::resampler::MEDIUM;
+    if (argc > 4) {
+        if (std::strcmp(argv[4], "fast") == 0) {
+            quality = format::riff_wav::resampler::FAST;
+        }
+        else if (std::strcmp(argv[4], "best") == 0) {
+            quality = format::riff_wav::resampler::BEST;
+        }
+    }
+
+    format::riff_wav::mapped_file win(argv[1]);
+    if (!win.is_open() || !win.validate()) {
+        std::cerr
+            << "bad wav file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+    format::riff_wav::elements_type elements = win.elements();
+    const unsigned int rate = std::atoi(argv[3]);
+    if (rate == 0) {
+        std::cerr
+            << "bad sampling rate: " << argv[3] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    format::riff_wav::elements_type outelements = elements;
+    outelements.sampling_rate = rate;
+    format::riff_wav::writer out(argv[2], outelements);
+    if (!out.is_open()) {
+        std::cerr
+            << "can't create the file: " << argv[2] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    const std::clock_t start = std::clock();
+
+    const unsigned int channels = elements.channels;
+    const unsigned int byte = elements.bit_depth / 8;
+    const std::size_t frame_size = channels * byte;
+    const std::size_t block_size = 4096;
+    format::riff_wav::resampler r(
+            elements.sampling_rate, rate, channels, quality);
+    converter conv(r, out, elements, block_size);
+
+    std::vector<float> values(block_size * channels);
+    std::vector< std::vector<float> > planes(
+            channels, std::vector<float>(block_size));
+    std::vector<const float*> pointers(channels);
+    for (unsigned int ch = 0; ch < channels; ++ch) {
+        pointers[ch] = &planes[ch][0];
+    }
+
+    const std::size_t numof_frames = win.data_size() / frame_size;
+    for (std::size_t i = 0; i < numof_frames; i += block_size) {
+        const std::size_t n = std::min(block_size, numof_frames - i);
+        if (!format::riff_wav::to_float(win.data() + i * frame_size,
+                    n * channels, elements.bit_depth, &values[0])) {
+            std::cerr
+                << "unsupported bit depth: " << elements.bit_depth << "\n"
+                << std::endl;
+            return 1;
+        }
+        split(&values[0], n, channels, planes);
+        if (!conv.write(r.process(&pointers[0], n, conv.buffers()))) break;
+    }
+    conv.write(r.flush(conv.buffers()));
+
+    if (!out.close()) {
+        std::cerr
+            << "failed to write: " << argv[2] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    // the throughput
+    const double seconds =
+        static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+    const double megabytes = win.data_size() / (1024.0 * 1024.0);
+    const double duration =
+        static_cast<double>(numof_frames) / elements.sampling_rate;
+    std::cerr
+        << "input:      " << megabytes << " MiB, " << duration << " s\n"
+        << "time:       " << seconds << " s\n";
+    if (seconds > 0) {
+        std::cerr
+            << "throughput: " << megabytes / seconds << " MiB/s, "
+            << duration / seconds << " x realtime\n";
+    }
+    std::cerr << std::endl;
+
+    return 0;
+}
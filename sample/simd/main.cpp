@@ -0,0 +1,27 @@
+/*
+ * main.cpp
+ *  sample codes for simd.hpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <iostream>
+
+#include "../../header/simd.hpp"
+
+int main(void) {
+    std::cout << "available instruction sets:";
+#ifdef SIMD_SSE2
+    std::cout << " SSE2";
+#endif
+#ifdef SIMD_SSSE3
+    std::cout << " SSSE3";
+#endif
+#ifdef SIMD_AVX2
+    std::cout << " AVX2";
+#endif
+    std::cout << "\n" << std::endl;
+
+    return 0;
+}
@@ -48,6 +48,22 @@ int main(const int argc, const char* const argv[]) {
                 checker)));
     std::cout << std::endl;
 
+    std::cout << "properties: \n";
+    for (int i = 0; i < argc; ++i) {
+        const util::string::check::numeral_type numeral =
+            checker.classify(argv[i]);
+        std::cout << argv[i] << ":"
+            << " sign " << numeral.sign
+            << " negative " << numeral.negative
+            << " integer " << numeral.integer
+            << " decimal " << numeral.decimal
+            << " exponent " << numeral.exponent
+            << " overflow " << numeral.overflow
+            << " digits " << numeral.integer_digits
+            << "." << numeral.fraction_digits << "\n";
+    }
+    std::cout << std::endl;
+
     // We must denote procedures in the form of classical iteration by using
     // "for" statements, because the STL's constraint that the combination of
     // std::bind1st and the member function that expects an argument that is a
@@ -0,0 +1,53 @@
+/*
+ * main.cpp
+ *  sample codes for strinfer.hpp
+ *
+ *  This infers the type of the arguments as a column, and the type of the
+ *  lines of the sample data.
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../../header/strinfer.hpp"
+
+using util::string::inferrer;
+
+const char* name(inferrer::type_type type) {
+    switch (type) {
+        case inferrer::EMPTY_COLUMN:    return "empty";
+        case inferrer::LONG_COLUMN:     return "long";
+        case inferrer::DOUBLE_COLUMN:   return "double";
+        default:                        return "string";
+    }
+}
+
+int main(const int argc, const char* const argv[]) {
+    inferrer infer;
+    std::vector<unsigned char> bits;
+
+    // the arguments
+    const inferrer::type_type type = infer.infer(argv + 1, argv + argc, bits);
+    for (std::size_t i = 0; i < bits.size(); ++i) {
+        std::cout << argv[i + 1] << ":"
+            << ((bits[i] & inferrer::INTEGER) ? " integer" : "")
+            << ((bits[i] & inferrer::DECIMAL) ? " decimal" : "")
+            << ((bits[i] & inferrer::EXPONENT) ? " exponent" : "")
+            << ((bits[i] & inferrer::NEGATIVE) ? " negative" : "")
+            << " -> " << name(inferrer::type(bits[i])) << "\n";
+    }
+    std::cout << "arguments: " << name(type) << "\n";
+
+    // the lines of a buffer
+    const std::string lines("3.14\r\n-2\r\n\r\n1e-3\r\n");
+    const char* const first = lines.data();
+    std::cout << "lines: "
+        << name(infer.infer(first, first + lines.size(), '\n', bits))
+        << " in " << bits.size() << " lines" << std::endl;
+
+    return 0;
+}
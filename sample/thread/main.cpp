@@ -0,0 +1,52 @@
+/*
+ * main.cpp
+ *  sample codes for thread.hpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "../../header/algorithm.hpp"
+#include "../../header/thread.hpp"
+
+// count up a shared counter
+class counting {
+    private:
+        util::thread::mutex& m;
+        unsigned int& counter;
+
+    public:
+        counting(util::thread::mutex& m, unsigned int& counter)
+            : m(m), counter(counter) {}
+
+        void operator()(void) {
+            for (unsigned int i = 0; i < 100000; ++i) {
+                util::thread::scoped_lock lock(m);
+                ++counter;
+            }
+        }
+};
+
+int main(void) {
+    const unsigned int numof_threads = util::thread::hardware_concurrency();
+    std::cout << "processors: " << numof_threads << std::endl;
+
+    util::thread::mutex m;
+    unsigned int counter = 0;
+
+    std::vector<util::thread::thread*> threads;
+    for (unsigned int i = 0; i < numof_threads + 1; ++i) {
+        threads.push_back(new util::thread::thread(counting(m, counter)));
+    }
+    // join all threads
+    std::for_each(threads.begin(), threads.end(),
+            util::algorithm::sweeper());
+
+    std::cout << "counter: " << counter << std::endl;
+
+    return 0;
+}
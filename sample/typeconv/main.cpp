@@ -95,6 +95,17 @@ int main(const int argc, const char* argv[]) {
     conv.split(joined, is, ", ");
     std::copy(is.begin(), is.end(), std::ostream_iterator<int>(std::cout, "\n"));
 
+    // split and join without allocations for each field
+    std::vector<string_ref> fields;
+    conv.split_view(joined, fields, ", ");
+    conv.split_view(joined, is, ", ");
+    std::string buffer;
+    conv.join_into(fields.begin(), fields.end(), buffer, " | ");
+    cout << buffer << "\n";
+    buffer.clear();
+    conv.join_into(is.begin(), is.end(), buffer, "; ");
+    cout << buffer << endl;
+
     return 0;
 }
 
@@ -7,10 +7,9 @@
  * */
 
 #include <algorithm>
-#include <fstream>
-#include <functional>
+#include <cstddef>
 #include <iostream>
-#include <iterator>
+#include <vector>
 #include <stdint.h>
 
 #include "../../header/cast.hpp"
@@ -19,13 +18,23 @@
 
 template<const unsigned int Channels, const unsigned int Byte>
 inline void
-channel_filter( std::istream& in, std::ostream& out,
+channel_filter( const format::riff_wav::mapped_file& in, std::ostream& out,
                 format::riff_wav::channel_type ch) {
     typedef format::riff_wav::basic_sample<Channels, Byte> sample_type;
-    std::istream_iterator<sample_type> eof, iitr(in);
-    std::transform(iitr, eof,
-            std::ostream_iterator<typename sample_type::mono_type>(out),
-            std::bind2nd(std::mem_fun_ref(&sample_type::channel), ch));
+    format::riff_wav::basic_sample_range<Channels, Byte> samples =
+        in.samples<Channels, Byte>();
+
+    // extract the channel block by block
+    const std::size_t block_size = 4096;
+    std::vector<char> buffer(block_size * Byte);
+    for (const sample_type* first = samples.begin();
+            first != samples.end(); ) {
+        const sample_type* last = first + std::min<std::size_t>(
+                block_size, samples.end() - first);
+        format::riff_wav::extract(first, last, ch, &buffer[0]);
+        out.write(&buffer[0], (last - first) * Byte);
+        first = last;
+    }
 }
 
 int main(const int argc, const char* const argv[]) {
@@ -52,25 +61,23 @@ int main(const int argc, const char* const argv[]) {
     }
 
     // mono-ize
-    // reading
-    std::ifstream win(argv[1], std::ios::binary);
-    if (!win.good()) {
+    // reading through the memory mapping
+    format::riff_wav::mapped_file win(argv[1]);
+    if (!win.is_open()) {
         std::cerr
             << "bad file.\n"
             << std::endl;
         return 1;
     }
 
-    format::riff_wav::header_type inheader;
-    win >> inheader;
-    if (!inheader.validate() || !inheader.validate(win)) {
+    if (!win.validate()) {
         std::cerr
             << "bad wav file: " << argv[1] << "\n"
             << std::endl;
         return 1;
     }
 
-    format::riff_wav::elements_type elements = inheader.elements();
+    format::riff_wav::elements_type elements = win.elements();
     if (elements.channels == 1) {
         std::cerr
             << "already mono wav file: " << argv[1] << "\n"
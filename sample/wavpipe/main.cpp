@@ -0,0 +1,62 @@
+/*
+ * main.cpp
+ *  sample codes for wavpipe.hpp
+ *
+ *  Copyright (C) 2010 janus_wel<janus.wel.3@gmail.com>
+ *  see LICENSE for redistributing, modifying, and so on.
+ * */
+
+#include <cstdlib>
+#include <iostream>
+
+#include "../../header/wav.hpp"
+#include "../../header/wavpipe.hpp"
+
+// mono-ize stereo 16 bits samples on some threads
+int main(const int argc, const char* const argv[]) {
+    if (argc < 3) {
+        std::cerr
+            << "Usage: " << argv[0] << " in.wav out.wav [threads]\n"
+            << std::endl;
+        return 1;
+    }
+    const unsigned int numof_threads =
+        argc > 3 ? std::atoi(argv[3]) : 0;
+
+    format::riff_wav::mapped_file in(argv[1]);
+    if (!in.is_open() || !in.validate()) {
+        std::cerr
+            << "bad wav file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+    format::riff_wav::elements_type elements = in.elements();
+    if (elements.channels != 2 || elements.bit_depth != 16) {
+        std::cerr
+            << "not a stereo 16 bits wav file: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+    in.close();
+
+    elements.channels = 1;
+    format::riff_wav::writer out(argv[2], elements);
+    if (!out.is_open()) {
+        std::cerr
+            << "can't create the file: " << argv[2] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    typedef format::riff_wav::channel_extractor<2, 2> kernel_type;
+    format::riff_wav::pipeline<kernel_type> p(
+            kernel_type(format::riff_wav::LEFT), numof_threads);
+    if (!p.run(argv[1], out) || !out.close()) {
+        std::cerr
+            << "failed to process: " << argv[1] << "\n"
+            << std::endl;
+        return 1;
+    }
+
+    return 0;
+}